@@ -0,0 +1,404 @@
+#include "BlockLayout.h"
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include "ExecuteInstruction.h"
+#include "globals.h"
+
+//first line of a profile
+const string PROFILE_MAGIC = "B17PROFILE";
+
+//names of the host events in the layout report
+static const char *LAYOUT_EVENT_NAMES[HOST_EVENTS] = { "cycles", "instructions", "branch-misses", "L1D-misses" };
+
+/************************************************************************
+Function: BlockLayout
+Author: Jake Davidson
+Description: Constructs the layout of a program in file order, with no
+counts. Each slot holds the instruction of the same position and links to
+the slot after it.
+Parameters: program - instructions vector
+			instructionRegister - current instruction, moved when reordering
+************************************************************************/
+BlockLayout::BlockLayout(vector<instruction> &program, vector<instruction>::iterator &instructionRegister)
+	: program(program), instructionRegister(instructionRegister), executed(program.size(), 0), jumped(program.size(), 0),
+	original(program.size()), slot(program.size()), profiling(false), blocks(0), chains(0), sequentialBefore(0), sequentialAfter(0),
+	baselineSteps(0)
+{
+	for (size_t n = 0; n < program.size(); n++)
+		original[n] = slot[n] = (int)n;
+	for (int e = 0; e < HOST_EVENTS; e++)
+		baseline[e] = 0;
+	this->relink();
+}
+
+/************************************************************************
+Function: relink
+Author: Jake Davidson
+Description: Sets the link of each slot to the slot of the next
+instruction in file order, and the slot of each address to the slot of
+the first instruction in file order with that address.
+************************************************************************/
+void BlockLayout::relink() {
+	unsigned int addresses = 0; //one more than the highest address
+	for (instruction &i : program)
+		addresses = max(addresses, i.instructionAddress + 1);
+	links.assign(program.size(), -1);
+	addressSlot.assign(addresses, -1);
+	for (size_t n = 0; n < program.size(); n++) {
+		if (n + 1 < program.size())
+			links[slot[n]] = slot[n + 1];
+		int &target = addressSlot[program[slot[n]].instructionAddress]; //slot jumps to the address go to
+		if (target < 0)
+			target = slot[n];
+	}
+}
+
+/************************************************************************
+Function: programHash
+Author: Jake Davidson
+Description: Hashes the address and hex string of every instruction in
+file order with 64-bit FNV-1a, to tell whether a profile is of this
+program.
+Returns: the hash
+************************************************************************/
+uint64_t BlockLayout::programHash() {
+	uint64_t hash = 0xcbf29ce484222325ULL; //FNV-1a offset basis
+	for (size_t n = 0; n < program.size(); n++) {
+		instruction &i = program[slot[n]];
+		string bytes = to_string(i.instructionAddress) + " " + i.instructionHexString + "\n"; //what is hashed for i
+		for (char c : bytes) {
+			hash ^= (unsigned char)c;
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	return hash;
+}
+
+/************************************************************************
+Function: record
+Author: Jake Davidson
+Description: Counts an instruction the machine executed, and whether it
+went anywhere other than the next instruction in file order.
+Parameters: from - the instruction executed
+			to - the instruction executed after it
+************************************************************************/
+void BlockLayout::record(vector<instruction>::iterator from, vector<instruction>::iterator to) {
+	int s = (int)(from - program.begin()); //slot of the instruction
+	executed[original[s]]++;
+	if (to - program.begin() != links[s])
+		jumped[original[s]]++;
+}
+
+/************************************************************************
+Function: readProfile
+Author: Jake Davidson
+Description: Adds the counts of a profile written by writeProfile, along
+with its host events if it has them. Nothing is added if the profile is
+of another program.
+Parameters: file - the profile
+Returns: false if it cannot be read or is of another program
+************************************************************************/
+bool BlockLayout::readProfile(string file) {
+	ifstream fin(file); //profile being read
+	string magic; //first word of the file
+	size_t count, n; //instructions in the profile, instruction of a line
+	uint64_t hash; //hash of the profiled program
+	unsigned long long steps, e, j; //steps of the profiled run, counts of an instruction
+	double events[HOST_EVENTS] = {}; //host events per 1000 instructions of the profiled run
+	vector<pair<size_t, pair<unsigned long long, unsigned long long> > > counts; //counts read
+	if (!(fin >> magic >> count >> hex >> hash >> dec >> steps) || magic != PROFILE_MAGIC || count != program.size() || hash != this->programHash())
+		return false;
+	for (int v = 0; v < HOST_EVENTS; v++)
+		fin >> events[v];
+	if (!fin)
+		return false;
+	while (fin >> n >> e >> j) {
+		if (n >= count)
+			return false;
+		counts.push_back(make_pair(n, make_pair(e, j)));
+	}
+	for (auto &c : counts) {
+		executed[c.first] += c.second.first;
+		jumped[c.first] += c.second.second;
+	}
+	baselineSteps = steps;
+	for (int v = 0; v < HOST_EVENTS; v++)
+		baseline[v] = events[v];
+	return true;
+}
+
+/************************************************************************
+Function: writeProfile
+Author: Jake Davidson
+Description: Writes the counts as a profile: the magic word, the number
+of instructions, the program hash, the steps and host events per 1000
+instructions of the run (0 steps if there are none), then the counts of
+every instruction that executed, in file order.
+Parameters: file - the profile to write
+			steps - steps of the run
+			perThousand - its host events per 1000 instructions, nullptr if it was reordered
+Returns: false if the file cannot be written
+************************************************************************/
+bool BlockLayout::writeProfile(string file, unsigned long long steps, const double perThousand[HOST_EVENTS]) {
+	ofstream fout(file); //profile being written
+	if (!fout)
+		return false;
+	fout << PROFILE_MAGIC << " " << program.size() << " " << hex << this->programHash() << dec << " " << (perThousand ? steps : 0);
+	for (int e = 0; e < HOST_EVENTS; e++)
+		fout << " " << (perThousand ? perThousand[e] : 0.0);
+	fout << endl;
+	for (size_t n = 0; n < program.size(); n++) {
+		if (executed[n] > 0)
+			fout << n << " " << executed[n] << " " << jumped[n] << endl;
+	}
+	return (bool)fout;
+}
+
+/************************************************************************
+Function: sequentialShare
+Author: Jake Davidson
+Description: Finds how many of the counted transitions from one
+instruction to the next go to the next slot of the current layout, which
+the host reads from the next few bytes of the store.
+Returns: the share of transitions, 0 if none were counted
+************************************************************************/
+double BlockLayout::sequentialShare() {
+	unsigned long long total = 0, sequential = 0; //transitions, those to the next slot
+	vector<instruction>::iterator target; //slot a jump goes to
+	for (size_t n = 0; n < program.size(); n++) {
+		total += executed[n];
+		if (n + 1 < program.size() && slot[n + 1] == slot[n] + 1)
+			sequential += executed[n] - jumped[n];
+		if (jumped[n] > 0 && this->find((unsigned int)program[slot[n]].EA, target) && target - program.begin() == slot[n] + 1)
+			sequential += jumped[n];
+	}
+	return total ? (double)sequential / total : 0;
+}
+
+/************************************************************************
+Function: reorder
+Author: Jake Davidson
+Description: Finds the basic blocks of the program in file order and the
+counted edges between them, chains the blocks along the edges from the
+most executed, then rebuilds the instructions vector chain by chain with
+the links and address table to match. The instruction register moves to
+the new slot of its instruction.
+************************************************************************/
+void BlockLayout::reorder() {
+	size_t count = program.size(); //instructions in the program
+	vector<int> blockOf(count), blockStart; //block of each instruction, first instruction of each block
+	vector<bool> leader(count, false); //true for the first instruction of a block
+	vector<instruction>::iterator target; //target of a jump
+	vector<pair<unsigned long long, pair<int, int> > > edges; //weight, then the blocks an edge leaves and enters
+	int current = original[instructionRegister - program.begin()]; //instruction being executed
+	if (count == 0)
+		return;
+	sequentialBefore = this->sequentialShare();
+
+	//a block starts at the first instruction, a jump target and after a jump or halt
+	leader[0] = true;
+	for (size_t n = 0; n < count; n++) {
+		instruction &i = program[slot[n]];
+		bool jump = i.opCode == J || i.opCode == JZ || i.opCode == JN || i.opCode == JP; //true if i is a jump
+		if (jump && this->find((unsigned int)i.EA, target))
+			leader[original[target - program.begin()]] = true;
+		if ((jump || i.opCode == HALT) && n + 1 < count)
+			leader[n + 1] = true;
+	}
+	for (size_t n = 0; n < count; n++) {
+		if (leader[n])
+			blockStart.push_back((int)n);
+		blockOf[n] = (int)blockStart.size() - 1;
+	}
+	blocks = (int)blockStart.size();
+	blockStart.push_back((int)count);
+
+	//edges leave from the last instruction of a block
+	for (int b = 0; b < blocks; b++) {
+		int last = blockStart[b + 1] - 1; //last instruction of the block
+		instruction &i = program[slot[last]];
+		if (i.opCode != J && i.opCode != HALT && b + 1 < blocks)
+			edges.push_back(make_pair(executed[last] - jumped[last], make_pair(b, b + 1)));
+		if (jumped[last] > 0 && this->find((unsigned int)i.EA, target))
+			edges.push_back(make_pair(jumped[last], make_pair(b, blockOf[original[target - program.begin()]])));
+	}
+	stable_sort(edges.begin(), edges.end(), [](const pair<unsigned long long, pair<int, int> > &a, const pair<unsigned long long, pair<int, int> > &b) {
+		return a.first > b.first;
+	});
+
+	//join chains along the edges, hottest first
+	vector<int> chainOf(blocks), after(blocks, -1), before(blocks, -1); //chain of each block, block after and before it
+	for (int b = 0; b < blocks; b++)
+		chainOf[b] = b;
+	for (auto &edge : edges) {
+		int from = edge.second.first, to = edge.second.second; //blocks of the edge
+		if (edge.first == 0 || from == to || after[from] >= 0 || before[to] >= 0 || chainOf[from] == chainOf[to])
+			continue;
+		after[from] = to;
+		before[to] = from;
+		for (int b = to; b >= 0; b = after[b])
+			chainOf[b] = chainOf[from];
+	}
+
+	//the chain being executed first, then the hottest chains, cold chains in file order
+	vector<int> heads; //first block of each chain
+	vector<unsigned long long> heat(blocks, 0); //most executed block of each chain, by chain
+	for (int b = 0; b < blocks; b++) {
+		heat[chainOf[b]] = max(heat[chainOf[b]], executed[blockStart[b]]);
+		if (before[b] < 0)
+			heads.push_back(b);
+	}
+	int first = chainOf[blockOf[current]]; //chain being executed
+	stable_sort(heads.begin(), heads.end(), [&](int a, int b) {
+		if ((chainOf[a] == first) != (chainOf[b] == first))
+			return chainOf[a] == first;
+		return heat[chainOf[a]] > heat[chainOf[b]];
+	});
+	chains = (int)heads.size();
+
+	//rebuild the vector chain by chain
+	vector<instruction> reordered; //program in the new layout
+	vector<int> order; //instruction in file order of each new slot
+	reordered.reserve(count);
+	for (int head : heads) {
+		for (int b = head; b >= 0; b = after[b]) {
+			for (int n = blockStart[b]; n < blockStart[b + 1]; n++) {
+				order.push_back(n);
+				reordered.push_back(program[slot[n]]);
+			}
+		}
+	}
+	program.swap(reordered);
+	original = order;
+	for (size_t s = 0; s < count; s++)
+		slot[original[s]] = (int)s;
+	this->relink();
+	instructionRegister = program.begin() + slot[current];
+	sequentialAfter = this->sequentialShare();
+}
+
+/************************************************************************
+Function: printSummary
+Author: Jake Davidson
+Description: Prints the blocks and chains of the layout and the share of
+counted transitions that go to the next slot before and after it.
+Parameters: out - stream to print to
+************************************************************************/
+void BlockLayout::printSummary(ostream &out) {
+	out << setfill(' ') << dec << "Layout: " << blocks << " basic blocks in " << chains << " chains, "
+		<< fixed << setprecision(2) << "transitions to the next slot " << 100 * sequentialBefore << "% in file order, "
+		<< 100 * sequentialAfter << "% reordered" << defaultfloat << endl;
+}
+
+/************************************************************************
+Function: printEvents
+Author: Jake Davidson
+Description: Prints a row of host events per 1000 instructions.
+Parameters: out - stream to print to
+			name - name of the row
+			perThousand - host events per 1000 instructions
+			counters - the counters, to tell which events were counted
+************************************************************************/
+static void printEvents(ostream &out, string name, const double perThousand[HOST_EVENTS], HostCounters &counters) {
+	out << left << setw(30) << name << right << fixed << setprecision(1);
+	for (int e = 0; e < HOST_EVENTS; e++) {
+		out << setw(15);
+		if (counters.counts((hostEvent)e))
+			out << perThousand[e];
+		else
+			out << "n/a";
+	}
+	out << defaultfloat << endl;
+}
+
+/************************************************************************
+Function: runWithLayout
+Author: Jake Davidson
+Description: Runs the loaded program with the trace like execute. With a
+profile the program is reordered before it starts, with warmup steps it is
+profiled in file order for those steps and then reordered. The host
+counters are read around each part of the run, and the events per 1000
+instructions of the reordered part are compared with those of the part in
+file order, or of the run that wrote the profile. With profileOut the
+counts of the whole run are written as a profile.
+Parameters: maxSteps - most instructions to execute, UNLIMITED_STEPS for no limit
+			profile - profile to reorder from, empty for none
+			warmup - steps to profile before reordering, 0 for none
+			profileOut - profile to write, empty for none
+************************************************************************/
+void runWithLayout(unsigned long long maxSteps, string profile, unsigned long long warmup, string profileOut) {
+	BlockLayout layout(instructions, instructionRegister); //layout of the program
+	HostCounters counters(1); //read around each part of the run
+	ExecuteInstruction ins; //machine, with the trace
+	double start[HOST_EVENTS], middle[HOST_EVENTS], end[HOST_EVENTS]; //counter readings
+	double inOrder[HOST_EVENTS], reordered[HOST_EVENTS]; //events per 1000 instructions of each part
+	unsigned long long steps = 0, ordered = 0; //steps executed, of them in file order
+	bool fromProfile = !profile.empty() && layout.readProfile(profile); //true if reordering from a profile
+	bool reorder = fromProfile || warmup > 0; //true if the program is reordered
+
+	if (!profile.empty() && !fromProfile)
+		cout << "Could not use profile " << profile << " (missing or of another program), running in file order." << endl;
+	ins.setBlockLayout(&layout);
+	layout.setProfiling(warmup > 0 || !profileOut.empty());
+	counters.open();
+	counters.read(start);
+	for (int e = 0; e < HOST_EVENTS; e++)
+		middle[e] = start[e];
+	if (fromProfile && warmup == 0)
+		layout.reorder();
+	if (warmup > 0) {
+		ordered = steps = ins.run(min(warmup, maxSteps));
+		counters.read(middle);
+		if (!ins.isHalted())
+			layout.reorder();
+		layout.setProfiling(!profileOut.empty());
+	}
+	if (!ins.isHalted() && steps < maxSteps)
+		steps += ins.run(maxSteps - steps);
+	counters.read(end);
+	if (!ins.isHalted())
+		cout << "Machine Halted - step limit reached" << endl;
+
+	if (!reorder)
+		ordered = steps;
+	for (int e = 0; e < HOST_EVENTS; e++) {
+		inOrder[e] = ordered ? (middle[e] - start[e] + (reorder ? 0 : end[e] - middle[e])) * 1000 / ordered : 0;
+		reordered[e] = steps > ordered ? (end[e] - middle[e]) * 1000 / (steps - ordered) : 0;
+	}
+	if (!profileOut.empty() && !layout.writeProfile(profileOut, steps, reorder ? nullptr : inOrder))
+		cout << "Could not write profile " << profileOut << endl;
+	if (!reorder)
+		return;
+	layout.printSummary(cout);
+	cout << "Host events per 1000 instructions" << (counters.usesClock() ? " (counters not available, cycles are ns)" : "") << endl;
+	cout << left << setw(30) << "" << right;
+	for (int e = 0; e < HOST_EVENTS; e++)
+		cout << setw(15) << LAYOUT_EVENT_NAMES[e];
+	cout << endl;
+	if (warmup > 0 && ordered > 0)
+		printEvents(cout, "file order, first " + to_string(ordered) + " steps", inOrder, counters);
+	else if (layout.getBaselineSteps() > 0) {
+		for (int e = 0; e < HOST_EVENTS; e++)
+			inOrder[e] = layout.getBaseline()[e];
+		printEvents(cout, "file order, profiled run", inOrder, counters);
+	}
+	else {
+		cout << "no run in file order to compare with" << endl;
+		return;
+	}
+	if (steps == ordered) {
+		cout << "the run ended before the program was reordered" << endl;
+		return;
+	}
+	printEvents(cout, "reordered, " + to_string(steps - ordered) + " steps", reordered, counters);
+	cout << left << setw(30) << "change" << right << fixed << setprecision(1);
+	for (int e = 0; e < HOST_EVENTS; e++) {
+		cout << setw(14);
+		if (counters.counts((hostEvent)e) && inOrder[e] > 0)
+			cout << 100 * (reordered[e] - inOrder[e]) / inOrder[e] << "%";
+		else
+			cout << "n/a" << " ";
+	}
+	cout << defaultfloat << endl;
+}
@@ -0,0 +1,87 @@
+//Profile-guided layout of the instruction store. The instructions vector is in
+//object file order, so the blocks of a hot loop may be far apart and cold code
+//sits between them. With --layout <profile> the basic blocks are reordered from
+//the execution profile written by an earlier run with --profile-out <profile>;
+//with --layout-warmup <n> the first n steps of this run are profiled in file
+//order and the program is reordered before the rest of the run.
+//
+//Blocks are placed by the Pettis-Hansen method: taking the edges between
+//blocks from the most to the least executed, the block an edge leaves is joined
+//to the block it enters whenever the first ends a chain and the second starts
+//one. The chain holding the instruction being executed goes first, then the
+//others from the hottest, blocks never executed last in file order.
+//
+//After reordering, the vector no longer says what follows an instruction, so
+//fall-through is an explicit link from each slot to the slot of the next
+//instruction in file order, and jumps find their target through a table from
+//address to slot, the slot of the first instruction in file order with that
+//address as J does. Instructions keep their address and hex string, so traces
+//are unchanged. The profile counts, for each instruction in file order, how
+//often it executed and how often it jumped; it starts with the number of
+//instructions and a hash of the program so a profile of another program is not
+//used. Host counter readings (HostCounters.h) per 1000 instructions are kept in
+//the profile of a run in file order, and the layout report compares them with
+//the reordered run, or with the warmup steps when they were profiled in this run.
+#ifndef BLOCKLAYOUT_H
+#define BLOCKLAYOUT_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+#include "const.h"
+#include "HostCounters.h"
+
+using namespace std;
+
+class BlockLayout {
+public:
+	BlockLayout(vector<instruction> &program, vector<instruction>::iterator &instructionRegister);
+	bool readProfile(string file); //add a profile to the counts, false if unreadable or of another program
+	//write the counts, with the host events per 1000 instructions of a run in file order (nullptr if reordered)
+	bool writeProfile(string file, unsigned long long steps, const double perThousand[HOST_EVENTS]);
+	void setProfiling(bool p) { profiling = p; } //true to count executed instructions
+	bool isProfiling() { return profiling; } //true if executed instructions are counted
+	void record(vector<instruction>::iterator from, vector<instruction>::iterator to); //count an executed instruction
+	void reorder(); //lay out the blocks from the counts, moving the instruction register with them
+	//finds the instruction after it in file order, false if it is the last
+	bool next(vector<instruction>::iterator it, vector<instruction>::iterator &next) {
+		int n = links[it - program.begin()]; //slot of the next instruction
+		if (n < 0)
+			return false;
+		next = program.begin() + n;
+		return true;
+	}
+	//finds the first instruction with address in file order, false if there is none
+	bool find(unsigned int address, vector<instruction>::iterator &target) {
+		if (address >= addressSlot.size() || addressSlot[address] < 0)
+			return false;
+		target = program.begin() + addressSlot[address];
+		return true;
+	}
+	void printSummary(ostream &out); //print the blocks and how sequential dispatch became
+	unsigned long long getBaselineSteps() { return baselineSteps; } //steps of the profiled run, 0 if it had no host events
+	const double *getBaseline() { return baseline; } //host events per 1000 instructions of the profiled run
+private:
+	uint64_t programHash(); //hash of the program in file order
+	double sequentialShare(); //share of counted transitions to the next slot
+	void relink(); //set the links and address table from the slot of each instruction
+	vector<instruction> &program; //instructions vector, reordered in place
+	vector<instruction>::iterator &instructionRegister; //current instruction
+	vector<unsigned long long> executed, jumped; //counts of each instruction in file order
+	vector<int> original; //instruction in file order held by each slot
+	vector<int> slot; //slot of each instruction in file order
+	vector<int> links; //slot of the next instruction in file order for each slot, -1 after the last
+	vector<int> addressSlot; //slot jumped to for each address, -1 if none
+	bool profiling; //true while executed instructions are counted
+	int blocks, chains; //basic blocks and chains of the layout
+	double sequentialBefore, sequentialAfter; //share of transitions to the next slot before and after reordering
+	unsigned long long baselineSteps; //steps of the profiled run, 0 if it had no readings
+	double baseline[HOST_EVENTS]; //its host events per 1000 instructions
+};
+
+//runs the loaded program with the trace, profiling and reordering it as asked, then
+//prints the layout and the host events before and after
+void runWithLayout(unsigned long long maxSteps, string profile, unsigned long long warmup, string profileOut);
+
+#endif
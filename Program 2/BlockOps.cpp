@@ -0,0 +1,131 @@
+#include "BlockOps.h"
+#include <cstring>
+#include "const.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+bool blockOpsEnabled = false;
+
+//SIMD vector of words, loaded and stored unaligned since blocks start anywhere
+#if defined(__AVX512F__)
+typedef __m512i blockVector;
+const size_t VECTOR_WORDS = 16;
+static inline blockVector vload(const int *p) { return _mm512_loadu_si512((const void *)p); }
+static inline void vstore(int *p, blockVector v) { _mm512_storeu_si512((void *)p, v); }
+static inline blockVector vset(int x) { return _mm512_set1_epi32(x); }
+static inline blockVector vzero() { return _mm512_setzero_si512(); }
+static inline blockVector vadd(blockVector a, blockVector b) { return _mm512_add_epi32(a, b); }
+static inline blockVector vxor(blockVector a, blockVector b) { return _mm512_xor_si512(a, b); }
+static inline unsigned int vsum(blockVector a) { return (unsigned int)_mm512_reduce_add_epi32(a); }
+#elif defined(__AVX2__)
+typedef __m256i blockVector;
+const size_t VECTOR_WORDS = 8;
+static inline blockVector vload(const int *p) { return _mm256_loadu_si256((const __m256i *)p); }
+static inline void vstore(int *p, blockVector v) { _mm256_storeu_si256((__m256i *)p, v); }
+static inline blockVector vset(int x) { return _mm256_set1_epi32(x); }
+static inline blockVector vzero() { return _mm256_setzero_si256(); }
+static inline blockVector vadd(blockVector a, blockVector b) { return _mm256_add_epi32(a, b); }
+static inline blockVector vxor(blockVector a, blockVector b) { return _mm256_xor_si256(a, b); }
+static inline unsigned int vsum(blockVector a) {
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return (unsigned int)_mm_cvtsi128_si32(s);
+}
+#endif
+
+/************************************************************************
+Function: enableBlockOps
+Author: Jake Davidson
+Description: Enables the bulk memory extension and names its opcodes for
+the trace.
+************************************************************************/
+void enableBlockOps() {
+	blockOpsEnabled = true;
+	opCodesPrintMap[BCPY] = "BCPY";
+	opCodesPrintMap[BFIL] = "BFIL";
+	opCodesPrintMap[BSUM] = "BSUM";
+	opCodesPrintMap[BXOR] = "BXOR";
+}
+
+/************************************************************************
+Function: blockCopy
+Author: Jake Davidson
+Description: Copies words. The blocks may overlap, memmove is already a
+vectorized kernel on every host.
+Parameters: destination - first word written
+			source - first word read
+			n - number of words
+************************************************************************/
+void blockCopy(int *destination, const int *source, size_t n) {
+	memmove(destination, source, n * sizeof(int));
+}
+
+/************************************************************************
+Function: blockFill
+Author: Jake Davidson
+Description: Sets words to a value.
+Parameters: destination - first word written
+			value - value to write
+			n - number of words
+************************************************************************/
+void blockFill(int *destination, int value, size_t n) {
+	size_t w = 0; //next word
+#if defined(__AVX512F__) || defined(__AVX2__)
+	blockVector v = vset(value);
+	for (; w + VECTOR_WORDS <= n; w += VECTOR_WORDS)
+		vstore(destination + w, v);
+#endif
+	for (; w < n; w++)
+		destination[w] = value;
+}
+
+/************************************************************************
+Function: blockSum
+Author: Jake Davidson
+Description: Adds up words with the machine's wrapping arithmetic. Four
+vector sums are kept so consecutive additions do not wait on each other.
+Parameters: source - first word read
+			n - number of words
+Returns: the sum
+************************************************************************/
+unsigned int blockSum(const int *source, size_t n) {
+	unsigned int sum = 0; //sum of the words
+	size_t w = 0; //next word
+#if defined(__AVX512F__) || defined(__AVX2__)
+	blockVector s0 = vzero(), s1 = vzero(), s2 = vzero(), s3 = vzero();
+	for (; w + 4 * VECTOR_WORDS <= n; w += 4 * VECTOR_WORDS) {
+		s0 = vadd(s0, vload(source + w));
+		s1 = vadd(s1, vload(source + w + VECTOR_WORDS));
+		s2 = vadd(s2, vload(source + w + 2 * VECTOR_WORDS));
+		s3 = vadd(s3, vload(source + w + 3 * VECTOR_WORDS));
+	}
+	for (; w + VECTOR_WORDS <= n; w += VECTOR_WORDS)
+		s0 = vadd(s0, vload(source + w));
+	sum = vsum(vadd(vadd(s0, s1), vadd(s2, s3)));
+#endif
+	for (; w < n; w++)
+		sum += (unsigned int)source[w];
+	return sum;
+}
+
+/************************************************************************
+Function: blockXor
+Author: Jake Davidson
+Description: XORs words into others. The blocks must be the same or not
+overlap.
+Parameters: destination - first word written
+			source - first word read
+			n - number of words
+************************************************************************/
+void blockXor(int *destination, const int *source, size_t n) {
+	size_t w = 0; //next word
+#if defined(__AVX512F__) || defined(__AVX2__)
+	for (; w + VECTOR_WORDS <= n; w += VECTOR_WORDS)
+		vstore(destination + w, vxor(vload(destination + w), vload(source + w)));
+#endif
+	for (; w < n; w++)
+		destination[w] ^= source[w];
+}
@@ -0,0 +1,43 @@
+//Bulk memory extension. Off by default; with --block-ops four instructions are
+//decoded from specifiers that are otherwise undefined:
+//
+//    BCPY  MEM 0011  copy the X0 words at memory[X1] to memory[X2]
+//    BFIL  MEM 0100  set the X0 words at memory[X2] to AC
+//    BSUM  ALU 0111  add the X0 words at memory[X1] to AC
+//    BXOR  ALU 1011  XOR the X0 words at memory[X1] into the X0 words at memory[X2]
+//
+//so, as object file words with a zero operand and index register field,
+//BCPY is 0004c0, BFIL 000500, BSUM 0009c0 and BXOR 000ac0. Like the string
+//instructions of other machines the length and bases always come from the
+//same registers, X0, X1 and X2, which are left unchanged. Only Direct
+//addressing is allowed, the operand and index register fields are not used,
+//and the trace shows the instruction like any other Direct instruction. A
+//block overlapping itself behaves as if the source was read before any word
+//was written. A negative length, or a block that does not fit in memory
+//(the whole address space with --address-bits), halts the machine. Blocks are
+//plain memory: devices, the simulated caches and the optimizer do not see
+//them, so --optimize is turned off with the extension.
+//
+//The blocks are processed by host kernels using AVX-512 or AVX2 when the
+//compiler targets them (as for Lockstep.cpp), otherwise plain loops the
+//compiler can vectorize itself.
+#ifndef BLOCKOPS_H
+#define BLOCKOPS_H
+
+#include <cstddef>
+
+using namespace std;
+
+//true once the extension is enabled, the decoder then uses BLOCK_OPCODE_TABLE (Semantics.h)
+extern bool blockOpsEnabled;
+
+//enable the extension, before any instruction is decoded
+void enableBlockOps();
+
+//host kernels, on n words
+void blockCopy(int *destination, const int *source, size_t n);
+void blockFill(int *destination, int value, size_t n);
+unsigned int blockSum(const int *source, size_t n); //sum of the words, wrapping around
+void blockXor(int *destination, const int *source, size_t n);
+
+#endif
@@ -0,0 +1,326 @@
+#include "CacheSimulator.h"
+
+#ifdef SIMULATE_CACHE
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include "Semantics.h"
+
+thread_local CacheSimulator cacheSimulator;
+
+//sets listed as conflict hot spots for each cache
+const int HOT_SPOT_SETS = 8;
+//lines listed for each hot spot set
+const int HOT_SPOT_LINES = 8;
+
+//names used in the configuration and report
+static const char *KIND_NAMES[] = { "instruction", "data", "unified" };
+static const char *POLICY_NAMES[] = { "lru", "fifo", "random" };
+
+/************************************************************************
+Function: Cache
+Author: Jake Davidson
+Description: Constructs an empty cache. words must be a multiple of
+ways * lineWords.
+Parameters: name - name of the cache in the report
+			kind - accesses the cache sees
+			words - capacity in words
+			ways - associativity
+			lineWords - words per line
+			policy - replacement policy
+************************************************************************/
+Cache::Cache(string name, cacheKind kind, int words, int ways, int lineWords, replacementPolicy policy)
+	: name(name), kind(kind), ways(ways), lineWords(lineWords), sets(words / (ways * lineWords)), policy(policy),
+	tags(sets * ways, -1), stamps(sets * ways, 0), clock(0), randomState(0xb17),
+	shadowPosition((CACHED_WORDS + lineWords - 1) / lineWords), inShadow(shadowPosition.size(), false),
+	seen(shadowPosition.size(), false), accesses(0), hits(0), compulsory(0), capacity(0), conflict(0),
+	conflictsBySet(sets, 0), conflictsByLine(shadowPosition.size(), 0), missesBySource(CACHED_WORDS, 0)
+{
+}
+
+/************************************************************************
+Function: shadowAccess
+Author: Jake Davidson
+Description: Accesses a fully associative LRU cache with as many lines as
+this cache. A miss here that hits there is a conflict miss, caused by the
+mapping of lines to sets rather than the size of the cache.
+Parameters: line - line number accessed
+Returns: true if the fully associative cache held the line
+************************************************************************/
+bool Cache::shadowAccess(int line) {
+	bool hit = inShadow[line]; //true if the line was resident
+	if (hit)
+		shadow.erase(shadowPosition[line]);
+	else if ((int)shadow.size() == sets * ways) {
+		inShadow[shadow.back()] = false;
+		shadow.pop_back();
+	}
+	shadow.push_front(line);
+	shadowPosition[line] = shadow.begin();
+	inShadow[line] = true;
+	return hit;
+}
+
+/************************************************************************
+Function: access
+Author: Jake Davidson
+Description: Looks up the line holding a word. On a miss the line is
+filled, into an empty way if there is one, otherwise replacing the way
+chosen by the policy. Misses are classified as compulsory (first access
+to the line), conflict (a fully associative cache would have hit) or
+capacity.
+Parameters: address - word accessed
+Returns: true on a hit
+************************************************************************/
+bool Cache::access(int address) {
+	int line = address / lineWords; //line holding the word
+	int set = line % sets; //set the line maps to
+	int *way = &tags[set * ways]; //ways of the set
+	unsigned long long *stamp = &stamps[set * ways]; //stamps of the ways
+	int victim = 0; //way to fill on a miss
+	bool shadowHit = this->shadowAccess(line); //result in the fully associative cache
+
+	clock++;
+	accesses++;
+	for (int w = 0; w < ways; w++) {
+		if (way[w] == line) {
+			hits++;
+			if (policy == LRU)
+				stamp[w] = clock;
+			return true;
+		}
+	}
+
+	//classify the miss
+	if (!seen[line]) {
+		compulsory++;
+		seen[line] = true;
+	}
+	else if (shadowHit) {
+		conflict++;
+		conflictsBySet[set]++;
+		conflictsByLine[line]++;
+	}
+	else {
+		capacity++;
+	}
+
+	//fill an empty way, or replace one
+	for (victim = 0; victim < ways && way[victim] != -1; victim++);
+	if (victim == ways) {
+		if (policy == RANDOM) {
+			randomState ^= randomState << 13;
+			randomState ^= randomState >> 17;
+			randomState ^= randomState << 5;
+			victim = (int)(randomState % ways);
+		}
+		else {
+			//LRU and FIFO both replace the oldest stamp
+			victim = 0;
+			for (int w = 1; w < ways; w++) {
+				if (stamp[w] < stamp[victim])
+					victim = w;
+			}
+		}
+	}
+	way[victim] = line;
+	stamp[victim] = clock;
+	return false;
+}
+
+/************************************************************************
+Function: writeReport
+Author: Jake Davidson
+Description: Writes the geometry, hit rate and miss classes of the cache,
+then the sets with the most conflict misses and the lines fighting over
+each of them.
+Parameters: out - stream to write to
+************************************************************************/
+void Cache::writeReport(ostream &out) {
+	unsigned long long misses = accesses - hits; //misses of every class
+	vector<int> order(sets); //sets, most conflict misses first
+	out << name << " (" << KIND_NAMES[kind] << ", " << dec << sets * ways * lineWords << " words, "
+		<< ways << "-way, " << lineWords << "-word lines, " << POLICY_NAMES[policy] << ")" << endl;
+	out << "  accesses " << accesses << ", hits " << hits;
+	if (accesses > 0)
+		out << " (" << fixed << setprecision(2) << (100.0 * hits / accesses) << "%)";
+	out << ", misses " << misses << ": compulsory " << compulsory << ", capacity " << capacity
+		<< ", conflict " << conflict << endl;
+
+	for (int s = 0; s < sets; s++)
+		order[s] = s;
+	stable_sort(order.begin(), order.end(), [&](int a, int b) { return conflictsBySet[a] > conflictsBySet[b]; });
+	if (conflict > 0)
+		out << "  conflict hot spots:" << endl;
+	for (int n = 0; n < HOT_SPOT_SETS && n < sets && conflictsBySet[order[n]] > 0; n++) {
+		int set = order[n];
+		vector<int> lines; //lines of the set with conflict misses
+		for (int line = set; line < (int)conflictsByLine.size(); line += sets) {
+			if (conflictsByLine[line] > 0)
+				lines.push_back(line);
+		}
+		stable_sort(lines.begin(), lines.end(), [&](int a, int b) { return conflictsByLine[a] > conflictsByLine[b]; });
+		out << "    set " << set << ": " << conflictsBySet[set] << " conflict misses, lines at";
+		for (int l = 0; l < HOT_SPOT_LINES && l < (int)lines.size(); l++)
+			out << " " << hex << setw(3) << setfill('0') << lines[l] * lineWords << dec << setfill(' ')
+				<< " (" << conflictsByLine[lines[l]] << ")";
+		out << endl;
+	}
+}
+
+/************************************************************************
+Function: ~CacheSimulator
+Author: Jake Davidson
+Description: Writes the report if one was asked for. The simulator of the
+main thread is destroyed however the program ends, so the report is 
+written even if the machine halts with exit.
+************************************************************************/
+CacheSimulator::~CacheSimulator() {
+	if (!reportFile.empty())
+		this->writeReport(reportFile);
+}
+
+/************************************************************************
+Function: configure
+Author: Jake Davidson
+Description: Reads the cache hierarchy, one cache per line, nearest to
+the machine first.
+Parameters: file - name of the configuration file
+Returns: false if the file cannot be read or a line is invalid
+************************************************************************/
+bool CacheSimulator::configure(string file) {
+	ifstream fin(file); //configuration file
+	string line, name, kind, policy; //current line and its fields
+	int words, ways, lineWords; //geometry of the cache on the line
+	int lineNumber = 0; //line being read, for errors
+	if (!fin) {
+		cout << "Could not open cache configuration " << file << endl;
+		return false;
+	}
+	caches.clear();
+	while (getline(fin, line)) {
+		lineNumber++;
+		if (line.find('#') != string::npos)
+			line = line.substr(0, line.find('#'));
+		istringstream fields(line);
+		if (!(fields >> name))
+			continue;
+		int k = -1, p = -1; //kind and policy, -1 if not recognised
+		if (fields >> kind >> words >> ways >> lineWords >> policy) {
+			for (int n = 0; n < 3; n++) {
+				if (kind == KIND_NAMES[n])
+					k = n;
+				if (policy == POLICY_NAMES[n])
+					p = n;
+			}
+		}
+		if (k < 0 || p < 0 || words <= 0 || ways <= 0 || lineWords <= 0 || words % (ways * lineWords) != 0) {
+			cout << file << ":" << lineNumber << ": expected <name> <instruction|data|unified> <words> <ways> "
+				<< "<line words> <lru|fifo|random>, with words a multiple of ways * line words" << endl;
+			return false;
+		}
+		caches.push_back(Cache(name, (cacheKind)k, words, ways, lineWords, (replacementPolicy)p));
+	}
+	if (caches.empty()) {
+		cout << "No caches in " << file << endl;
+		return false;
+	}
+	return true;
+}
+
+/************************************************************************
+Function: useDefault
+Author: Jake Davidson
+Description: Configures the hierarchy used without --cache: 64 word
+2-way instruction and data caches with 4 word lines, backed by a 512
+word 4-way unified cache with 8 word lines, all LRU.
+************************************************************************/
+void CacheSimulator::useDefault() {
+	caches.push_back(Cache("L1I", InstructionCache, 64, 2, 4, LRU));
+	caches.push_back(Cache("L1D", DataCache, 64, 2, 4, LRU));
+	caches.push_back(Cache("L2", UnifiedCache, 512, 4, 8, LRU));
+}
+
+/************************************************************************
+Function: access
+Author: Jake Davidson
+Description: Passes an access down the caches that see it until one hits.
+Parameters: address - word accessed
+			source - address of the instruction making the access
+			isFetch - true for an instruction fetch, false for data
+************************************************************************/
+void CacheSimulator::access(int address, unsigned int source, bool isFetch) {
+	if (caches.empty())
+		this->useDefault();
+	if (address < 0 || address >= CACHED_WORDS || source >= (unsigned int)CACHED_WORDS)
+		return;
+	for (Cache &c : caches) {
+		if (c.getKind() == (isFetch ? DataCache : InstructionCache))
+			continue;
+		if (c.access(address))
+			return;
+		c.countMiss(source);
+	}
+}
+
+/************************************************************************
+Function: fetch
+Author: Jake Davidson
+Description: Simulates fetching an instruction from its address.
+Parameters: i - instruction fetched
+************************************************************************/
+void CacheSimulator::fetch(instruction &i) {
+	this->access((int)i.instructionAddress, i.instructionAddress, true);
+}
+
+/************************************************************************
+Function: data
+Author: Jake Davidson
+Description: Simulates the memory access of an instruction, if it reads
+or writes memory[EA].
+Parameters: i - instruction executing
+************************************************************************/
+void CacheSimulator::data(instruction &i) {
+	if (!illegalAddressMode(i.opCode, i.addressMode) && (readsMemory(i.opCode, i.addressMode) || writesMemory(i.opCode, i.addressMode)))
+		this->access(i.EA, i.instructionAddress, false);
+}
+
+/************************************************************************
+Function: writeReport
+Author: Jake Davidson
+Description: Writes the report of every cache, then the misses caused by
+each instruction address in each cache, for instructions with misses.
+Parameters: file - name of file to write the report to
+************************************************************************/
+void CacheSimulator::writeReport(string file) {
+	ofstream fout; //stream to write the report to
+	fout.open(file);
+	if (!fout) {
+		cout << "Could not write cache report to " << file << endl;
+		return;
+	}
+	for (Cache &c : caches) {
+		c.writeReport(fout);
+		fout << endl;
+	}
+	fout << "Misses by source instruction:" << endl << "  addr";
+	for (Cache &c : caches)
+		fout << " " << setw(10) << c.getName();
+	fout << endl;
+	for (unsigned int source = 0; source < (unsigned int)CACHED_WORDS; source++) {
+		unsigned long long total = 0; //misses of the instruction over every cache
+		for (Cache &c : caches)
+			total += c.getMisses(source);
+		if (total == 0)
+			continue;
+		fout << "  " << hex << setw(3) << setfill('0') << source << " " << dec << setfill(' ');
+		for (Cache &c : caches)
+			fout << " " << setw(10) << c.getMisses(source);
+		fout << endl;
+	}
+}
+
+#endif
@@ -0,0 +1,111 @@
+//Memory hierarchy simulation. Define SIMULATE_CACHE to pass every instruction
+//fetch and every memory access made by ExecuteInstruction through a model of
+//one or more cache levels, and write a report of hit rates, misses per source
+//instruction and conflict hot spots to cache_report.txt when the program ends.
+//When SIMULATE_CACHE is not defined the CACHE_FETCH/CACHE_DATA hooks expand to
+//nothing, so normal builds pay no cost for them.
+//
+//The hierarchy is read from the file given with --cache, one cache per line,
+//nearest the machine first (# starts a comment):
+//
+//  <name> <instruction|data|unified> <words> <ways> <line words> <lru|fifo|random>
+//
+//An access goes through the caches of its kind in order until one hits, and
+//every cache it missed in is filled. Sizes are in words, since B17 memory is
+//word addressed. Without --cache a split 64 word L1 and a 512 word L2 are used.
+//EM and EMX read and write the same word, and count as one access.
+#ifndef CACHESIMULATOR_H
+#define CACHESIMULATOR_H
+
+#ifdef SIMULATE_CACHE
+
+#include <string>
+#include <vector>
+#include <list>
+#include "const.h"
+
+using namespace std;
+
+//file the report is written to when the program ends
+#ifndef CACHE_REPORT_FILE
+#define CACHE_REPORT_FILE "cache_report.txt"
+#endif
+
+//words of memory that can be accessed or fetched, matches memory in globals.h
+const int CACHED_WORDS = 4096;
+
+//which accesses a cache sees
+enum cacheKind {
+	InstructionCache,
+	DataCache,
+	UnifiedCache
+};
+
+//line chosen for eviction when a set is full
+enum replacementPolicy {
+	LRU, //least recently used
+	FIFO, //first filled
+	RANDOM //pseudo-random, the same on every run
+};
+
+//one cache of the hierarchy
+class Cache {
+public:
+	Cache(string name, cacheKind kind, int words, int ways, int lineWords, replacementPolicy policy);
+	bool access(int address); //look up the line holding address, filling it on a miss. Returns true on a hit
+	void writeReport(ostream &out); //write hit rates and conflict hot spots
+	string getName() { return name; }
+	cacheKind getKind() { return kind; }
+	unsigned long long getMisses(unsigned int source) { return missesBySource[source]; } //misses caused by the instruction at source
+	void countMiss(unsigned int source) { missesBySource[source]++; }
+private:
+	bool shadowAccess(int line); //access a fully associative LRU cache of the same size, true on a hit
+	string name; //name given in the configuration
+	cacheKind kind; //accesses seen
+	int ways, lineWords, sets; //geometry
+	replacementPolicy policy; //eviction policy
+	vector<int> tags; //line held by each way of each set, -1 if empty
+	vector<unsigned long long> stamps; //last use (LRU) or fill time (FIFO) of each way
+	unsigned long long clock; //accesses so far, used for stamps
+	unsigned int randomState; //state of the random policy
+	list<int> shadow; //lines of the fully associative cache, most recent first
+	vector<list<int>::iterator> shadowPosition; //position of each line in shadow
+	vector<bool> inShadow; //true for lines in shadow
+	vector<bool> seen; //true for lines accessed before
+	unsigned long long accesses, hits, compulsory, capacity, conflict; //access counts
+	vector<unsigned long long> conflictsBySet; //conflict misses in each set
+	vector<unsigned long long> conflictsByLine; //conflict misses of each line
+	vector<unsigned long long> missesBySource; //misses caused by each instruction address
+};
+
+class CacheSimulator {
+public:
+	~CacheSimulator();
+	bool configure(string file); //read the hierarchy from file, false on errors
+	void fetch(instruction &i); //fetch of instruction i
+	void data(instruction &i); //memory access made by instruction i, if it makes one
+	void useDefault(); //configure the default hierarchy
+	void writeReport(string file); //write the report of every cache to file
+	void reportTo(string file) { reportFile = file; } //write the report to file when the simulator is destroyed
+private:
+	void access(int address, unsigned int source, bool isFetch); //pass one access down the hierarchy
+	vector<Cache> caches; //the hierarchy, nearest first
+	string reportFile; //file to write the report to on destruction, empty for none
+};
+
+//simulator for the machine running on this thread. The report is written when
+//it is destroyed rather than from atexit, since objects with thread storage
+//duration are destroyed before atexit functions run
+extern thread_local CacheSimulator cacheSimulator;
+
+#define CACHE_FETCH(i) cacheSimulator.fetch(i)
+#define CACHE_DATA(i) cacheSimulator.data(i)
+
+#else
+
+#define CACHE_FETCH(i)
+#define CACHE_DATA(i)
+
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+//Compile time evaluation of B17 programs. Header only, needs C++17 (constexpr
+//std::array element assignment). A program given as a constexpr array of
+//instruction words is decoded and run during compilation, with a step limit,
+//and the final machine can be used as a compile time constant:
+//
+//    constexpr std::array<unsigned int, 3> program = { 0x005404, 0x003804, 0x000000 };
+//    constexpr b17Machine result = b17Evaluate(program, 0x000, 0x000, 100);
+//    static_assert(result.AC == 8 && result.status == b17Halted, "LD 5, ADD 3, HALT");
+//
+//The decoding and the semantics of every opcode come from Semantics.h, the
+//same functions ExecuteInstruction uses at run time. A program that reads
+//memory outside of the 4096 words fails to compile.
+#ifndef CONSTEXPRB17_H
+#define CONSTEXPRB17_H
+
+#include <array>
+#include <cstddef>
+#include "Semantics.h"
+
+//words of memory in a compile time machine
+constexpr size_t B17_MEMORY_WORDS = 4096;
+
+//why evaluation stopped, matching the halt messages of the interpreter
+enum b17Status {
+	b17Running, //step limit reached
+	b17Halted, //HALT instruction executed
+	b17IllegalAddressMode, //illegal addressing mode
+	b17InvalidJump, //invalid jump address
+	b17UndefinedOpcode, //undefined opcode
+	b17EndOfProgram //no more instructions to execute
+};
+
+//a decoded instruction, without the strings of struct instruction
+struct b17Instruction {
+	unsigned int address;
+	int indexRegister;
+	addrModes addressMode;
+	opCodes opCode;
+	int EA;
+};
+
+//state of a compile time machine
+struct b17Machine {
+	int AC;
+	int X[4];
+	std::array<int, B17_MEMORY_WORDS> memory;
+	unsigned int instructionAddress; //address of the instruction in the instruction register
+	unsigned long long steps; //instructions executed
+	b17Status status;
+};
+
+/************************************************************************
+Function: b17Evaluate
+Author: Jake Davidson
+Description: Decodes and runs a program at compile time. words holds the 
+instruction words of the program, starting at baseAddress. Like 
+readInstructions, EAs are calculated when the program is decoded: indexed
+addresses use the index registers at that point (zero) and indirect 
+addresses read the initial memory.
+Parameters: words - instruction words, one per address from baseAddress
+			baseAddress - address of words[0]
+			startAddress - address to start execution at
+			maxSteps - most instructions to execute
+			initialMemory - memory before the program runs
+Returns: the machine after it halted or reached maxSteps
+************************************************************************/
+template <size_t N>
+constexpr b17Machine b17Evaluate(const std::array<unsigned int, N> &words, unsigned int baseAddress,
+	unsigned int startAddress, unsigned long long maxSteps,
+	const std::array<int, B17_MEMORY_WORDS> &initialMemory = std::array<int, B17_MEMORY_WORDS>{}) {
+	b17Machine m{ 0, { 0, 0, 0, 0 }, initialMemory, startAddress, 0, b17Running };
+	std::array<b17Instruction, N> program{};
+	size_t ir = N; //index of the instruction register in program, N if no instruction is there
+
+	//decode the whole program first, as readInstructions does
+	for (size_t n = 0; n < N; n++) {
+		b17Instruction &i = program[n];
+		i.address = baseAddress + (unsigned int)n;
+		i.indexRegister = decodeIndexRegister(words[n]);
+		i.addressMode = decodeAddrMode(words[n]);
+		i.opCode = decodeOpCode(words[n]);
+		if (i.addressMode == Direct || i.addressMode == Immediate || i.addressMode == Indexed)
+			i.EA = (int)decodeOperandAddress(words[n]);
+		else
+			i.EA = m.memory[decodeOperandAddress(words[n])];
+		if (i.address == startAddress && ir == N)
+			ir = n;
+	}
+	if (ir == N) {
+		m.status = b17EndOfProgram;
+		return m;
+	}
+
+	while (m.steps != maxSteps) {
+		const b17Instruction &i = program[ir];
+		bool jump = false;
+		m.steps++;
+		m.instructionAddress = i.address;
+		if (i.opCode == UNDEFINED) {
+			m.status = b17UndefinedOpcode;
+			return m;
+		}
+		if (i.opCode == HALT) {
+			m.status = b17Halted;
+			return m;
+		}
+		if (illegalAddressMode(i.opCode, i.addressMode)) {
+			m.status = b17IllegalAddressMode;
+			return m;
+		}
+		int value = usesImmediate(i.opCode, i.addressMode) ? i.EA : 0; //operand of the instruction
+		int &x = m.X[i.indexRegister]; //index register of the instruction
+		switch (i.opCode) {
+		case LD: case ADD: case SUB: case AND: case OR: case XOR:
+			if (!usesImmediate(i.opCode, i.addressMode))
+				value = m.memory[i.EA];
+			m.AC = accumulatorResult(i.opCode, m.AC, value);
+			break;
+		case CLR: case COM:
+			m.AC = accumulatorResult(i.opCode, m.AC, 0);
+			break;
+		case ST:
+			m.memory[i.EA] = m.AC;
+			break;
+		case EM:
+			value = m.memory[i.EA];
+			m.memory[i.EA] = m.AC;
+			m.AC = value;
+			break;
+		case LDX: case ADDX: case SUBX: case CLRX:
+			if (i.opCode != CLRX && !usesImmediate(i.opCode, i.addressMode))
+				value = m.memory[i.EA];
+			x = indexResult(i.opCode, x, value);
+			break;
+		case STX:
+			m.memory[i.EA] = x;
+			break;
+		case EMX:
+			value = m.memory[i.EA];
+			m.memory[i.EA] = x;
+			x = value;
+			break;
+		case J: case JZ: case JN: case JP:
+			if (jumpTaken(i.opCode, m.AC)) {
+				//the first instruction with the target address, as ExecuteInstruction::J finds it
+				size_t target = N;
+				for (size_t n = 0; n < N && target == N; n++) {
+					if ((int)program[n].address == i.EA)
+						target = n;
+				}
+				if (target == N) {
+					m.status = b17InvalidJump;
+					return m;
+				}
+				ir = target;
+				jump = true;
+			}
+			break;
+		default:
+			break;
+		}
+		if (!jump) {
+			if (ir + 1 == N) {
+				m.status = b17EndOfProgram;
+				return m;
+			}
+			ir++;
+		}
+	}
+	m.instructionAddress = program[ir].address;
+	return m;
+}
+
+#endif
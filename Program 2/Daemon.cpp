@@ -0,0 +1,559 @@
+#include "Daemon.h"
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <streambuf>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include "ExecuteInstruction.h"
+#include "Loader.h"
+#include "MemoryImage.h"
+#include "MappedFile.h"
+#include "ProgramImage.h"
+#include "globals.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+#ifndef _WIN32
+//bytes of output collected before they are written to the connection
+const size_t RESULT_BUFFER_BYTES = 1 << 16;
+
+//set by SIGTERM and SIGINT in the master, which then stops the workers
+static volatile sig_atomic_t stopRequested = 0;
+
+/************************************************************************
+Function: requestStop
+Author: Jake Davidson
+Description: Signal handler of the master, asks it to stop the daemon.
+Parameters: signal - the signal received
+************************************************************************/
+static void requestStop(int) {
+	stopRequested = 1;
+}
+
+/************************************************************************
+Function: writeAll
+Author: Jake Davidson
+Description: Writes bytes to a connection, however many writes it takes.
+Parameters: connection - socket to write to
+			data - bytes to write
+			size - number of bytes
+Returns: false if the client has gone
+************************************************************************/
+static bool writeAll(int connection, const char *data, size_t size) {
+	while (size > 0) {
+		ssize_t written = send(connection, data, size, MSG_NOSIGNAL); //bytes taken by this write
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+//Output of a run, written to the connection in large pieces or into a result
+//segment. Flushing (endl ends every trace line) does not write anything, so
+//the trace is not sent a line at a time; finish writes the rest. Once output
+//cannot be written the stream fails, which halts a traced run at its next
+//trace line; runs without a trace are stopped by runRequest when the client
+//hangs up.
+class ResultStream : public streambuf {
+public:
+	ResultStream(int connection);
+	~ResultStream();
+	bool attach(string name); //write into the result segment name instead, false if it cannot be used
+	void finish(); //write the rest of the output and mark the segment complete
+protected:
+	int overflow(int c); //make room for more output
+	int sync() { return 0; } //output is written when the buffer is full or the run is over
+private:
+	int connection; //socket of the client
+	daemonResult *segment; //result segment, nullptr to write to the connection
+	size_t segmentBytes; //size of the mapped segment
+	bool failed; //true once output could not be written, the run then halts
+	char buffer[RESULT_BUFFER_BYTES]; //output not yet written to the connection
+};
+
+//output of the run being served, finished at exit if a loader halts the worker
+static ResultStream *currentResult = nullptr;
+
+/************************************************************************
+Function: ResultStream
+Author: Jake Davidson
+Description: Constructs the output of a run written to a connection.
+Parameters: connection - socket of the client
+************************************************************************/
+ResultStream::ResultStream(int connection) : connection(connection), segment(nullptr), segmentBytes(0), failed(false) {
+	setp(buffer, buffer + sizeof(buffer));
+}
+
+/************************************************************************
+Function: ~ResultStream
+Author: Jake Davidson
+Description: Unmaps the result segment, if there is one.
+************************************************************************/
+ResultStream::~ResultStream() {
+	if (segment)
+		munmap(segment, segmentBytes);
+}
+
+/************************************************************************
+Function: attach
+Author: Jake Davidson
+Description: Maps the result segment a client created and writes the
+output straight into its buffer from now on.
+Parameters: name - name of the segment
+Returns: false if the segment cannot be opened or has no buffer
+************************************************************************/
+bool ResultStream::attach(string name) {
+	struct stat status; //size of the segment
+	int fd = shm_open(name.c_str(), O_RDWR, 0); //the segment
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &status) != 0 || (size_t)status.st_size <= sizeof(daemonResult)) {
+		close(fd);
+		return false;
+	}
+	void *p = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return false;
+	segment = (daemonResult *)p;
+	segmentBytes = status.st_size;
+	segment->capacity = segmentBytes - sizeof(daemonResult);
+	segment->length = 0;
+	segment->state = RESULT_RUNNING;
+	segment->magic = DAEMON_RESULT_MAGIC;
+	char *output = (char *)(segment + 1); //the segment's buffer
+	setp(output, output + segment->capacity);
+	return true;
+}
+
+/************************************************************************
+Function: overflow
+Author: Jake Davidson
+Description: Writes the full buffer to the connection. A full result
+segment cannot take any more, so it is marked truncated and the stream
+fails, which halts a traced machine.
+Parameters: c - character that did not fit, or EOF
+Returns: EOF if the output could not be written
+************************************************************************/
+int ResultStream::overflow(int c) {
+	if (failed)
+		return traits_type::eof();
+	if (segment) {
+		segment->length = pptr() - pbase();
+		if (c != traits_type::eof()) {
+			segment->state = RESULT_TRUNCATED;
+			failed = true;
+			return traits_type::eof();
+		}
+		return traits_type::not_eof(c);
+	}
+	if (!writeAll(connection, pbase(), pptr() - pbase())) {
+		failed = true;
+		return traits_type::eof();
+	}
+	setp(buffer, buffer + sizeof(buffer));
+	if (c != traits_type::eof())
+		sputc((char)c);
+	return traits_type::not_eof(c);
+}
+
+/************************************************************************
+Function: finish
+Author: Jake Davidson
+Description: Ends the output of the run, writing what is left in the
+buffer and marking the segment complete unless it was truncated.
+************************************************************************/
+void ResultStream::finish() {
+	this->overflow(traits_type::eof());
+	if (segment && segment->state == RESULT_RUNNING)
+		segment->state = RESULT_COMPLETE;
+}
+
+/************************************************************************
+Function: finishCurrentResult
+Author: Jake Davidson
+Description: Registered with atexit in each worker. The loaders halt the
+process on an error, so the message they printed is sent to the client
+before the worker exits.
+************************************************************************/
+static void finishCurrentResult() {
+	if (currentResult) {
+		currentResult->finish();
+		currentResult = nullptr;
+	}
+}
+
+/************************************************************************
+Function: hashProgram
+Author: Jake Davidson
+Description: Hashes the bytes of an object file (64-bit FNV-1a).
+Parameters: data - bytes of the file
+			size - number of bytes
+Returns: the hash
+************************************************************************/
+static uint64_t hashProgram(const char *data, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325ULL; //hash of the bytes so far
+	for (size_t n = 0; n < size; n++) {
+		hash ^= (unsigned char)data[n];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+//Decoded programs of a worker, keyed by the hash of the object file. The
+//extension decodes the same file differently, so it is part of the key.
+class ProgramCache {
+public:
+	ProgramCache(string imageCache) : imageCache(imageCache), uses(0) {}
+	bool load(string file, bool blockOps); //load file into the instructions vector, false if it cannot be opened
+private:
+	struct cachedProgram {
+		uint64_t size; //size of the object file
+		vector<instruction> program; //decoded program
+		size_t start; //position of the instruction execution starts at
+		unsigned long long lastUse; //uses when it was last loaded
+	};
+	string imageCache; //directory of predecoded images, empty to decode the text
+	map<pair<uint64_t, bool>, cachedProgram> programs; //cached programs by hash and decoding
+	unsigned long long uses; //programs loaded so far
+};
+
+/************************************************************************
+Function: load
+Author: Jake Davidson
+Description: Fills the instructions vector with a program and sets the
+instruction register to its start. A cached program is copied and its EAs
+calculated from memory as it is now, anything else is decoded (through
+the image cache if there is one) and kept, replacing the least recently
+used program once DAEMON_CACHED_PROGRAMS are kept.
+Parameters: file - the object file
+			blockOps - true if the bulk memory extension is decoded
+Returns: false if the object file cannot be opened
+************************************************************************/
+bool ProgramCache::load(string file, bool blockOps) {
+	MappedFile object; //the object file
+	int index[4] = { X0, X1, X2, X3 }; //index registers used by indexed EAs
+	if (!object.open(file))
+		return false;
+	pair<uint64_t, bool> key = make_pair(hashProgram(object.data(), object.size()), blockOps); //key of the program
+	uint64_t size = object.size(); //size of the object file
+	object.close();
+	uses++;
+
+	map<pair<uint64_t, bool>, cachedProgram>::iterator cached = programs.find(key);
+	if (cached != programs.end() && cached->second.size == size) {
+		instructions = cached->second.program;
+		for (instruction &i : instructions)
+			i.EA = effectiveAddress(i, memory, index);
+		instructionRegister = instructions.begin() + cached->second.start;
+		cached->second.lastUse = uses;
+		return true;
+	}
+
+	instructions.clear();
+	instructionRegister = instructions.begin();
+	if (imageCache.empty())
+		readInstructions(file);
+	else
+		loadCachedProgram(file, imageCache);
+	if (instructions.empty())
+		return true;
+	if (programs.size() >= DAEMON_CACHED_PROGRAMS && cached == programs.end()) {
+		map<pair<uint64_t, bool>, cachedProgram>::iterator oldest = programs.begin(); //least recently used program
+		for (map<pair<uint64_t, bool>, cachedProgram>::iterator it = programs.begin(); it != programs.end(); it++) {
+			if (it->second.lastUse < oldest->second.lastUse)
+				oldest = it;
+		}
+		programs.erase(oldest);
+	}
+	cachedProgram &entry = programs[key];
+	entry.size = size;
+	entry.program = instructions;
+	entry.start = instructionRegister - instructions.begin();
+	entry.lastUse = uses;
+	return true;
+}
+
+/************************************************************************
+Function: parseRequest
+Author: Jake Davidson
+Description: Reads the settings of a request (see Daemon.h).
+Parameters: text - the request, without the blank line ending it
+			request - set to the run asked for
+Returns: false if the request is malformed or has no object file
+************************************************************************/
+static bool parseRequest(string text, daemonRequest &request) {
+	stringstream lines(text); //the request, a line at a time
+	string line; //current line
+	request = daemonRequest();
+	request.maxSteps = UNLIMITED_STEPS;
+	request.trace = true;
+	if (!getline(lines, line) || line != DAEMON_REQUEST_MAGIC)
+		return false;
+	while (getline(lines, line)) {
+		size_t space = line.find(' '); //end of the setting's name
+		string name = line.substr(0, space), value = space == string::npos ? "" : line.substr(space + 1);
+		if (name == "data" && !value.empty())
+			request.dataFiles.push_back(value);
+		else if (name == "cwd" && !value.empty())
+			request.directory = value;
+		else if (name == "object" && !value.empty())
+			request.objectFile = value;
+		else if (name == "steps" && !value.empty() && value.find_first_not_of("0123456789") == string::npos)
+			request.maxSteps = stoull(value);
+		else if (name == "shm" && !value.empty())
+			request.shmName = value;
+		else if (line == "block-ops")
+			request.blockOps = true;
+		else if (line == "no-trace")
+			request.trace = false;
+		else
+			return false;
+	}
+	return !request.directory.empty() && !request.objectFile.empty();
+}
+
+/************************************************************************
+Function: readRequest
+Author: Jake Davidson
+Description: Reads a request from a client, up to the blank line.
+Parameters: connection - socket of the client
+			text - set to the request
+Returns: false if the client closed the connection first or the request
+is too long
+************************************************************************/
+static bool readRequest(int connection, string &text) {
+	char chunk[4096]; //bytes of the current read
+	size_t end; //position of the blank line
+	text.clear();
+	while ((end = text.find("\n\n")) == string::npos) {
+		ssize_t received = recv(connection, chunk, sizeof(chunk), 0); //bytes read
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0 || text.size() + received > DAEMON_MAX_REQUEST)
+			return false;
+		text.append(chunk, received);
+	}
+	text.erase(end + 1);
+	return true;
+}
+
+/************************************************************************
+Function: clientGone
+Author: Jake Davidson
+Description: Checks, without waiting, whether the client has closed its
+end of the connection. It sends nothing after the request, so anything
+to read means it has hung up.
+Parameters: connection - socket of the client
+Returns: true if the client has gone
+************************************************************************/
+static bool clientGone(int connection) {
+	struct pollfd p = { connection, POLLIN, 0 };
+	char c; //byte waiting, if any
+	return poll(&p, 1, 0) > 0 && ((p.revents & (POLLHUP | POLLERR)) || recv(connection, &c, 1, MSG_PEEK | MSG_DONTWAIT) <= 0);
+}
+
+/************************************************************************
+Function: runRequest
+Author: Jake Davidson
+Description: Runs a request on the global machine, which starts out
+cleared as in a new process. The output is what b17 prints for the same
+run, or without a trace the final registers and the halt message. The
+machine runs DAEMON_POLL_INTERVAL instructions at a time, and is
+abandoned if the client has hung up, so a run that never halts does not
+hold the worker once nobody is waiting for it.
+Parameters: request - the run
+			cache - decoded programs of the worker
+			connection - socket of the client
+************************************************************************/
+static void runRequest(daemonRequest &request, ProgramCache &cache, int connection) {
+	unsigned long long steps = 0; //instructions executed so far
+	memset(memory, 0, sizeof(memory));
+	AC = X0 = X1 = X2 = X3 = 0;
+	//naming the extension's opcodes does not affect runs without it
+	if (request.blockOps)
+		enableBlockOps();
+	else
+		blockOpsEnabled = false;
+	for (string &file : request.dataFiles)
+		loadMemoryImage(file);
+	if (!cache.load(request.objectFile, request.blockOps)) {
+		cout << "Could not open object file, ensure the path is correct." << endl;
+		return;
+	}
+	if (instructions.empty()) {
+		cout << "No instructions loaded, ensure object file is not empty." << endl;
+		return;
+	}
+	ExecuteInstruction ins(request.trace ? &cout : nullptr); //the global machine
+	while (!ins.isHalted() && steps != request.maxSteps) {
+		if (clientGone(connection))
+			return;
+		steps += ins.run(min(DAEMON_POLL_INTERVAL, request.maxSteps - steps));
+	}
+	if (!request.trace)
+		ExecuteInstruction(&cout).printRegisters();
+	if (!request.trace && ins.isHalted())
+		cout << ins.getHaltReason() << endl;
+	else if (!ins.isHalted())
+		cout << "Machine Halted - step limit reached" << endl;
+}
+
+/************************************************************************
+Function: serveRequests
+Author: Jake Davidson
+Description: Body of a worker process. Takes connections from the
+listening socket one at a time and runs the request on each, with cout
+sent to the client for the length of the run. Only returns, to exit, if
+the socket fails.
+Parameters: server - listening socket
+			imageCache - directory of predecoded images, empty for none
+************************************************************************/
+static void serveRequests(int server, string imageCache) {
+	ProgramCache cache(imageCache); //programs this worker has decoded
+	ios_base::fmtflags flags = cout.flags(); //formatting of a new cout, restored for each run
+	string text; //current request
+	daemonRequest request; //its settings
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	atexit(finishCurrentResult);
+	while (true) {
+		int connection = accept(server, nullptr, nullptr); //client being served
+		if (connection < 0 && errno == EINTR)
+			continue;
+		if (connection < 0)
+			return;
+		if (!readRequest(connection, text) || !parseRequest(text, request)) {
+			string error = "b17d: malformed request\n"; //reply to a request that cannot be run
+			writeAll(connection, error.data(), error.size());
+			close(connection);
+			continue;
+		}
+		ResultStream result(connection);
+		string error = ""; //reply to a request that cannot be run
+		if (!request.shmName.empty() && !result.attach(request.shmName))
+			error = "b17d: could not open result segment " + request.shmName + "\n";
+		else if (chdir(request.directory.c_str()) != 0)
+			error = "b17d: could not use working directory " + request.directory + "\n";
+		if (!error.empty()) {
+			writeAll(connection, error.data(), error.size());
+			close(connection);
+			continue;
+		}
+		streambuf *console = cout.rdbuf(&result); //the daemon's own output
+		cout.clear();
+		cout.flags(flags);
+		cout.fill(' ');
+		currentResult = &result;
+		runRequest(request, cache, connection);
+		currentResult = nullptr;
+		result.finish();
+		cout.rdbuf(console);
+		cout.clear();
+		close(connection);
+	}
+}
+
+/************************************************************************
+Function: startWorker
+Author: Jake Davidson
+Description: Forks a worker process serving requests from the socket.
+Parameters: server - listening socket
+			imageCache - directory of predecoded images, empty for none
+Returns: process id of the worker, or -1 if it could not be started
+************************************************************************/
+static pid_t startWorker(int server, string imageCache) {
+	cout.flush();
+	pid_t pid = fork(); //the worker, 0 in the worker itself
+	if (pid == 0) {
+		serveRequests(server, imageCache);
+		_exit(0);
+	}
+	return pid;
+}
+#endif
+
+/************************************************************************
+Function: runDaemon
+Author: Jake Davidson
+Description: Creates the socket (readable and writable by this user only)
+and starts the workers, then waits, starting a new worker whenever one
+exits, until SIGTERM or SIGINT. The workers are then stopped and the
+socket removed.
+Parameters: socketPath - path of the Unix domain socket to create
+			workers - number of worker processes, 0 for one per core
+			imageCache - directory of predecoded images shared by the workers, empty for none
+************************************************************************/
+void runDaemon(string socketPath, int workers, string imageCache) {
+#ifndef _WIN32
+	struct sockaddr_un address = {};
+	struct sigaction stop = {};
+	vector<pid_t> pool; //worker processes
+	int status; //exit status of a worker
+	int server = socket(AF_UNIX, SOCK_STREAM, 0); //listening socket
+	if (server < 0 || socketPath.size() >= sizeof(address.sun_path)) {
+		cout << "Could not create daemon socket " << socketPath << endl;
+		return;
+	}
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketPath.c_str());
+	unlink(socketPath.c_str());
+	if (::bind(server, (struct sockaddr *)&address, sizeof(address)) != 0 || chmod(socketPath.c_str(), 0600) != 0
+		|| listen(server, SOMAXCONN) != 0) {
+		cout << "Could not listen on " << socketPath << endl;
+		close(server);
+		return;
+	}
+	if (workers <= 0)
+		workers = max(1u, thread::hardware_concurrency());
+	//workers run from their clients' directories, so the image cache is found from here
+	char directory[4096]; //working directory of the daemon
+	if (!imageCache.empty() && imageCache[0] != '/' && getcwd(directory, sizeof(directory)))
+		imageCache = string(directory) + "/" + imageCache;
+
+	//no SA_RESTART, so the signal ends the wait below
+	stop.sa_handler = requestStop;
+	sigaction(SIGTERM, &stop, nullptr);
+	sigaction(SIGINT, &stop, nullptr);
+	cout << "b17d listening on " << socketPath << " with " << workers << " workers" << endl;
+	for (int w = 0; w < workers; w++)
+		pool.push_back(startWorker(server, imageCache));
+	while (!stopRequested) {
+		pid_t pid = wait(&status); //worker that exited
+		if (pid < 0 && errno == EINTR)
+			continue;
+		if (pid < 0)
+			break;
+		for (pid_t &worker : pool) {
+			if (worker == pid && !stopRequested)
+				worker = startWorker(server, imageCache);
+		}
+	}
+	for (pid_t worker : pool) {
+		if (worker > 0)
+			kill(worker, SIGTERM);
+	}
+	while (wait(&status) > 0 || errno == EINTR);
+	close(server);
+	unlink(socketPath.c_str());
+	cout << "b17d stopped" << endl;
+#else
+	cout << "The daemon needs POSIX sockets" << endl;
+#endif
+}
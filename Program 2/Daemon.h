@@ -0,0 +1,124 @@
+//Emulator daemon. Started as b17d (b17 installed or linked under that name) or
+//with b17 --daemon <socket>, the emulator listens on a Unix domain socket and
+//runs programs for clients such as b17-client (b17-client.cpp), which takes the
+//same arguments as b17 <object file> and prints the same output, without paying
+//for process startup and decoding on every run.
+//
+//The daemon is a master process and a pool of worker processes (--jobs, one per
+//core by default) that all accept connections on the socket. A worker runs one
+//request at a time on the global machine, with the same loader and executor as
+//b17, so a worker that hits a loader error halts with the usual message and the
+//master starts a new one. A run is abandoned once its client hangs up, which
+//is checked every DAEMON_POLL_INTERVAL instructions. Each worker keeps the
+//decoded programs it has run, keyed by a hash and the size of the object file,
+//so a program is decoded once per worker; with --image-cache the workers also
+//share predecoded images (ProgramImage.h). EAs are calculated again from the
+//data images of each run.
+//
+//One request per connection. The client sends lines of text ending with a
+//blank line. The worker moves to the client's working directory for the run,
+//so paths and the messages naming them are as they would be for b17:
+//    B17RUN 1
+//    cwd /home/user/work         working directory of the client
+//    data prog.hex               repeatable, loaded in order
+//    steps 1000                  optional step limit
+//    block-ops                   optional, decode the bulk memory extension
+//    no-trace                    optional, only the final registers and halt message
+//    shm /b17-result-123         optional, write the output to this segment
+//    object prog.obj
+//Without shm the output of the run is written back on the connection, which is
+//closed when the run is over. With shm the client has created the segment, a
+//daemonResult header followed by the buffer, and the output is written into
+//the buffer; only errors about the request itself come back on the connection.
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+//first line of a request, with the protocol version
+const char DAEMON_REQUEST_MAGIC[] = "B17RUN 1";
+//longest request accepted, in bytes
+const size_t DAEMON_MAX_REQUEST = 1 << 16;
+//instructions a worker runs between checks that the client is still connected
+const unsigned long long DAEMON_POLL_INTERVAL = 1 << 20;
+//decoded programs each worker keeps, least recently used first out
+const size_t DAEMON_CACHED_PROGRAMS = 64;
+//identifies a result segment set up by the daemon
+const unsigned int DAEMON_RESULT_MAGIC = 0xb17d17;
+
+//state of a result segment
+enum daemonResultState { RESULT_RUNNING, RESULT_COMPLETE, RESULT_TRUNCATED };
+
+//start of a result segment, followed by capacity bytes of output
+struct daemonResult {
+	unsigned int magic; //DAEMON_RESULT_MAGIC once the daemon has taken the segment
+	unsigned int state; //daemonResultState
+	uint64_t capacity; //bytes of output the segment holds
+	uint64_t length; //bytes of output written
+};
+
+//one run asked for by a client
+struct daemonRequest {
+	vector<string> dataFiles; //data images loaded before the program, in order
+	string directory; //working directory of the client
+	string objectFile; //program to run
+	unsigned long long maxSteps; //most instructions to execute
+	bool blockOps; //true to decode the bulk memory extension
+	bool trace; //true to trace every instruction
+	string shmName; //result segment, empty to answer on the connection
+};
+
+/************************************************************************
+Function: daemonSocketPath
+Author: Jake Davidson
+Description: Finds the socket the daemon listens on when none is given,
+$B17D_SOCKET or a path of the user's own in /tmp.
+Returns: the socket path
+************************************************************************/
+inline string daemonSocketPath() {
+	const char *path = getenv("B17D_SOCKET"); //socket chosen by the user
+	if (path && *path)
+		return path;
+#ifndef _WIN32
+	return "/tmp/b17d-" + to_string(getuid()) + ".sock";
+#else
+	return "";
+#endif
+}
+
+/************************************************************************
+Function: formatRequest
+Author: Jake Davidson
+Description: Writes a request in the form the daemon reads.
+Parameters: request - the run
+Returns: the request text, ending with the blank line
+************************************************************************/
+inline string formatRequest(const daemonRequest &request) {
+	string text = string(DAEMON_REQUEST_MAGIC) + "\n" + "cwd " + request.directory + "\n"; //request being built
+	for (const string &file : request.dataFiles)
+		text += "data " + file + "\n";
+	//all ones is UNLIMITED_STEPS (ExecuteInstruction.h)
+	if (request.maxSteps != ~0ULL)
+		text += "steps " + to_string(request.maxSteps) + "\n";
+	if (request.blockOps)
+		text += "block-ops\n";
+	if (!request.trace)
+		text += "no-trace\n";
+	if (!request.shmName.empty())
+		text += "shm " + request.shmName + "\n";
+	return text + "object " + request.objectFile + "\n\n";
+}
+
+//listens on socketPath and serves requests on workers worker processes (0 for one per core) until stopped
+void runDaemon(string socketPath, int workers, string imageCache);
+
+#endif
@@ -0,0 +1,263 @@
+#include "DependencyAnalysis.h"
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include "ExecuteInstruction.h"
+#include "SparseMemory.h"
+#include "globals.h"
+
+//token bits used in even and odd phases
+const uint64_t TOKEN_HALVES[2] = { 0x00000000ffffffffULL, 0xffffffff00000000ULL };
+
+/************************************************************************
+Function: DependencyAnalyzer
+Author: Jake Davidson
+Description: Constructs an analyzer for a program, with every register
+and memory word produced before the first cycle.
+Parameters: instructions - the program being executed
+************************************************************************/
+DependencyAnalyzer::DependencyAnalyzer(vector<instruction> &instructions)
+	: instructions(instructions), pages(memoryWords() / PAGE_WORDS), addressMask(memoryWords() - 1),
+	steps(0), phase(0), random(0x2545f4914f6cdd1dULL), plantOffset(0), executed(instructions.size()), sampled(instructions.size()), critical(instructions.size())
+{
+	memset(registers, 0, sizeof(registers));
+	memset(cycles, 0, sizeof(cycles));
+	memset(&latest, 0, sizeof(latest));
+	for (int w = 0; w < WINDOW_COUNT; w++)
+		windows[w].assign(WINDOW_SIZES[w], 0);
+	for (int t = 0; t < 64; t++)
+		tokenInstruction[t] = -1;
+}
+
+/************************************************************************
+Function: word
+Author: Jake Davidson
+Description: Finds the location of a memory word. Addresses wrap like
+the machine's, and the page is allocated the first time it is used.
+Parameters: address - the memory address
+Returns: the location
+************************************************************************/
+dependencyLocation &DependencyAnalyzer::word(unsigned int address) {
+	address &= addressMask;
+	unique_ptr<dependencyLocation[]> &page = pages[address / PAGE_WORDS];
+	if (!page) {
+		page.reset(new dependencyLocation[PAGE_WORDS]);
+		memset(page.get(), 0, PAGE_WORDS * sizeof(dependencyLocation));
+	}
+	return page[address % PAGE_WORDS];
+}
+
+/************************************************************************
+Function: validTokens
+Author: Jake Davidson
+Description: Gives the tokens of a location that are still being
+followed. A value produced in this phase carries only live tokens. One
+produced in the previous phase may also carry tokens of the phase before,
+which have been checked and reused, so only its own phase's half is kept.
+Anything older carries no live tokens.
+Parameters: l - the location
+Returns: the live tokens of l
+************************************************************************/
+uint64_t DependencyAnalyzer::validTokens(const dependencyLocation &l) {
+	if (l.phase == phase)
+		return l.tokens;
+	if (l.phase + 1 == phase)
+		return l.tokens & TOKEN_HALVES[l.phase % 2];
+	return 0;
+}
+
+/************************************************************************
+Function: checkTokens
+Author: Jake Davidson
+Description: Counts a token as critical if the latest finishing value
+carries it, then frees it.
+Parameters: bits - the tokens to check
+************************************************************************/
+void DependencyAnalyzer::checkTokens(uint64_t bits) {
+	uint64_t live = this->validTokens(latest); //tokens on the critical path so far
+	for (int t = 0; t < 64; t++) {
+		if (!(bits >> t & 1) || tokenInstruction[t] < 0)
+			continue;
+		if (live >> t & 1)
+			critical[tokenInstruction[t]]++;
+		tokenInstruction[t] = -1;
+	}
+}
+
+/************************************************************************
+Function: record
+Author: Jake Davidson
+Description: Schedules an instruction about to execute. It reads
+and writes the same locations the executor does, which for a block
+instruction are found from the global machine's registers. In every schedule it
+executes one cycle after the latest value it reads was produced, and in a
+window schedule no earlier than one cycle after the instruction a window
+before it. The values it writes are produced in that cycle and carry the
+tokens of the latest value it read, along with a new token if one is
+planted on it.
+Parameters: i - the instruction, an element of the program
+************************************************************************/
+void DependencyAnalyzer::record(const instruction &i) {
+	vector<dependencyLocation *> &reads = readList, &writes = writeList; //locations read and written
+	dependencyLocation *index = &registers[1 + i.indexRegister]; //index register of the instruction
+	dependencyLocation *memoryWord = nullptr; //memory[EA], if used
+	dependencyLocation *arriving = nullptr; //location read that was produced last
+	uint64_t at[SCHEDULES], tokens = 0; //cycle the instruction executes in each schedule, tokens it passes on
+	size_t n = &i - instructions.data(); //static instruction
+	opCodes op = i.opCode;
+
+	reads.clear();
+	writes.clear();
+	if (readsMemory(op, i.addressMode) || writesMemory(op, i.addressMode))
+		memoryWord = &this->word((unsigned int)i.EA);
+	if (op == ADD || op == SUB || op == AND || op == OR || op == XOR || op == COM || op == ST || op == EM
+		|| op == JZ || op == JN || op == JP || op == BFIL || op == BSUM)
+		reads.push_back(&registers[0]);
+	if (op == STX || op == EMX || op == ADDX || op == SUBX)
+		reads.push_back(index);
+	if (readsMemory(op, i.addressMode))
+		reads.push_back(memoryWord);
+	if (op == LD || op == EM || op == ADD || op == SUB || op == CLR || op == COM || op == AND || op == OR || op == XOR || op == BSUM)
+		writes.push_back(&registers[0]);
+	if (op == LDX || op == EMX || op == ADDX || op == SUBX || op == CLRX)
+		writes.push_back(index);
+	if (writesMemory(op, i.addressMode))
+		writes.push_back(memoryWord);
+	//block instructions read X0 and the bases, then every word of their blocks
+	if (isBlockOp(op)) {
+		unsigned int length = X0, source = X1, destination = X2, words = addressMask + 1; //the blocks, as the executor sees them
+		reads.push_back(&registers[1]);
+		if (op != BFIL)
+			reads.push_back(&registers[2]);
+		if (op != BSUM)
+			reads.push_back(&registers[3]);
+		for (unsigned int w = 0; op != BFIL && X0 > 0 && source < words && length <= words - source && w < length; w++)
+			reads.push_back(&this->word(source + w));
+		for (unsigned int w = 0; op != BSUM && X0 > 0 && destination < words && length <= words - destination && w < length; w++) {
+			writes.push_back(&this->word(destination + w));
+			if (op == BXOR)
+				reads.push_back(writes.back());
+		}
+	}
+
+	for (int s = 0; s < SCHEDULES; s++) {
+		at[s] = 1;
+		for (dependencyLocation *r : reads)
+			at[s] = max(at[s], r->ready[s] + 1);
+	}
+	for (int w = 0; w < WINDOW_COUNT; w++) {
+		//the slot holds the latest cycle up to the instruction a window before this one
+		uint64_t &slot = windows[w][steps % WINDOW_SIZES[w]];
+		at[w] = max(at[w], slot + 1);
+		cycles[w] = max(cycles[w], at[w]);
+		slot = cycles[w];
+	}
+	for (dependencyLocation *r : reads) {
+		if (!arriving || r->ready[WINDOW_COUNT] > arriving->ready[WINDOW_COUNT])
+			arriving = r;
+	}
+	if (arriving)
+		tokens = this->validTokens(*arriving);
+	//a token is planted at a random step of each interval, so loops do not always sample the same instructions
+	if (steps % PLANT_INTERVAL == 0) {
+		random ^= random << 13;
+		random ^= random >> 7;
+		random ^= random << 17;
+		plantOffset = random % PLANT_INTERVAL;
+	}
+	if (steps % PLANT_INTERVAL == plantOffset) {
+		int t = (int)(phase % 2 * 32 + steps % TOKEN_HORIZON / PLANT_INTERVAL); //token planted on this instruction
+		tokenInstruction[t] = (int)n;
+		tokens |= 1ULL << t;
+		sampled[n]++;
+	}
+	for (dependencyLocation *w : writes) {
+		memcpy(w->ready, at, sizeof(at));
+		w->tokens = tokens;
+		w->phase = phase;
+	}
+	if (at[WINDOW_COUNT] >= cycles[WINDOW_COUNT]) {
+		cycles[WINDOW_COUNT] = at[WINDOW_COUNT];
+		latest.tokens = tokens;
+		latest.phase = phase;
+	}
+	executed[n]++;
+	steps++;
+
+	//the previous phase's tokens have lived at least a whole phase
+	if (steps % TOKEN_HORIZON == 0) {
+		this->checkTokens(TOKEN_HALVES[(phase + 1) % 2]);
+		phase++;
+	}
+}
+
+/************************************************************************
+Function: printReport
+Author: Jake Davidson
+Description: Checks the tokens still being followed against the end of
+the run, then prints the critical path length, the parallelism of each
+window and the instructions most often on the critical path.
+Parameters: out - stream to print to
+************************************************************************/
+void DependencyAnalyzer::printReport(ostream &out) {
+	vector<size_t> rows; //static instructions with critical samples, most critical first
+	unsigned long long totalSampled = 0, totalCritical = 0; //over every instruction
+	this->checkTokens(~0ULL);
+	for (size_t n = 0; n < instructions.size(); n++) {
+		totalSampled += sampled[n];
+		totalCritical += critical[n];
+		if (critical[n] > 0)
+			rows.push_back(n);
+	}
+	sort(rows.begin(), rows.end(), [this](size_t a, size_t b) { return critical[a] > critical[b] || (critical[a] == critical[b] && a < b); });
+	if (rows.size() > (size_t)CRITICAL_ROWS)
+		rows.resize(CRITICAL_ROWS);
+
+	out << setfill(' ') << dec << "Dependency analysis (true dependencies through AC, X0-X3 and memory, one cycle per instruction, branches predicted)" << endl;
+	out << "Instructions executed: " << steps << endl;
+	out << "Critical path length:  " << cycles[WINDOW_COUNT] << " cycles" << endl;
+	out << fixed << setprecision(2);
+	out << "Available parallelism: " << (cycles[WINDOW_COUNT] ? (double)steps / cycles[WINDOW_COUNT] : 0.0) << endl << endl;
+	out << right << setw(10) << "window" << setw(16) << "cycles" << setw(14) << "parallelism" << endl;
+	for (int s = 0; s < SCHEDULES; s++) {
+		if (s < WINDOW_COUNT)
+			out << setw(10) << WINDOW_SIZES[s];
+		else
+			out << setw(10) << "unlimited";
+		out << setw(16) << cycles[s] << setw(14) << (cycles[s] ? (double)steps / cycles[s] : 0.0) << endl;
+	}
+	out << endl << "Critical path samples: " << totalCritical << " of " << totalSampled << " sampled instructions";
+	if (totalSampled > 0)
+		out << " (" << 100.0 * totalCritical / totalSampled << "%)";
+	out << endl;
+	if (!rows.empty()) {
+		out << left << setw(9) << "address" << setw(10) << "hex" << setw(6) << "op" << right << setw(14) << "executed"
+			<< setw(10) << "sampled" << setw(10) << "critical" << setw(9) << "share" << endl;
+		for (size_t n : rows) {
+			instruction &i = instructions[n];
+			out << left << hex << setw(9) << i.instructionAddress << setw(10) << i.instructionHexString << dec
+				<< setw(6) << (i.opCode == UNDEFINED ? "???" : opCodesPrintMap[i.opCode]) << right << setw(14) << executed[n]
+				<< setw(10) << sampled[n] << setw(10) << critical[n] << setw(8) << 100.0 * critical[n] / sampled[n] << "%" << endl;
+		}
+	}
+	out << defaultfloat;
+}
+
+/************************************************************************
+Function: runWithDependencyAnalysis
+Author: Jake Davidson
+Description: Runs the loaded program without a trace, scheduling every
+instruction it executes, then prints how the machine halted and the
+dependency report.
+Parameters: maxSteps - most instructions to execute, UNLIMITED_STEPS for no limit
+************************************************************************/
+void runWithDependencyAnalysis(unsigned long long maxSteps) {
+	DependencyAnalyzer analyzer(instructions); //schedules the executed instructions
+	ExecuteInstruction ins(nullptr); //machine, without a trace
+	unsigned long long steps; //instructions executed
+	ins.setDependencyAnalyzer(&analyzer);
+	steps = ins.run(maxSteps);
+	cout << (ins.isHalted() ? ins.getHaltReason() : "Machine Halted - step limit reached") << " after " << dec << steps << " steps" << endl;
+	ExecuteInstruction(&cout).printRegisters();
+	analyzer.printReport(cout);
+}
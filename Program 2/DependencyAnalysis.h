@@ -0,0 +1,82 @@
+//Dynamic dependency analysis. With --dependencies the program runs without a
+//trace while every executed instruction is placed in a dataflow schedule: it
+//can execute one cycle after the last of the values it reads (AC, an index
+//register or memory[EA]) was produced. Only true dependencies count, as if
+//registers and memory were renamed, every instruction took one cycle and every
+//branch was predicted. EAs are fixed when the program is decoded, so there are
+//no address dependencies.
+//
+//The unlimited schedule gives the critical path length, and the instructions
+//executed divided by it is the parallelism available to an ideal machine. The
+//same schedule is also kept for several instruction window sizes, where an
+//instruction cannot start until the instruction WINDOW places before it, and
+//everything before that, has executed.
+//
+//Nothing is kept per dynamic instruction, only the cycle each location was
+//last written in, so memory use is fixed by the program and the memory it
+//touches, however long the run. The instructions on the critical path are found by
+//token passing: once every PLANT_INTERVAL steps, at a random step, a token is
+//planted on the executing instruction and passed along the last arriving dependency to whatever is
+//computed from it. A token that is still carried by the latest finishing value
+//TOKEN_HORIZON to 2*TOKEN_HORIZON steps later lies on the critical path of the
+//run so far. The report gives, for each static instruction, how often its
+//sampled instances were critical.
+#ifndef DEPENDENCYANALYSIS_H
+#define DEPENDENCYANALYSIS_H
+
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <cstdint>
+#include "const.h"
+
+using namespace std;
+
+//window sizes scheduled besides the unlimited window
+const int WINDOW_SIZES[] = { 4, 16, 64, 256, 1024 };
+const int WINDOW_COUNT = sizeof(WINDOW_SIZES) / sizeof(WINDOW_SIZES[0]);
+//schedules kept, the windows then the unlimited window
+const int SCHEDULES = WINDOW_COUNT + 1;
+//steps in a token phase, tokens are checked at the end of the phase after the one they were planted in
+const unsigned long long TOKEN_HORIZON = 4096;
+//steps between planted tokens, so a phase plants at most 32 and uses half of the 64 token bits
+const unsigned long long PLANT_INTERVAL = TOKEN_HORIZON / 32;
+//instructions listed in the critical instruction table
+const int CRITICAL_ROWS = 10;
+
+//a register or memory word: when its value was produced and the tokens it carries
+struct dependencyLocation {
+	uint64_t ready[SCHEDULES]; //cycle the value was produced in each schedule
+	uint64_t tokens; //tokens carried by the value
+	uint64_t phase; //token phase the value was produced in
+};
+
+class DependencyAnalyzer {
+public:
+	DependencyAnalyzer(vector<instruction> &instructions);
+	void record(const instruction &i); //schedule an instruction about to execute
+	void printReport(ostream &out); //print the critical path, parallelism and critical instructions
+private:
+	dependencyLocation &word(unsigned int address); //location of a memory word, allocating its page if needed
+	uint64_t validTokens(const dependencyLocation &l); //tokens of l that are still being followed
+	void checkTokens(uint64_t bits); //count the tokens in bits that are critical, and free them
+	vector<instruction> &instructions; //program, to give static instructions an index
+	dependencyLocation registers[5]; //AC then X0-X3
+	vector<unique_ptr<dependencyLocation[]> > pages; //memory words, pages allocated when first written
+	unsigned int addressMask; //memory address bits kept
+	vector<uint64_t> windows[WINDOW_COUNT]; //latest cycle of each of the last WINDOW_SIZES[w] instructions
+	uint64_t cycles[SCHEDULES]; //latest cycle so far in each schedule
+	unsigned long long steps; //instructions recorded
+	uint64_t phase; //current token phase
+	uint64_t random; //xorshift state choosing where tokens are planted
+	uint64_t plantOffset; //step of the current interval a token is planted on
+	dependencyLocation latest; //latest finishing value, only its tokens and phase are used
+	int tokenInstruction[64]; //static instruction each token was planted on, -1 if unused
+	vector<unsigned long long> executed, sampled, critical; //per static instruction
+	vector<dependencyLocation *> readList, writeList; //locations used by the instruction being scheduled
+};
+
+//runs the loaded program without a trace, scheduling its dependencies, then prints the report
+void runWithDependencyAnalysis(unsigned long long maxSteps);
+
+#endif
@@ -0,0 +1,339 @@
+#include "Devices.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+/************************************************************************
+Function: openStream
+Author: Jake Davidson
+Description: Opens a device file, or a pipe to or from a command if the
+name starts with |.
+Parameters: name - file name or |command
+			mode - "r" or "w"
+Returns: the open stream, nullptr if it could not be opened
+************************************************************************/
+static FILE *openStream(string name, const char *mode) {
+	if (!name.empty() && name[0] == '|')
+		return popen(name.substr(1).c_str(), mode);
+	return fopen(name.c_str(), mode);
+}
+
+/************************************************************************
+Function: closeStream
+Author: Jake Davidson
+Description: Closes a stream opened by openStream.
+Parameters: name - name the stream was opened with
+			file - the stream
+************************************************************************/
+static void closeStream(string name, FILE *file) {
+	if (!name.empty() && name[0] == '|')
+		pclose(file);
+	else
+		fclose(file);
+}
+
+/************************************************************************
+Function: read
+Author: Jake Davidson
+Description: Takes the next word from the input queue, or reports how
+many words are waiting.
+Parameters: offset - 0 for the FIFO, 1 for the count of waiting words
+Returns: the next word, 0 if none is waiting, or the count
+************************************************************************/
+int InputDevice::read(int offset) {
+	int word = 0; //word read, 0 if none waiting
+	if (offset == 1)
+		return (int)shared->queue.size();
+	shared->queue.pop(word);
+	return word;
+}
+
+/************************************************************************
+Function: start
+Author: Jake Davidson
+Description: Starts the backend, which reads hex words from the source
+into the queue until the source ends or the machine is done. When the
+queue is full the backend waits for the machine to catch up. The backend
+only uses the channel, so it is left behind if it is stuck reading a
+source that has not ended when the machine stops.
+************************************************************************/
+void InputDevice::start() {
+	shared = make_shared<channel>();
+	shared->stopping = false;
+	shared_ptr<channel> c = shared; //channel kept alive by the backend
+	string name = source;
+	backend = thread([c, name]() {
+		FILE *file = openStream(name, "r");
+		unsigned int word; //word read from the source
+		if (!file) {
+			cerr << "Could not open device input " << name << endl;
+			return;
+		}
+		while (!c->stopping && fscanf(file, "%x", &word) == 1) {
+			while (!c->queue.push((int)(word & 0xffffff)) && !c->stopping)
+				this_thread::sleep_for(chrono::microseconds(100));
+		}
+		closeStream(name, file);
+	});
+}
+
+/************************************************************************
+Function: stop
+Author: Jake Davidson
+Description: Stops the backend. Words not read by the machine are dropped.
+************************************************************************/
+void InputDevice::stop() {
+	if (!shared)
+		return;
+	shared->stopping = true;
+	if (backend.joinable())
+		backend.detach();
+}
+
+/************************************************************************
+Function: ~OutputDevice
+Author: Jake Davidson
+Description: Closes the destination if the machine never started, waiting
+for a command it was piped to.
+************************************************************************/
+OutputDevice::~OutputDevice() {
+	this->stop();
+	if (file)
+		closeStream(destination, file);
+}
+
+/************************************************************************
+Function: open
+Author: Jake Davidson
+Description: Opens the destination, so a bad name is reported before the
+machine starts.
+Returns: false if the destination could not be opened
+************************************************************************/
+bool OutputDevice::open() {
+	file = openStream(destination, "w");
+	return file != nullptr;
+}
+
+/************************************************************************
+Function: write
+Author: Jake Davidson
+Description: Queues a stored word for the backend. Waits only if the
+queue is full.
+Parameters: offset - always 0, unused
+			value - word stored
+************************************************************************/
+void OutputDevice::write(int /*offset*/, int value) {
+	while (!queue.push(value))
+		this_thread::yield();
+}
+
+/************************************************************************
+Function: start
+Author: Jake Davidson
+Description: Starts the backend, which writes queued words to the
+destination, one hex word per line, flushing whenever the queue runs dry
+so a reader on a pipe sees output as it is produced.
+************************************************************************/
+void OutputDevice::start() {
+	backend = thread([this]() {
+		int word; //word taken from the queue
+		bool written = false; //true if words were written since the last flush
+		while (true) {
+			if (queue.pop(word)) {
+				fprintf(file, "%06x\n", (unsigned int)word & 0xffffff);
+				written = true;
+			}
+			else if (stopping) {
+				break;
+			}
+			else {
+				if (written)
+					fflush(file);
+				written = false;
+				this_thread::sleep_for(chrono::microseconds(100));
+			}
+		}
+		closeStream(destination, file);
+		file = nullptr;
+	});
+}
+
+/************************************************************************
+Function: stop
+Author: Jake Davidson
+Description: Waits for the backend to write every queued word.
+************************************************************************/
+void OutputDevice::stop() {
+	stopping = true;
+	if (backend.joinable())
+		backend.join();
+}
+
+/************************************************************************
+Function: start
+Author: Jake Davidson
+Description: Starts the backend, which advances the tick count once per
+period, measured from the start so ticks do not drift.
+************************************************************************/
+void TimerDevice::start() {
+	backend = thread([this]() {
+		chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+		long long tick = 0; //ticks counted so far
+		while (!stopping) {
+			this_thread::sleep_until(begin + chrono::microseconds(period * (tick + 1)));
+			tick++;
+			ticks.store((int)(tick & 0xffffff), memory_order_relaxed);
+		}
+	});
+}
+
+/************************************************************************
+Function: stop
+Author: Jake Davidson
+Description: Stops the backend.
+************************************************************************/
+void TimerDevice::stop() {
+	stopping = true;
+	if (backend.joinable())
+		backend.join();
+}
+
+/************************************************************************
+Function: DeviceBus
+Author: Jake Davidson
+Description: Constructs a bus with no devices, all memory is plain memory.
+************************************************************************/
+DeviceBus::DeviceBus() : running(false) {
+	for (int a = 0; a < 4096; a++)
+		map[a] = nullptr;
+}
+
+/************************************************************************
+Function: ~DeviceBus
+Author: Jake Davidson
+Description: Stops the devices if they are still running.
+************************************************************************/
+DeviceBus::~DeviceBus() {
+	this->stop();
+}
+
+/************************************************************************
+Function: configure
+Author: Jake Davidson
+Description: Reads the devices file and places each device. Devices may
+not overlap or extend past the end of memory, and output destinations are
+opened here so errors are reported before the machine starts.
+Parameters: file - devices file, one device per line
+Returns: false if the file cannot be read or a line is invalid
+************************************************************************/
+bool DeviceBus::configure(string file) {
+	ifstream fin(file); //devices file
+	string line, kind, name; //current line, device kind and its file
+	int lineNumber = 0; //line being read, for errors
+	unsigned int address; //first word of the device
+	long long period; //timer period
+	if (!fin) {
+		cout << "Could not open devices file " << file << endl;
+		return false;
+	}
+	while (getline(fin, line)) {
+		lineNumber++;
+		if (line.find('#') != string::npos)
+			line = line.substr(0, line.find('#'));
+		istringstream fields(line);
+		if (!(fields >> kind))
+			continue;
+		Device *d = nullptr; //device described by the line
+		if (!(fields >> hex >> address) || address >= 4096) {
+			cout << file << ":" << lineNumber << ": invalid device address" << endl;
+			return false;
+		}
+		if (kind == "input" && fields >> ws && getline(fields, name) && !name.empty())
+			d = new InputDevice(address, name);
+		else if (kind == "output" && fields >> ws && getline(fields, name) && !name.empty()) {
+			OutputDevice *output = new OutputDevice(address, name);
+			if (!output->open()) {
+				cout << file << ":" << lineNumber << ": could not open " << name << endl;
+				delete output;
+				return false;
+			}
+			d = output;
+		}
+		else if (kind == "timer" && fields >> dec >> period && period > 0)
+			d = new TimerDevice(address, period);
+		else {
+			cout << file << ":" << lineNumber << ": expected input, output or timer and its file or period" << endl;
+			return false;
+		}
+		devices.push_back(unique_ptr<Device>(d));
+		for (int w = 0; w < d->words(); w++) {
+			if (address + w >= 4096 || map[address + w]) {
+				cout << file << ":" << lineNumber << ": device overlaps another device or the end of memory" << endl;
+				return false;
+			}
+			map[address + w] = d;
+		}
+	}
+	return true;
+}
+
+/************************************************************************
+Function: start
+Author: Jake Davidson
+Description: Starts the backend of every device.
+************************************************************************/
+void DeviceBus::start() {
+	for (unique_ptr<Device> &d : devices)
+		d->start();
+	running = true;
+}
+
+/************************************************************************
+Function: stop
+Author: Jake Davidson
+Description: Stops the backend of every device, waiting for output to be
+written.
+************************************************************************/
+void DeviceBus::stop() {
+	if (!running)
+		return;
+	for (unique_ptr<Device> &d : devices)
+		d->stop();
+	running = false;
+}
+
+/************************************************************************
+Function: beforeStep
+Author: Jake Davidson
+Description: If the instruction reads a device word, reads the device
+and places the value in memory for the instruction to use.
+Parameters: i - instruction about to execute
+			memory - memory of the machine
+************************************************************************/
+void DeviceBus::beforeStep(instruction &i, int *memory) {
+	if (this->mapped(i.EA) && !illegalAddressMode(i.opCode, i.addressMode) && readsMemory(i.opCode, i.addressMode)) {
+		Device *d = map[i.EA];
+		memory[i.EA] = d->read(i.EA - d->getAddress());
+	}
+}
+
+/************************************************************************
+Function: afterStep
+Author: Jake Davidson
+Description: If the instruction wrote a device word, gives the value it
+wrote to the device.
+Parameters: i - instruction that executed
+			memory - memory of the machine
+************************************************************************/
+void DeviceBus::afterStep(instruction &i, int *memory) {
+	if (this->mapped(i.EA) && writesMemory(i.opCode, i.addressMode)) {
+		Device *d = map[i.EA];
+		d->write(i.EA - d->getAddress(), memory[i.EA]);
+	}
+}
@@ -0,0 +1,133 @@
+//Memory-mapped devices. With --devices <file> words of memory are routed to
+//devices instead of being plain storage. Each line of the devices file places
+//one device, addresses are hex like the object file (# starts a comment):
+//
+//  input <address> <file>          input FIFO: each read of address returns the next
+//                                  word of file (hex, whitespace separated), 0 if none
+//                                  has arrived yet. Reading address+1 returns the
+//                                  number of words waiting
+//  output <address> <file>         output port: each word stored at address is
+//                                  written to file as a 6 digit hex line
+//  timer <address> <microseconds>  timer: reading address returns the ticks of the
+//                                  given period since the machine started
+//
+//A file starting with | is a command to read from or write to through a pipe.
+//Devices are placed for a plain run of one program (with --stream, --lazy-decode,
+//--optimize, --metrics or --pipeline), the other modes reject --devices.
+//
+//Every device has a backend thread doing the host I/O or timekeeping. The
+//machine talks to it through an SpscQueue, so executing an instruction never
+//waits on the host: an input FIFO with nothing waiting reads 0. The one
+//exception is an output port whose queue is full, where the machine waits for
+//the backend rather than lose output.
+//
+//Before an instruction that reads memory[EA] of a device executes, the device
+//value is placed in memory[EA]; after an instruction that writes it, the new
+//value of memory[EA] is given to the device. EM and EMX exchange with the device.
+#ifndef DEVICES_H
+#define DEVICES_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include "SpscQueue.h"
+#include "Semantics.h"
+#include "globals.h"
+
+using namespace std;
+
+//words a device queue holds between the machine and the backend
+const size_t DEVICE_QUEUE_WORDS = 4096;
+
+//a device occupying one or more words of memory
+class Device {
+public:
+	Device(int address) : address(address) {}
+	virtual ~Device() {}
+	virtual int words() = 0; //number of memory words the device occupies
+	virtual int read(int offset) = 0; //value read from word address + offset
+	virtual void write(int offset, int value) = 0; //value stored to word address + offset
+	virtual void start() = 0; //start the backend thread
+	virtual void stop() = 0; //finish outstanding I/O and stop the backend thread
+	int getAddress() { return address; } //first word of the device
+protected:
+	int address; //first word of the device
+};
+
+//input FIFO fed from a file or command
+class InputDevice : public Device {
+public:
+	InputDevice(int address, string source) : Device(address), source(source) {}
+	int words() { return 2; }
+	int read(int offset);
+	void write(int /*offset*/, int /*value*/) {}
+	void start();
+	void stop();
+private:
+	//state shared with the backend, which may outlive the device if its source never ends
+	struct channel {
+		SpscQueue<int, DEVICE_QUEUE_WORDS> queue; //words read by the backend
+		atomic<bool> stopping; //set when the machine is done with the device
+	};
+	string source; //file or |command to read
+	shared_ptr<channel> shared; //queue and stop flag
+	thread backend; //reads words from source into the queue
+};
+
+//output port written to a file or command
+class OutputDevice : public Device {
+public:
+	OutputDevice(int address, string destination) : Device(address), destination(destination) {}
+	~OutputDevice();
+	int words() { return 1; }
+	int read(int /*offset*/) { return 0; }
+	void write(int offset, int value);
+	bool open(); //open the destination, false if it cannot be opened
+	void start();
+	void stop();
+private:
+	string destination; //file or |command to write
+	FILE *file = nullptr; //open destination, until the backend or destructor closes it
+	SpscQueue<int, DEVICE_QUEUE_WORDS> queue; //words stored by the machine
+	atomic<bool> stopping{ false }; //set when the machine is done with the device
+	thread backend; //writes words from the queue to the destination
+};
+
+//free running timer
+class TimerDevice : public Device {
+public:
+	TimerDevice(int address, long long period) : Device(address), period(period) {}
+	int words() { return 1; }
+	int read(int /*offset*/) { return ticks.load(memory_order_relaxed); }
+	void write(int /*offset*/, int /*value*/) {}
+	void start();
+	void stop();
+private:
+	long long period; //microseconds per tick
+	atomic<int> ticks{ 0 }; //ticks since start, kept to 24 bits
+	atomic<bool> stopping{ false }; //set when the machine is done with the device
+	thread backend; //advances ticks
+};
+
+//the devices of a machine and the memory words they occupy
+class DeviceBus {
+public:
+	DeviceBus();
+	~DeviceBus();
+	bool configure(string file); //place the devices listed in file, false on errors
+	void start(); //start every backend
+	void stop(); //stop every backend, flushing output
+	//true if the word at address belongs to a device
+	bool mapped(int address) { return address >= 0 && address < 4096 && map[address] != nullptr; }
+	void beforeStep(instruction &i, int *memory); //read the device into memory if i reads it
+	void afterStep(instruction &i, int *memory); //give memory to the device if i wrote it
+private:
+	vector<unique_ptr<Device>> devices; //every device, in the order configured
+	Device *map[4096]; //device owning each word, nullptr for plain memory
+	bool running; //true between start and stop
+};
+
+#endif
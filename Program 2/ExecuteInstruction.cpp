@@ -1,4 +1,36 @@
 #include "ExecuteInstruction.h"
+#include <fstream>
+#include <cstring>
+
+/************************************************************************
+Function: ExecuteInstruction
+Author: Jake Davidson
+Description: Constructs an executor for the global machine, the one 
+started from the command line.
+Parameters: out - stream to write the trace to, nullptr for no trace
+************************************************************************/
+ExecuteInstruction::ExecuteInstruction(ostream *out)
+	: AC(::AC), X0(::X0), X1(::X1), X2(::X2), X3(::X3), memory(::memory), extended(::extendedMemory),
+	instructions(::instructions), instructionRegister(::instructionRegister),
+	out(out), metrics(nullptr), devices(nullptr), loader(nullptr), lazy(nullptr), counters(nullptr), analyzer(nullptr), layout(nullptr), pipeline(nullptr), shared(false), halted(false)
+{
+}
+
+/************************************************************************
+Function: ExecuteInstruction
+Author: Jake Davidson
+Description: Constructs an executor for a machine other than the global
+one. Several of these can run at once on different threads, as long as
+each has its own machineState.
+Parameters: m - state of the machine to execute
+			out - stream to write the trace to, nullptr for no trace
+************************************************************************/
+ExecuteInstruction::ExecuteInstruction(machineState &m, ostream *out)
+	: AC(m.AC), X0(m.X0), X1(m.X1), X2(m.X2), X3(m.X3), memory(m.memory), extended(nullptr),
+	instructions(*m.instructions), instructionRegister(m.instructionRegister),
+	out(out), metrics(nullptr), devices(nullptr), loader(nullptr), lazy(nullptr), counters(nullptr), analyzer(nullptr), layout(nullptr), pipeline(nullptr), shared(false), halted(false)
+{
+}
 
 /************************************************************************
 Function: halt
@@ -6,9 +38,7 @@ Author: Jake Davidson
 Description: Halts execution
 ************************************************************************/
 void ExecuteInstruction::halt() {
-	this->printRegisters();
-	cout << "Machine Halted - HALT instruction executed" << endl;
-	exit(0);
+	this->stop("Machine Halted - HALT instruction executed", true);
 }
 
 /************************************************************************
@@ -20,10 +50,12 @@ Parameters: i - current instruction
 void ExecuteInstruction::LD(instruction i) {
 	//if the addressing mode is IMM, take the immediate value
 	if (i.addressMode == Immediate)
-		AC = i.EA;
+		AC = accumulatorResult(i.opCode, AC, i.EA);
 	//otherwise, load value from memory
-	else 
-		AC = memory[i.EA];
+	else {
+		TRACK_READ(i.EA);
+		AC = accumulatorResult(i.opCode, AC, this->load(i.EA));
+	}
 }
 
 /************************************************************************
@@ -34,14 +66,14 @@ Parameters: i - current instruction
 ************************************************************************/
 void ExecuteInstruction::ST(instruction i) {
 	//check for legal addressing mode
-	if (i.addressMode == Immediate) {
-		this->printRegisters();
-		cout << "Machine Halted - illegal addressing mode" << endl;
-		exit(0);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		this->stop("Machine Halted - illegal addressing mode", true);
 	}
 	//store AC into memory location
-	else
-		memory[i.EA] = AC;
+	else {
+		TRACK_WRITE(i.EA);
+		this->store(i.EA, AC);
+	}
 }
 
 /************************************************************************
@@ -52,18 +84,15 @@ Parameters: i - current instruction
 ************************************************************************/
 void ExecuteInstruction::EM(instruction i) 
 {
-	int tmp; //used for swap
 	//check for illegal addressing mode
-	if (i.addressMode == Immediate) {
-		this->printRegisters();
-		cout << "Machine Halted - illegal addressing mode" << endl;
-		exit(0);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		this->stop("Machine Halted - illegal addressing mode", true);
 	}
 	//swap memory with AC
 	else {
-		tmp = memory[i.EA];
-		i.EA = AC;
-		AC = tmp;
+		TRACK_READ(i.EA);
+		TRACK_WRITE(i.EA);
+		AC = this->exchange(i.EA, AC);
 	}
 }
 
@@ -77,31 +106,29 @@ void ExecuteInstruction::LDX(instruction i)
 {
 	int x; //holds value to store to register
 	//check for illegal addressing modes
-	if (i.addressMode == Indexed || i.addressMode == Indirect) {
-		this->printRegisters();
-		cout << "Machine Halted - illegal addressing mode" << endl;
-		exit(0);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		this->stop("Machine Halted - illegal addressing mode", true);
 	}
 	else {
-		x = memory[i.EA]; //load value from memory
+		TRACK_READ(i.EA);
+		x = this->load(i.EA); //load value from memory
 		//store it to specified register
 		switch (i.indexRegister)
 		{
 		case 0:
-			X0 = x;
+			X0 = indexResult(i.opCode, X0, x);
 			break;
 		case 1:
-			X1 = x;
+			X1 = indexResult(i.opCode, X1, x);
 			break;
 		case 2:
-			X2 = x;
+			X2 = indexResult(i.opCode, X2, x);
 			break;
 		case 3:
-			X3 = x;
+			X3 = indexResult(i.opCode, X3, x);
 			break;
 		default:
-			cout << "Machine Halted - illegal index register (somehow)" << endl;
-			exit(0);
+			this->stop("Machine Halted - illegal index register (somehow)", false);
 			break;
 		}
 	}
@@ -116,30 +143,28 @@ Parameters: i - current instruction
 void ExecuteInstruction::STX(instruction i)
 {
 	//check for illegal addressing mode
-	if (i.addressMode != Direct) {
-		this->printRegisters();
-		cout << "Machine Halted - illegal addressing mode" << endl;
-		exit(0);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		this->stop("Machine Halted - illegal addressing mode", true);
 	}
 	//store specified register into memory location in EA
 	else {
+		TRACK_WRITE(i.EA);
 		switch (i.indexRegister)
 		{
 		case 0:
-			memory[i.EA] = X0;
+			this->store(i.EA, X0);
 			break;
 		case 1:
-			memory[i.EA] = X1;
+			this->store(i.EA, X1);
 			break;
 		case 2:
-			memory[i.EA] = X2;
+			this->store(i.EA, X2);
 			break;
 		case 3:
-			memory[i.EA] = X3;
+			this->store(i.EA, X3);
 			break;
 		default:
-			cout << "Machine Halted - illegal index register (somehow)" << endl;
-			exit(0);
+			this->stop("Machine Halted - illegal index register (somehow)", false);
 			break;
 		}
 	}
@@ -153,37 +178,30 @@ Parameters: i - current instruction
 ************************************************************************/
 void ExecuteInstruction::EMX(instruction i)
 {
-	int tmp; //temp value used for swap
 	//check for illegal addressing mode
-	if (i.addressMode != Direct) {
-		this->printRegisters();
-		cout << "Machine Halted - illegal addressing mode" << endl;
-		exit(0);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		this->stop("Machine Halted - illegal addressing mode", true);
 	}
 	//store specified register into memory location in EA
 	else {
-		tmp = memory[i.EA];
+		TRACK_READ(i.EA);
+		TRACK_WRITE(i.EA);
 		switch (i.indexRegister)
 		{
 		case 0:
-			memory[i.EA] = X0;
-			X0 = tmp;
+			X0 = this->exchange(i.EA, X0);
 			break;
 		case 1:
-			memory[i.EA] = X1;
-			X1 = tmp;
+			X1 = this->exchange(i.EA, X1);
 			break;
 		case 2:
-			memory[i.EA] = X2;
-			X2 = tmp;
+			X2 = this->exchange(i.EA, X2);
 			break;
 		case 3:
-			memory[i.EA] = X3;
-			X3 = tmp;
+			X3 = this->exchange(i.EA, X3);
 			break;
 		default:
-			cout << "Machine Halted - illegal index register (somehow)" << endl;
-			exit(0);
+			this->stop("Machine Halted - illegal index register (somehow)", false);
 			break;
 		}
 	}
@@ -201,11 +219,12 @@ void ExecuteInstruction::ADD(instruction i)
 {
 	//if IMM addressing mode, add immediate value to AC
 	if (i.addressMode == Immediate) {
-		AC += i.EA;
+		AC = accumulatorResult(i.opCode, AC, i.EA);
 	}
 	//otherwise add memory location to AC
 	else {
-		AC += memory[i.EA];
+		TRACK_READ(i.EA);
+		AC = accumulatorResult(i.opCode, AC, this->load(i.EA));
 	}
 }
 
@@ -219,11 +238,12 @@ void ExecuteInstruction::SUB(instruction i)
 {
 	//if IMM addressing mode, subtract immediate value from AC
 	if (i.addressMode == Immediate) {
-		AC -= i.EA;
+		AC = accumulatorResult(i.opCode, AC, i.EA);
 	}
 	//otherwise subtract memory location from AC
 	else {
-		AC -= memory[i.EA];
+		TRACK_READ(i.EA);
+		AC = accumulatorResult(i.opCode, AC, this->load(i.EA));
 	}
 }
 
@@ -236,7 +256,7 @@ Parameters: i - current instruction
 void ExecuteInstruction::CLR()
 {
 	//set value of accumulator to 0
-	AC = 0;
+	AC = accumulatorResult(opCodes::CLR, AC, 0);
 }
 
 /************************************************************************
@@ -248,7 +268,7 @@ Parameters: i - current instruction
 void ExecuteInstruction::COM()
 {
 	//take complement of the accumulator
-	AC = ~AC;
+	AC = accumulatorResult(opCodes::COM, AC, 0);
 }
 
 /************************************************************************
@@ -262,10 +282,12 @@ void ExecuteInstruction::AND(instruction i)
 	//bitwise AND a memory location and the accumulator
 	//for IMM address mode, and the immediate value in the instruction
 	if (i.addressMode == Immediate)
-		AC = AC & i.EA;
+		AC = accumulatorResult(i.opCode, AC, i.EA);
 	//for all other addressing modes, AND the value at the memory location i.EA
-	else
-		AC = AC & memory[i.EA];
+	else {
+		TRACK_READ(i.EA);
+		AC = accumulatorResult(i.opCode, AC, this->load(i.EA));
+	}
 }
 
 /************************************************************************
@@ -279,10 +301,12 @@ void ExecuteInstruction::OR(instruction i)
 	//bitwise OR a memory location and the accumulator
 	//for IMM address mode, OR the immediate value in the instruction
 	if (i.addressMode == Immediate)
-		AC = AC | i.EA;
+		AC = accumulatorResult(i.opCode, AC, i.EA);
 	//for all other addressing modes, OR the value at the memory location i.EA
-	else
-		AC = AC | memory[i.EA];
+	else {
+		TRACK_READ(i.EA);
+		AC = accumulatorResult(i.opCode, AC, this->load(i.EA));
+	}
 }
 
 /************************************************************************
@@ -296,10 +320,12 @@ void ExecuteInstruction::XOR(instruction i)
 	//bitwise XOR a memory location and the accumulator
 	//for IMM address mode, XOR the immediate value in the instruction
 	if (i.addressMode == Immediate)
-		AC = AC ^ i.EA;
+		AC = accumulatorResult(i.opCode, AC, i.EA);
 	//for all other addressing modes, XOR the value at the memory location i.EA
-	else
-		AC = AC ^ memory[i.EA];
+	else {
+		TRACK_READ(i.EA);
+		AC = accumulatorResult(i.opCode, AC, this->load(i.EA));
+	}
 }
 
 /************************************************************************
@@ -312,10 +338,8 @@ void ExecuteInstruction::ADDX(instruction i)
 {
 	int addVal; //value to add to register
 	//check for ilegal addressing modes
-	if (i.addressMode == Indexed || i.addressMode == Indirect) {
-		this->printRegisters();
-		cout << "Machine Halted - illegal addressing mode" << endl;
-		exit(0);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		this->stop("Machine Halted - illegal addressing mode", true);
 	}
 	//for IMM, add the EA value directly
 	else if (i.addressMode == Immediate) {
@@ -323,25 +347,25 @@ void ExecuteInstruction::ADDX(instruction i)
 	}
 	//for Direct, add value located at memory location EA
 	else {
-		addVal = memory[i.EA];
+		TRACK_READ(i.EA);
+		addVal = this->load(i.EA);
 	}
 	//add addVal to specified index register
 	switch (i.indexRegister) {
 	case 0:
-		X0 += addVal;
+		X0 = indexResult(i.opCode, X0, addVal);
 		break;
 	case 1:
-		X1 += addVal;
+		X1 = indexResult(i.opCode, X1, addVal);
 		break;
 	case 2:
-		X2 += addVal;
+		X2 = indexResult(i.opCode, X2, addVal);
 		break;
 	case 3:
-		X3 += addVal;
+		X3 = indexResult(i.opCode, X3, addVal);
 		break;
 	default:
-		cout << "Machine Halted - illegal index register (somehow)" << endl;
-		exit(0);
+		this->stop("Machine Halted - illegal index register (somehow)", false);
 	}
 }
 
@@ -355,10 +379,8 @@ void ExecuteInstruction::SUBX(instruction i)
 {
 	int subVal; //value to sub from register
 	//check for ilegal addressing modes
-	if (i.addressMode == Indexed || i.addressMode == Indirect) {
-		this->printRegisters();
-		cout << "Machine Halted - illegal addressing mode" << endl;
-		exit(0);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		this->stop("Machine Halted - illegal addressing mode", true);
 	}
 	//for IMM, sub the EA value directly
 	else if (i.addressMode == Immediate) {
@@ -366,25 +388,25 @@ void ExecuteInstruction::SUBX(instruction i)
 	}
 	//for Direct, sub value located at memory location EA
 	else {
-		subVal = memory[i.EA];
+		TRACK_READ(i.EA);
+		subVal = this->load(i.EA);
 	}
 	//sub addVal from specified index register
 	switch (i.indexRegister) {
 	case 0:
-		X0 -= subVal;
+		X0 = indexResult(i.opCode, X0, subVal);
 		break;
 	case 1:
-		X1 -= subVal;
+		X1 = indexResult(i.opCode, X1, subVal);
 		break;
 	case 2:
-		X2 -= subVal;
+		X2 = indexResult(i.opCode, X2, subVal);
 		break;
 	case 3:
-		X3 -= subVal;
+		X3 = indexResult(i.opCode, X3, subVal);
 		break;
 	default:
-		cout << "Machine Halted - illegal index register (somehow)" << endl;
-		exit(0);
+		this->stop("Machine Halted - illegal index register (somehow)", false);
 	}
 }
 
@@ -401,20 +423,19 @@ void ExecuteInstruction::CLRX(instruction i)
 	{
 	//0 out the specified register
 	case 0:
-		X0 = 0;
+		X0 = indexResult(i.opCode, X0, 0);
 		break;
 	case 1:
-		X1 = 0;
+		X1 = indexResult(i.opCode, X1, 0);
 		break;
 	case 2:
-		X2 = 0;
+		X2 = indexResult(i.opCode, X2, 0);
 		break;
 	case 3:
-		X3 = 0;
+		X3 = indexResult(i.opCode, X3, 0);
 		break;
 	default:
-		cout << "Machine Halted - illegal register specifier (somehow)" << endl;
-		exit(0);
+		this->stop("Machine Halted - illegal register specifier (somehow)", false);
 		break;
 	}
 }
@@ -431,10 +452,26 @@ bool ExecuteInstruction::J(instruction i)
 	//the instruction with the address specified in i
 
 	//check that we do not have an illegal addressing mode
-	if (i.addressMode == Immediate) {
-		this->printRegisters();
-		cout << "Machine Halted - illegal addressing mode" << endl;
-		exit(0);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		this->stop("Machine Halted - illegal addressing mode", true);
+	}
+	//while the program is still being loaded, wait for the target to be decoded
+	else if (loader && !loader->finished()) {
+		if (loader->waitForAddress(i.EA, instructionRegister))
+			return true;
+		this->stop("Machine Halted - invalid jump address", false);
+	}
+	//a reordered program finds the target through its address table
+	else if (layout) {
+		if (layout->find(i.EA, instructionRegister))
+			return true;
+		this->stop("Machine Halted - invalid jump address", false);
+	}
+	//with lazy decoding the target may not be decoded yet
+	else if (lazy) {
+		if (lazy->find(i.EA, instructionRegister))
+			return true;
+		this->stop("Machine Halted - invalid jump address", false);
 	}
 	else {
 		for (vector<instruction>::iterator it = instructions.begin(); it != instructions.end(); it++) {
@@ -447,8 +484,7 @@ bool ExecuteInstruction::J(instruction i)
 			}
 		}
 		//if we end up here, the address was not valid
-		cout << "Machine Halted - invalid jump address" << endl;
-		exit(0);
+		this->stop("Machine Halted - invalid jump address", false);
 	}
 	//we should never get here, but we need to return a default value
 	return false;
@@ -462,13 +498,11 @@ Parameters: i - current instruction
 bool ExecuteInstruction::JZ(instruction i)
 {
 	bool jump;
-	if (i.addressMode == Immediate) {
-		this->printRegisters();
-		cout << "Machine Halted, invalid address mode" << endl;
-		exit(0);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		this->stop("Machine Halted, invalid address mode", true);
 	}
 	//jump if the accumulator is a zero
-	if (AC == 0) {
+	if (jumpTaken(i.opCode, AC)) {
 		//call the jump function, and return what it returns. this will not return false,
 		//since if the address is not found we halt the machine
 		jump = this->J(i);
@@ -489,13 +523,11 @@ Parameters: i - current instruction
 bool ExecuteInstruction::JN(instruction i)
 {
 	bool jump;
-	if (i.addressMode == Immediate) {
-		this->printRegisters();
-		cout << "Machine Halted, invalid address mode" << endl;
-		exit(0);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		this->stop("Machine Halted, invalid address mode", true);
 	}
 	//jump if the accumulator is negative
-	if (AC < 0) {
+	if (jumpTaken(i.opCode, AC)) {
 		//call the jump function, and return what it returns. this will not return false,
 		//since if the address is not found we halt the machine
 		jump = this->J(i);
@@ -516,13 +548,11 @@ Parameters: i - current instruction
 bool ExecuteInstruction::JP(instruction i)
 {
 	bool jump;
-	if (i.addressMode == Immediate) {
-		this->printRegisters();
-		cout << "Machine Halted, invalid address mode" << endl;
-		exit(0);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		this->stop("Machine Halted, invalid address mode", true);
 	}
 	//jump if the accumulator is positive
-	if (AC > 0) {
+	if (jumpTaken(i.opCode, AC)) {
 		//call the jump function, and return what it returns. this will not return false,
 		//since if the address is not found we halt the machine
 		jump = this->J(i);
@@ -534,6 +564,77 @@ bool ExecuteInstruction::JP(instruction i)
 	}
 }
 
+/************************************************************************
+Function: blockOp
+Author: Jake Davidson
+Description: Executes a block instruction of the bulk memory extension on
+the X0 words at X1 (source) and X2 (destination), see BlockOps.h. Memory
+is used directly in the host kernels. With extended addressing a block
+may span several pages, so the source is first gathered page by page and
+the destination is written page by page.
+Parameters: i - current instruction
+************************************************************************/
+void ExecuteInstruction::blockOp(instruction i) {
+	unsigned int words = extended ? extended->words() : 4096; //words in memory
+	unsigned int length = X0, source = X1, destination = X2; //the blocks
+	bool reads = i.opCode != BFIL, writes = i.opCode != BSUM; //blocks used
+	vector<int> gathered; //source block, when it cannot be used in place
+	const int *from = nullptr; //source block
+	if (illegalAddressMode(i.opCode, i.addressMode))
+		this->stop("Machine Halted - illegal addressing mode", true);
+	if (X0 < 0)
+		this->stop("Machine Halted - negative block length", true);
+	if ((reads && (source >= words || length > words - source)) || (writes && (destination >= words || length > words - destination)))
+		this->stop("Machine Halted - block outside memory", true);
+#ifdef TRACK_MEMORY
+	for (unsigned int w = 0; w < length; w++) {
+		if (reads) {
+			TRACK_READ(source + w);
+		}
+		if (writes) {
+			TRACK_WRITE(destination + w);
+		}
+	}
+#endif
+
+	//the source can be used in place in memory, unless an XOR would overwrite it before it is read
+	if (!extended && (i.opCode != BXOR || source == destination || source + length <= destination || destination + length <= source))
+		from = memory + source;
+	else if (reads) {
+		gathered.resize(length);
+		for (unsigned int w = 0; w < length;) {
+			unsigned int n = min(length - w, PAGE_WORDS - (source + w) % PAGE_WORDS); //words left in the page
+			memcpy(gathered.data() + w, extended ? extended->span(source + w) : memory + source + w, n * sizeof(int));
+			w += n;
+		}
+		from = gathered.data();
+	}
+	if (i.opCode == BSUM) {
+		AC = (int)((unsigned int)AC + blockSum(from, length));
+		return;
+	}
+	if (!extended) {
+		if (i.opCode == BCPY)
+			blockCopy(memory + destination, from, length);
+		else if (i.opCode == BFIL)
+			blockFill(memory + destination, AC, length);
+		else
+			blockXor(memory + destination, from, length);
+		return;
+	}
+	for (unsigned int w = 0; w < length;) {
+		unsigned int n = min(length - w, PAGE_WORDS - (destination + w) % PAGE_WORDS); //words left in the page
+		int *to = &extended->write(destination + w); //destination in this page
+		if (i.opCode == BCPY)
+			blockCopy(to, from + w, n);
+		else if (i.opCode == BFIL)
+			blockFill(to, AC, n);
+		else
+			blockXor(to, from + w, n);
+		w += n;
+	}
+}
+
 /************************************************************************
 Function: printInstruction
 Author: Jake Davidson
@@ -543,18 +644,18 @@ Parameters: i - current instruction
 ************************************************************************/
 void ExecuteInstruction::printInstruction(instruction i) {
 	//print address of the instruction
-	cout << hex << setw(3) << setfill('0') << i.instructionAddress << ":  ";
+	*out << hex << setw(3) << setfill('0') << i.instructionAddress << ":  ";
 	//print instruction itself in hex
-	cout << i.instructionHexString << "   ";
+	*out << i.instructionHexString << "   ";
 	//print instruction mnemonic
-	cout << opCodesPrintMap[i.opCode] << "   ";
+	*out << opCodesPrintMap[i.opCode] << "   ";
 	//print EA used by this instruction (or IMM is Immediate addressing mode)
 	if (i.addressMode == Direct)
-		cout << hex << setw(3) << setfill('0') << i.EA << "    ";
+		*out << hex << setw(3) << setfill('0') << i.EA << "    ";
 	else if (i.addressMode == Immediate)
-		cout << "IMM    ";
+		*out << "IMM    ";
 	else if (i.addressMode == HALT)
-		cout << "   ";
+		*out << "   ";
 }
 
 /************************************************************************
@@ -565,7 +666,254 @@ Parameters: i - current instruction
 ************************************************************************/
 void ExecuteInstruction::printRegisters() {
 	//print formatted contents of the AC and the 4 X registers
-	cout << "AC[" << hex << setw(6) << setfill('0') << AC << "]   " << "X0[" << hex << setw(3) << setfill('0') << X0 << "]   " 
+	*out << "AC[" << hex << setw(6) << setfill('0') << AC << "]   " << "X0[" << hex << setw(3) << setfill('0') << X0 << "]   " 
 		<< "X1[" << hex << setw(3) << setfill('0') << X1 << "]   " <<"X2[" << hex << setw(3) << setfill('0') << X2 << "]   " 
 		<< "X3[" << hex << setw(3) << setfill('0') << X3 << "]" << endl;
 }
+
+/************************************************************************
+Function: stop
+Author: Jake Davidson
+Description: Halts the machine. Prints the halt message to the trace 
+(after the registers if requested) and throws machineHalt so the run 
+loop can stop, without ending the whole process.
+Parameters: message - halt message to print
+			registers - true to print the registers before the message
+************************************************************************/
+void ExecuteInstruction::stop(string message, bool registers) {
+	if (out) {
+		if (registers)
+			this->printRegisters();
+		*out << message << endl;
+	}
+	halted = true;
+	haltReason = message;
+	throw machineHalt{ message };
+}
+
+/************************************************************************
+Function: step
+Author: Jake Davidson
+Description: Executes the instruction the instruction register points to,
+printing its trace line. If there is a jump, the jump function sets 
+instructionRegister to the target, otherwise it is moved to the next 
+instruction in the list. Halting the machine, or failing to write the 
+trace, throws machineHalt.
+************************************************************************/
+void ExecuteInstruction::step() {
+	bool jump = false; //bool to keep track of whether or not we have jumped or not
+	instruction i = *instructionRegister;
+	vector<instruction>::iterator from = instructionRegister; //instruction executed, for the layout profile
+	//print current instructions and all related data
+	if (out)
+		this->printInstruction(i);
+	//an indirect EA is a word of memory, which a data image can set to anything
+	//(extended addressing wraps addresses to the address space instead)
+	if (!extended && (i.EA < 0 || i.EA >= 4096) && !illegalAddressMode(i.opCode, i.addressMode)
+		&& (readsMemory(i.opCode, i.addressMode) || writesMemory(i.opCode, i.addressMode)))
+		this->stop("Machine Halted - illegal address", true);
+	//simulated caches see the fetch and then the memory access, if there is one
+	CACHE_FETCH(i);
+	CACHE_DATA(i);
+	//a device word is read just before the instruction uses it
+	if (devices)
+		devices->beforeStep(i, memory);
+
+	//execute the instruction based on op code
+	switch (i.opCode)
+	{
+	case HALT:
+		this->halt();
+		break;
+	case NOP:
+		//do nothing
+		break;
+	case opCodes::LD:
+		this->LD(i);
+		break;
+	case opCodes::ST:
+		this->ST(i);
+		break;
+	case opCodes::EM:
+		this->EM(i);
+		break;
+	case opCodes::LDX:
+		this->LDX(i);
+		break;
+	case opCodes::STX:
+		this->STX(i);
+		break;
+	case opCodes::EMX:
+		this->EMX(i);
+		break;
+	case opCodes::ADD:
+		this->ADD(i);
+		break;
+	case opCodes::SUB:
+		this->SUB(i);
+		break;
+	case opCodes::CLR:
+		this->CLR();
+		break;
+	case opCodes::COM:
+		this->COM();
+		break;
+	case opCodes::AND:
+		this->AND(i);
+		break;
+	case opCodes::OR:
+		this->OR(i);
+		break;
+	case opCodes::XOR:
+		this->XOR(i);
+		break;
+	case opCodes::ADDX:
+		this->ADDX(i);
+		break;
+	case opCodes::SUBX:
+		this->SUBX(i);
+		break;
+	case opCodes::CLRX:
+		this->CLRX(i);
+		break;
+	case opCodes::J:
+		jump = this->J(i);
+		break;
+	case opCodes::JZ:
+		jump = this->JZ(i);
+		break;
+	case opCodes::JN:
+		jump = this->JN(i);
+		break;
+	case opCodes::JP:
+		jump = this->JP(i);
+		break;
+	case BCPY:
+	case BFIL:
+	case BSUM:
+	case BXOR:
+		this->blockOp(i);
+		break;
+	default:
+		this->stop("Machine Halted - undefined opcode", true);
+		break;
+	}
+	if (devices)
+		devices->afterStep(i, memory);
+	//print contents of registers after instruction is executed
+	//if the trace cannot be written (or differs from an expected trace) there is no point going on
+	if (out) {
+		this->printRegisters();
+		if (!*out)
+			this->stop("Machine Halted - trace output failed", false);
+	}
+	if (metrics)
+		recordMetrics(metrics, i, jump);
+	if (pipeline)
+		pipeline->record(i, jump, X0);
+
+	//if we do not jump, we need to point instructionRegister to the 
+	//next instruction in the list
+	if (!jump) {
+		//while the program is still being loaded, the next instruction may not be decoded yet
+		if (loader && !loader->finished()) {
+			if (!loader->waitForNext(instructionRegister, instructionRegister))
+				this->stop("Machine Halted - no more instructions to execute", false);
+		}
+		//a reordered program links each instruction to the next in file order
+		else if (layout) {
+			if (!layout->next(instructionRegister, instructionRegister))
+				this->stop("Machine Halted - no more instructions to execute", false);
+		}
+		//with lazy decoding the next instruction is decoded when it is first reached
+		else if (lazy) {
+			if (!lazy->next(instructionRegister, instructionRegister))
+				this->stop("Machine Halted - no more instructions to execute", false);
+		}
+		//if we are not at the end of the list
+		else if (instructionRegister + 1 != instructions.end()) {
+			instructionRegister++;
+		}
+		//we have executed the last instruction and there was no jump
+		//end the program
+		else {
+			this->stop("Machine Halted - no more instructions to execute", false);
+		}
+	}
+	if (layout && layout->isProfiling())
+		layout->record(from, instructionRegister);
+}
+
+/************************************************************************
+Function: run
+Author: Jake Davidson
+Description: Executes instructions until the machine halts or maxSteps
+instructions have been executed.
+Parameters: maxSteps - most instructions to execute, UNLIMITED_STEPS for no limit
+Returns: number of instructions executed
+************************************************************************/
+unsigned long long ExecuteInstruction::run(unsigned long long maxSteps) {
+	unsigned long long steps = 0; //instructions executed so far
+	try {
+		while (!halted && steps != maxSteps) {
+			//a snapshot was requested with SIGUSR1, take it between instructions
+			if (snapshotRequested) {
+				snapshotRequested = 0;
+				this->writeSnapshot(nextSnapshotFile());
+			}
+			steps++;
+			//dependencies are known from the decoded instruction, so it is scheduled before it executes
+			if (analyzer)
+				analyzer->record(*instructionRegister);
+			//measure the dispatch with the host counters if it is sampled
+			if (counters && counters->dispatch(*instructionRegister, steps)) {
+				this->step();
+				counters->end();
+			}
+			else
+				this->step();
+		}
+	}
+	catch (machineHalt &) {
+		//halted flag and reason were set by stop
+	}
+	return steps;
+}
+
+/************************************************************************
+Function: writeSnapshot
+Author: Jake Davidson
+Description: Writes the registers, the address in the instruction register
+and the whole of memory to a file, 8 words per line. With extended
+addressing only the pages that have been written are included.
+Parameters: file - name of the file to write
+************************************************************************/
+void ExecuteInstruction::writeSnapshot(string file) {
+	ofstream fout(file); //stream to write the snapshot to
+	ostream *trace = out; //trace stream, restored after printing the registers
+	if (!fout)
+		return;
+	out = &fout;
+	this->printRegisters();
+	out = trace;
+	fout << "IR[" << hex << setw(3) << setfill('0') << instructionRegister->instructionAddress << "]" << endl;
+	for (int address = 0; address < 4096; address++) {
+		if (address % 8 == 0)
+			fout << hex << setw(3) << setfill('0') << address << ":";
+		fout << " " << hex << setw(6) << setfill('0') << memory[address];
+		if (address % 8 == 7)
+			fout << endl;
+	}
+	//with extended addressing, the pages that have been written follow
+	for (unsigned int page = 1; extended && page < extended->pageCount(); page++) {
+		if (!extended->allocated(page))
+			continue;
+		for (unsigned int address = page * PAGE_WORDS; address < (page + 1) * PAGE_WORDS; address++) {
+			if (address % 8 == 0)
+				fout << hex << setw(3) << setfill('0') << address << ":";
+			fout << " " << hex << setw(6) << setfill('0') << extended->read(address);
+			if (address % 8 == 7)
+				fout << endl;
+		}
+	}
+}
@@ -1,17 +1,50 @@
 #ifndef INSTRUCTIONS_H
-#define INSTRUCTIIONS_H
+#define INSTRUCTIONS_H
 
 #include <string>
 #include <iostream>
 #include <iomanip>
 #include "globals.h"
 #include "const.h"
+#include "MemoryTracker.h"
+#include "CacheSimulator.h"
+#include "LiveMetrics.h"
+#include "Semantics.h"
+#include "Devices.h"
+#include "PipelinedLoader.h"
+#include "LazyLoader.h"
+#include "HostCounters.h"
+#include "SparseMemory.h"
+#include "DependencyAnalysis.h"
+#include "BlockOps.h"
+#include "MultiCore.h"
+#include "PipelineModel.h"
+#include "BlockLayout.h"
 
 using namespace std;
 
+//run without a step limit
+const unsigned long long UNLIMITED_STEPS = ~0ULL;
+
+//state of a single B17 machine. The machine started from the command line uses 
+//the globals in globals.h, other machines (such as sweep variants) each own one of these
+struct machineState {
+	int AC; //accumulator
+	int X0, X1, X2, X3; //index registers
+	int *memory; //main memory, 4096 words
+	vector<instruction> *instructions; //program being executed
+	vector<instruction>::iterator instructionRegister; //current instruction
+};
+
+//thrown when the machine halts, carries the reason printed in the halt message
+struct machineHalt {
+	string reason;
+};
 
 class ExecuteInstruction {
 public:
+	ExecuteInstruction(ostream *out = &cout); //execute on the global machine, tracing to out (nullptr for no trace)
+	ExecuteInstruction(machineState &m, ostream *out); //execute on m, tracing to out (nullptr for no trace)
 	//public functions, one per opcode
 	void halt(); //halts execution
 	void LD(instruction i); //load
@@ -34,8 +67,63 @@ public:
 	bool JZ(instruction i);//jump if ac is 0
 	bool JN(instruction i); //jump if ac is negative
 	bool JP(instruction i); //jump if ac is positive
+	void blockOp(instruction i); //block instruction of the bulk memory extension
 	void printInstruction(instruction i); //print details of instruction for trace
 	void printRegisters(); //print contents of AC and 4 index registers
+	void step(); //execute the instruction in the instruction register and advance it
+	unsigned long long run(unsigned long long maxSteps); //step until halted or maxSteps executed, returns steps executed
+	bool isHalted() { return halted; } //true once the machine has halted
+	string getHaltReason() { return haltReason; } //reason the machine halted
+	void setMetrics(liveMetrics *m) { metrics = m; } //publish live metrics to m, nullptr to stop
+	void setDevices(DeviceBus *d) { devices = d; } //route device addresses to d, nullptr for plain memory
+	void setLoader(PipelinedLoader *l) { loader = l; } //program still being loaded by l, nullptr if loaded
+	void setLazyLoader(LazyLoader *l) { lazy = l; } //decode instructions with l as they are fetched, nullptr if decoded
+	void setHostCounters(HostCounters *c) { counters = c; } //charge host counters to dispatches, nullptr to stop
+	void setDependencyAnalyzer(DependencyAnalyzer *a) { analyzer = a; } //schedule executed instructions in a, nullptr to stop
+	void setShared(bool s) { shared = s; } //true if other cores use memory at the same time
+	void setPipelineModel(PipelineModel *p) { pipeline = p; } //time executed instructions on p, nullptr to stop
+	void setBlockLayout(BlockLayout *l) { layout = l; } //follow the links and address table of l, nullptr for file order
+	void writeSnapshot(string file); //write the registers and memory to file
+private:
+	void stop(string message, bool registers); //print halt message (and registers) and halt the machine
+	//value of the word at address, through the page table with extended addressing
+	int load(int address) { return extended ? extended->read(address) : shared ? sharedLoad(&memory[address]) : memory[address]; }
+	//write value to the word at address
+	void store(int address, int value) {
+		if (extended)
+			extended->write(address) = value;
+		else if (shared)
+			sharedStore(&memory[address], value);
+		else
+			memory[address] = value;
+	}
+	//write value to the word at address, returning the value it replaces, atomically when memory is shared
+	int exchange(int address, int value) {
+		if (shared && !extended)
+			return sharedExchange(&memory[address], value);
+		int old = this->load(address); //value replaced
+		this->store(address, value);
+		return old;
+	}
+	//state of the machine being executed
+	int &AC;
+	int &X0, &X1, &X2, &X3;
+	int *memory;
+	SparseMemory *extended; //whole address space with extended addressing, nullptr for memory alone
+	vector<instruction> &instructions;
+	vector<instruction>::iterator &instructionRegister;
+	ostream *out; //stream to write the trace to, nullptr if not tracing
+	liveMetrics *metrics; //live metrics segment, nullptr if not publishing
+	DeviceBus *devices; //memory-mapped devices, nullptr if there are none
+	PipelinedLoader *loader; //loader still decoding the program, nullptr if it is loaded
+	LazyLoader *lazy; //loader decoding instructions as they are fetched, nullptr if they are decoded
+	HostCounters *counters; //host counters measuring dispatches, nullptr if not measuring
+	DependencyAnalyzer *analyzer; //dependency analysis of executed instructions, nullptr if not analysing
+	BlockLayout *layout; //layout of a reordered program, nullptr if it is in file order
+	PipelineModel *pipeline; //pipeline model timing executed instructions, nullptr if not modelling
+	bool shared; //true if memory is shared with other cores running at the same time
+	bool halted; //true once the machine has halted
+	string haltReason; //halt message of the machine
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,575 @@
+#include "GdbStub.h"
+#include "Semantics.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+//hex digits for encoding replies
+static const char HEX_DIGITS[] = "0123456789abcdef";
+//query reading the target description, before its offset,length
+static const char TARGET_XML_READ[] = "Xfer:features:read:target.xml:";
+//target description served through qXfer, naming the registers in g packet order, PC typed as a code pointer
+static const string TARGET_XML = "<?xml version=\"1.0\"?>"
+	"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+	"<target version=\"1.0\">"
+	"<feature name=\"org.b17.core\">"
+	"<reg name=\"AC\" bitsize=\"32\" type=\"int32\" regnum=\"0\"/>"
+	"<reg name=\"X0\" bitsize=\"32\" type=\"int32\"/>"
+	"<reg name=\"X1\" bitsize=\"32\" type=\"int32\"/>"
+	"<reg name=\"X2\" bitsize=\"32\" type=\"int32\"/>"
+	"<reg name=\"X3\" bitsize=\"32\" type=\"int32\"/>"
+	"<reg name=\"PC\" bitsize=\"32\" type=\"code_ptr\"/>"
+	"</feature>"
+	"</target>";
+
+/************************************************************************
+Function: toHex
+Author: Jake Davidson
+Description: Encodes a 32-bit value as 8 hex digits, least significant 
+byte first, the order GDB uses for register and memory contents.
+Parameters: value - value to encode
+			bytes - number of bytes to encode (1 to 4)
+Returns: the hex digits
+************************************************************************/
+static string toHex(unsigned int value, int bytes) {
+	string s = ""; //encoded value
+	for (int b = 0; b < bytes; b++) {
+		s += HEX_DIGITS[(value >> (8 * b + 4)) & 0xf];
+		s += HEX_DIGITS[(value >> (8 * b)) & 0xf];
+	}
+	return s;
+}
+
+/************************************************************************
+Function: parseHex
+Author: Jake Davidson
+Description: Reads a hex number, most significant digit first, as in
+addresses and register numbers. Packets come from outside, so a bad
+number is reported rather than thrown.
+Parameters: s - hex digits
+			value - set to the number read
+Returns: false if s is empty, has a character that is not a hex digit
+or does not fit in 32 bits
+************************************************************************/
+static bool parseHex(string s, unsigned int &value) {
+	value = 0;
+	if (s.empty() || s.size() > 8)
+		return false;
+	for (char c : s) {
+		const char *digit = strchr(HEX_DIGITS, tolower((unsigned char)c)); //position of the digit
+		if (c == 0 || !digit)
+			return false;
+		value = value * 16 + (unsigned int)(digit - HEX_DIGITS);
+	}
+	return true;
+}
+
+/************************************************************************
+Function: fromHex
+Author: Jake Davidson
+Description: Decodes hex digits written least significant byte first.
+Parameters: s - hex digits, two per byte
+			value - set to the decoded value
+Returns: false if a byte is not two hex digits
+************************************************************************/
+static bool fromHex(string s, unsigned int &value) {
+	unsigned int byte; //current byte
+	value = 0;
+	for (size_t b = 0; b + 1 < s.size() && b < 8; b += 2) {
+		if (!parseHex(s.substr(b, 2), byte))
+			return false;
+		value |= byte << (4 * b);
+	}
+	return true;
+}
+
+/************************************************************************
+Function: GdbStub
+Author: Jake Davidson
+Description: Constructs a stub for the global machine. Nothing runs until
+a debugger connects and resumes it.
+************************************************************************/
+GdbStub::GdbStub() : connection(-1), acknowledge(true), ins(nullptr), watching(false), detached(false) {
+}
+
+/************************************************************************
+Function: ~GdbStub
+Author: Jake Davidson
+Description: Closes the connection to the debugger.
+************************************************************************/
+GdbStub::~GdbStub() {
+#ifndef _WIN32
+	if (connection >= 0)
+		close(connection);
+#endif
+}
+
+/************************************************************************
+Function: listen
+Author: Jake Davidson
+Description: Waits for one debugger to connect. A target made only of 
+digits is a TCP port on the loopback address, anything else is the path 
+of a Unix domain socket to create.
+Parameters: where - port number or socket path
+Returns: true once a debugger is connected
+************************************************************************/
+bool GdbStub::listen(string where) {
+#ifndef _WIN32
+	int server; //listening socket
+	bool tcp = !where.empty() && where.size() <= 5 && where.find_first_not_of("0123456789") == string::npos;
+	if (tcp) {
+		struct sockaddr_in address = {};
+		int reuse = 1;
+		server = socket(AF_INET, SOCK_STREAM, 0);
+		if (server < 0)
+			return false;
+		setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		address.sin_family = AF_INET;
+		if (stoi(where) > 65535) {
+			close(server);
+			return false;
+		}
+		address.sin_port = htons((unsigned short)stoi(where));
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (::bind(server, (struct sockaddr *)&address, sizeof(address)) != 0) {
+			close(server);
+			return false;
+		}
+	}
+	else {
+		struct sockaddr_un address = {};
+		server = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (server < 0 || where.size() >= sizeof(address.sun_path))
+			return false;
+		address.sun_family = AF_UNIX;
+		strcpy(address.sun_path, where.c_str());
+		unlink(where.c_str());
+		if (::bind(server, (struct sockaddr *)&address, sizeof(address)) != 0) {
+			close(server);
+			return false;
+		}
+	}
+	cout << "Waiting for debugger on " << (tcp ? "localhost:" : "") << where << endl;
+	if (::listen(server, 1) != 0) {
+		close(server);
+		return false;
+	}
+	connection = accept(server, nullptr, nullptr);
+	close(server);
+	if (!tcp)
+		unlink(where.c_str());
+	if (connection >= 0 && tcp) {
+		int noDelay = 1;
+		setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+	}
+	return connection >= 0;
+#else
+	cout << "The GDB stub needs POSIX sockets" << endl;
+	return false;
+#endif
+}
+
+/************************************************************************
+Function: readPacket
+Author: Jake Davidson
+Description: Reads the next $packet#checksum from the debugger, skipping 
+acknowledgements and stray interrupts, and acknowledges it.
+Parameters: packet - set to the packet data
+Returns: false if the debugger disconnected
+************************************************************************/
+bool GdbStub::readPacket(string &packet) {
+#ifndef _WIN32
+	char c; //current character
+	char checksum[2]; //checksum characters, not verified since the stream is reliable
+	packet.clear();
+	do {
+		if (recv(connection, &c, 1, 0) != 1)
+			return false;
+	} while (c != '$');
+	while (true) {
+		if (recv(connection, &c, 1, 0) != 1)
+			return false;
+		if (c == '#')
+			break;
+		packet += c;
+	}
+	if (recv(connection, checksum, 2, MSG_WAITALL) != 2)
+		return false;
+	if (acknowledge && send(connection, "+", 1, 0) != 1)
+		return false;
+	return true;
+#else
+	return false;
+#endif
+}
+
+/************************************************************************
+Function: sendPacket
+Author: Jake Davidson
+Description: Sends data as a $data#checksum packet, then waits for the 
+acknowledgement unless acknowledgements are off.
+Parameters: data - packet data
+************************************************************************/
+void GdbStub::sendPacket(string data) {
+#ifndef _WIN32
+	unsigned char sum = 0; //checksum of the data
+	char c; //acknowledgement
+	for (char d : data)
+		sum += (unsigned char)d;
+	string packet = "$" + data + "#" + HEX_DIGITS[sum >> 4] + HEX_DIGITS[sum & 0xf];
+	send(connection, packet.data(), packet.size(), 0);
+	if (acknowledge)
+		recv(connection, &c, 1, 0);
+#endif
+}
+
+/************************************************************************
+Function: interrupted
+Author: Jake Davidson
+Description: Checks, without waiting, whether the debugger has sent 
+Ctrl-C (0x03), consuming it if so.
+Returns: true if the debugger asked the machine to stop
+************************************************************************/
+bool GdbStub::interrupted() {
+#ifndef _WIN32
+	struct pollfd p = { connection, POLLIN, 0 };
+	char c; //waiting character
+	if (poll(&p, 1, 0) > 0 && recv(connection, &c, 1, MSG_PEEK) == 1 && c == 0x03) {
+		recv(connection, &c, 1, 0);
+		return true;
+	}
+#endif
+	return false;
+}
+
+/************************************************************************
+Function: stopReply
+Author: Jake Davidson
+Description: Builds a T stop reply, which includes the PC so the debugger
+does not have to ask for it.
+Parameters: signal - signal number (5 trap, 2 interrupt)
+			reason - extra stop reason fields, such as "swbreak:;"
+Returns: the reply
+************************************************************************/
+string GdbStub::stopReply(int signal, string reason) {
+	string reply = "T"; //stop reply being built
+	reply += HEX_DIGITS[(signal >> 4) & 0xf];
+	reply += HEX_DIGITS[signal & 0xf];
+	return reply + reason + "05:" + toHex(instructionRegister->instructionAddress * GDB_WORD_BYTES, 4) + ";";
+}
+
+/************************************************************************
+Function: readRegisters
+Author: Jake Davidson
+Description: Encodes AC, X0-X3 and PC for the g packet.
+Returns: the register contents
+************************************************************************/
+string GdbStub::readRegisters() {
+	return toHex(AC, 4) + toHex(X0, 4) + toHex(X1, 4) + toHex(X2, 4) + toHex(X3, 4)
+		+ toHex(instructionRegister->instructionAddress * GDB_WORD_BYTES, 4);
+}
+
+/************************************************************************
+Function: writeRegister
+Author: Jake Davidson
+Description: Sets a register. Setting PC moves the instruction register to
+the instruction at that address, which must exist.
+Parameters: n - register number (0 AC, 1-4 X0-X3, 5 PC)
+			value - new value
+Returns: false if n is not a register or PC has no instruction
+************************************************************************/
+bool GdbStub::writeRegister(int n, unsigned int value) {
+	switch (n) {
+	case 0: AC = (int)value; return true;
+	case 1: X0 = (int)value; return true;
+	case 2: X1 = (int)value; return true;
+	case 3: X2 = (int)value; return true;
+	case 4: X3 = (int)value; return true;
+	case 5:
+		for (vector<instruction>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+			if (it->instructionAddress * GDB_WORD_BYTES == value) {
+				instructionRegister = it;
+				return true;
+			}
+		}
+		return false;
+	default:
+		return false;
+	}
+}
+
+/************************************************************************
+Function: readMemory
+Author: Jake Davidson
+Description: Encodes bytes of memory for the m packet.
+Parameters: address - first byte address
+			length - number of bytes
+Returns: the bytes in hex, or an error if they are outside of memory
+************************************************************************/
+string GdbStub::readMemory(unsigned int address, unsigned int length) {
+	string reply = ""; //bytes read
+	//64 bits, so address + length cannot wrap
+	for (unsigned long long b = address; b < (unsigned long long)address + length; b++) {
+		if (b / GDB_WORD_BYTES >= 4096)
+			return reply.empty() ? "E01" : reply;
+		reply += toHex((unsigned int)memory[b / GDB_WORD_BYTES] >> (8 * (b % GDB_WORD_BYTES)), 1);
+	}
+	return reply;
+}
+
+/************************************************************************
+Function: writeMemory
+Author: Jake Davidson
+Description: Writes bytes of memory for the M packet.
+Parameters: address - first byte address
+			length - number of bytes
+			hexData - the bytes, two hex digits each
+Returns: false if the bytes are outside of memory
+************************************************************************/
+bool GdbStub::writeMemory(unsigned int address, unsigned int length, string hexData) {
+	if (hexData.size() < 2 * (size_t)length || (unsigned long long)address + length > 4096ULL * GDB_WORD_BYTES)
+		return false;
+	for (unsigned int b = 0; b < length; b++) {
+		unsigned int word = (address + b) / GDB_WORD_BYTES; //word holding the byte
+		unsigned int shift = 8 * ((address + b) % GDB_WORD_BYTES); //position of the byte in the word
+		unsigned int value; //the byte
+		if (!parseHex(hexData.substr(2 * b, 2), value))
+			return false;
+		memory[word] = (int)(((unsigned int)memory[word] & ~(0xffu << shift)) | (value << shift));
+	}
+	return true;
+}
+
+/************************************************************************
+Function: resume
+Author: Jake Davidson
+Description: Runs the machine for one instruction, or until a breakpoint,
+watchpoint, Ctrl-C or halt when continuing. A breakpoint on the 
+instruction the machine is stopped at does not stop it again. Watchpoints
+are checked before each instruction from its decoded opcode and EA, and 
+reported after it has executed. Ctrl-C is only polled every 
+GDB_POLL_INTERVAL instructions, so continuing costs little more than 
+running without the debugger.
+Parameters: single - true to execute only one instruction
+Returns: the stop reply
+************************************************************************/
+string GdbStub::resume(bool single) {
+	int poll = 0; //instructions since the connection was last checked
+	bool first = true; //true for the instruction the machine was stopped at
+	string watch; //watchpoint kind hit by the current instruction
+	char address[16]; //byte address of the watched word, in hex
+	if (ins.isHalted())
+		return "W00";
+	while (true) {
+		instruction &i = *instructionRegister;
+		if (!first && i.instructionAddress < 4096 && breakpoints[i.instructionAddress])
+			return stopReply(5, "swbreak:;");
+		watch = "";
+		if (watching && i.EA >= 0 && i.EA < 4096 && !illegalAddressMode(i.opCode, i.addressMode)) {
+			bool reads = readsMemory(i.opCode, i.addressMode), writes = writesMemory(i.opCode, i.addressMode);
+			if (writeWatch[i.EA] && readWatch[i.EA] && (reads || writes))
+				watch = "awatch";
+			else if (writeWatch[i.EA] && writes)
+				watch = "watch";
+			else if (readWatch[i.EA] && reads)
+				watch = "rwatch";
+			snprintf(address, sizeof(address), "%x", (unsigned int)i.EA * GDB_WORD_BYTES);
+		}
+		try {
+			ins.step();
+		}
+		catch (machineHalt &halt) {
+			//tell the user why, the machine stays stopped at the halting instruction
+			string text = halt.reason + "\n", console = "O";
+			for (char c : text)
+				console += toHex((unsigned char)c, 1);
+			sendPacket(console);
+			return stopReply(5, "");
+		}
+		if (!watch.empty())
+			return stopReply(5, watch + ":" + address + ";");
+		if (single)
+			return stopReply(5, "");
+		if (++poll == GDB_POLL_INTERVAL) {
+			poll = 0;
+			if (interrupted())
+				return stopReply(2, "");
+		}
+		first = false;
+	}
+}
+
+/************************************************************************
+Function: readTargetDescription
+Author: Jake Davidson
+Description: Replies to qXfer:features:read:target.xml with the part of
+the target description asked for, so the debugger names the registers
+AC, X0-X3 and PC instead of applying its host's register layout.
+Parameters: range - offset,length in hex
+Returns: m and the part if more follows, l and the part if it is the
+last, E01 if the range is malformed
+************************************************************************/
+string GdbStub::readTargetDescription(string range) {
+	size_t comma = range.find(','); //end of the offset
+	unsigned int offset, length; //part of the description asked for
+	if (comma == string::npos || !parseHex(range.substr(0, comma), offset) || !parseHex(range.substr(comma + 1), length))
+		return "E01";
+	if (offset >= TARGET_XML.size())
+		return "l";
+	string part = TARGET_XML.substr(offset, length); //bytes sent, none need escaping
+	return (offset + part.size() < TARGET_XML.size() ? "m" : "l") + part;
+}
+
+/************************************************************************
+Function: handle
+Author: Jake Davidson
+Description: Replies to one packet. Step and continue packets run the 
+machine and reply with the stop reason. QStartNoAckMode replies itself, 
+before acknowledgements are turned off, and returns "\x01" so serve does
+not reply again.
+Parameters: packet - packet data
+			done - set to true once the debugger has detached or killed the machine
+Returns: the reply, empty for unsupported packets
+************************************************************************/
+string GdbStub::handle(string packet, bool &done) {
+	char kind = packet.empty() ? 0 : packet[0]; //packet type
+	string args = packet.empty() ? "" : packet.substr(1); //packet arguments
+	size_t comma = args.find(','), colon = args.find(':'), equals = args.find('=');
+	unsigned int n, address, length, value; //register number, address, length and value parsed from the arguments
+	done = false;
+	switch (kind) {
+	case '?':
+		return ins.isHalted() ? "W00" : stopReply(5, "");
+	case 'g':
+		return readRegisters();
+	case 'G':
+		for (n = 0; n < GDB_REGISTERS && (size_t)(n + 1) * 8 <= args.size(); n++) {
+			if (!fromHex(args.substr(n * 8, 8), value))
+				return "E01";
+			writeRegister(n, value);
+		}
+		return "OK";
+	case 'p':
+		//gdb probes for registers past the last one, which do not exist
+		if (!parseHex(args, n) || n >= GDB_REGISTERS)
+			return "E01";
+		return readRegisters().substr(n * 8, 8);
+	case 'P':
+		if (equals == string::npos || !parseHex(args.substr(0, equals), n) || !fromHex(args.substr(equals + 1), value))
+			return "E01";
+		return writeRegister((int)n, value) ? "OK" : "E01";
+	case 'm':
+		if (comma == string::npos || !parseHex(args.substr(0, comma), address) || !parseHex(args.substr(comma + 1), length))
+			return "E01";
+		return readMemory(address, length);
+	case 'M':
+		if (comma == string::npos || colon == string::npos || !parseHex(args.substr(0, comma), address)
+			|| !parseHex(args.substr(comma + 1, colon - comma - 1), length))
+			return "E01";
+		return writeMemory(address, length, args.substr(colon + 1)) ? "OK" : "E01";
+	case 's':
+	case 'c':
+		//an address to resume at is not supported, the machine resumes where it stopped
+		return this->resume(kind == 's');
+	case 'Z':
+	case 'z':
+		if (args.size() < 3 || comma == string::npos) {
+			return "E01";
+		}
+		else {
+			size_t second = args.find(',', comma + 1);
+			bool set = kind == 'Z';
+			if (!parseHex(args.substr(comma + 1, second - comma - 1), address) || address / GDB_WORD_BYTES >= 4096)
+				return "E01";
+			unsigned int word = address / GDB_WORD_BYTES; //word of the breakpoint or watchpoint
+			switch (args[0]) {
+			case '0':
+			case '1':
+				breakpoints[word] = set;
+				break;
+			case '2':
+				writeWatch[word] = set;
+				break;
+			case '3':
+				readWatch[word] = set;
+				break;
+			case '4':
+				readWatch[word] = set;
+				writeWatch[word] = set;
+				break;
+			default:
+				return "";
+			}
+			watching = readWatch.any() || writeWatch.any();
+			return "OK";
+		}
+	case 'H':
+		return "OK";
+	case 'T':
+		return "OK";
+	case 'D':
+		detached = true;
+		done = true;
+		return "OK";
+	case 'k':
+		done = true;
+		return "";
+	case 'q':
+		if (args.compare(0, 9, "Supported") == 0)
+			return "PacketSize=1000;QStartNoAckMode+;swbreak+;hwbreak+;qXfer:features:read+";
+		if (args.compare(0, strlen(TARGET_XML_READ), TARGET_XML_READ) == 0)
+			return this->readTargetDescription(args.substr(strlen(TARGET_XML_READ)));
+		if (args == "Attached")
+			return "1";
+		if (args == "C")
+			return "QC1";
+		if (args == "fThreadInfo")
+			return "m1";
+		if (args == "sThreadInfo")
+			return "l";
+		return "";
+	case 'Q':
+		if (args == "StartNoAckMode") {
+			sendPacket("OK");
+			acknowledge = false;
+			return "\x01";
+		}
+		return "";
+	default:
+		return "";
+	}
+}
+
+/************************************************************************
+Function: serve
+Author: Jake Davidson
+Description: Handles packets from the connected debugger. If the debugger
+detaches, the machine runs on to its halt without tracing and the final
+registers are printed.
+************************************************************************/
+void GdbStub::serve() {
+	string packet, reply; //current packet and its reply
+	bool done = false; //true once the debugger has detached or killed the machine
+	while (!done && this->readPacket(packet)) {
+		reply = this->handle(packet, done);
+		//QStartNoAckMode has already replied and k expects no reply
+		if (reply != "\x01" && packet != "k")
+			this->sendPacket(reply);
+	}
+	if (detached && !ins.isHalted()) {
+		ins.run(UNLIMITED_STEPS);
+		cout << ins.getHaltReason() << endl;
+		ExecuteInstruction(&cout).printRegisters();
+	}
+}
@@ -0,0 +1,55 @@
+//GDB remote serial protocol stub. With --gdb <port|socket path> the emulator
+//waits for a debugger to connect over TCP (localhost) or a Unix domain socket,
+//then runs the global machine under its control without tracing.
+//
+//Registers are AC, X0, X1, X2, X3 and PC, each 32 bits little endian (g/G/p/P),
+//named in a target description the debugger reads with qXfer:features:read.
+//Memory is presented as bytes: word w of memory is bytes 4w to 4w+3, little
+//endian, and PC is the byte address of the instruction register (4 times its
+//instruction address). Supported: m/M, s/c, Z0/Z1 breakpoints, Z2/Z3/Z4
+//watchpoints, Ctrl-C, D and k. When the machine halts the halt message is sent
+//as console output and later resume requests report the program as exited.
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include <string>
+#include <bitset>
+#include "ExecuteInstruction.h"
+
+using namespace std;
+
+//registers presented to the debugger: AC, X0-X3 and PC
+const unsigned int GDB_REGISTERS = 6;
+//bytes per memory word as seen by the debugger
+const int GDB_WORD_BYTES = 4;
+//instructions run between checks of the connection for Ctrl-C while continuing
+const int GDB_POLL_INTERVAL = 1 << 16;
+
+class GdbStub {
+public:
+	GdbStub();
+	~GdbStub();
+	bool listen(string where); //wait for a debugger on a TCP port or Unix socket path
+	void serve(); //handle packets until the debugger detaches or kills the machine
+private:
+	bool readPacket(string &packet); //read the next packet, acknowledging it
+	void sendPacket(string data); //send a packet and wait for its acknowledgement
+	string handle(string packet, bool &done); //reply to a packet, done is set by D and k
+	string resume(bool single); //step or continue, returns the stop reply
+	string stopReply(int signal, string reason); //build a T stop reply
+	string readRegisters(); //reply to g
+	string readTargetDescription(string range); //reply to qXfer:features:read:target.xml
+	bool writeRegister(int n, unsigned int value); //set register n, false if it cannot be set
+	string readMemory(unsigned int address, unsigned int length); //reply to m
+	bool writeMemory(unsigned int address, unsigned int length, string hexData); //handle M
+	bool interrupted(); //true if the debugger has sent Ctrl-C
+	int connection; //socket connected to the debugger
+	bool acknowledge; //false once the debugger turned off acknowledgements
+	ExecuteInstruction ins; //executor of the global machine, without trace
+	bitset<4096> breakpoints; //instruction addresses with a breakpoint
+	bitset<4096> readWatch, writeWatch; //memory words being watched
+	bool watching; //true if any watchpoint is set
+	bool detached; //true once the debugger has detached
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include "GoldenTrace.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+//text used in place of a line when one trace ends before the other
+const string END_OF_TRACE = "<end of trace>";
+
+/************************************************************************
+Function: GoldenTrace
+Author: Jake Davidson
+Description: Constructs a comparator with no golden trace open.
+************************************************************************/
+GoldenTrace::GoldenTrace() : golden(nullptr), piped(false), decompressor(-1), line(0), diverged(false) {
+}
+
+/************************************************************************
+Function: ~GoldenTrace
+Author: Jake Davidson
+Description: Closes the golden trace, waiting for the decompressor if it
+was read through one.
+************************************************************************/
+GoldenTrace::~GoldenTrace() {
+	if (!golden)
+		return;
+#ifdef _WIN32
+	if (piped) {
+		pclose(golden);
+		return;
+	}
+#endif
+	fclose(golden);
+#ifndef _WIN32
+	if (decompressor > 0)
+		waitpid(decompressor, nullptr, 0);
+#endif
+}
+
+/************************************************************************
+Function: startDecompressor
+Author: Jake Davidson
+Description: Starts a decompressor writing the file to a pipe. On POSIX
+systems it is started directly with the file as an argument, so no shell
+ever sees the file name; Windows file names cannot hold the quote that
+would end the quoted name.
+Parameters: program - decompressor, which takes -dc and the file
+			file - compressed golden trace
+Returns: the read end of the pipe, nullptr if it could not be started
+************************************************************************/
+FILE *GoldenTrace::startDecompressor(string program, string file) {
+#ifdef _WIN32
+	return popen((program + " -dc \"" + file + "\"").c_str(), "r");
+#else
+	int ends[2]; //read and write ends of the pipe
+	if (pipe(ends) != 0)
+		return nullptr;
+	decompressor = fork();
+	if (decompressor == 0) {
+		dup2(ends[1], STDOUT_FILENO);
+		close(ends[0]);
+		close(ends[1]);
+		execlp(program.c_str(), program.c_str(), "-dc", "--", file.c_str(), (char *)nullptr);
+		_exit(127);
+	}
+	close(ends[1]);
+	if (decompressor < 0) {
+		close(ends[0]);
+		return nullptr;
+	}
+	return fdopen(ends[0], "r");
+#endif
+}
+
+/************************************************************************
+Function: open
+Author: Jake Davidson
+Description: Opens the golden trace. Compressed files are read through 
+the matching decompressor, so they are streamed rather than unpacked.
+Parameters: file - name of the golden trace
+Returns: true if the golden trace was opened
+************************************************************************/
+bool GoldenTrace::open(string file) {
+	string command = ""; //decompressor to read a compressed golden trace through
+	size_t dot = file.rfind('.'); //start of the file extension
+	string extension = (dot == string::npos) ? "" : file.substr(dot);
+	if (extension == ".gz")
+		command = "gzip";
+	else if (extension == ".xz")
+		command = "xz";
+	else if (extension == ".zst")
+		command = "zstd";
+
+	if (command.empty()) {
+		golden = fopen(file.c_str(), "r");
+		piped = false;
+	}
+	else {
+		//make sure the file exists, the decompressor would only report it on stderr
+		FILE *check = fopen(file.c_str(), "rb");
+		if (!check)
+			return false;
+		fclose(check);
+		golden = this->startDecompressor(command, file);
+		piped = true;
+	}
+	return golden != nullptr;
+}
+
+/************************************************************************
+Function: readGolden
+Author: Jake Davidson
+Description: Reads the next line of the golden trace, without the line 
+ending.
+Parameters: s - set to the line read
+Returns: true if a line was read, false at the end of the golden trace
+************************************************************************/
+bool GoldenTrace::readGolden(string &s) {
+	char chunk[256]; //part of the line read by fgets
+	size_t length; //length of chunk
+	bool read = false; //true once any characters have been read
+	s.clear();
+	while (golden && fgets(chunk, sizeof(chunk), golden)) {
+		read = true;
+		length = strlen(chunk);
+		if (length > 0 && chunk[length - 1] == '\n') {
+			chunk[--length] = '\0';
+			if (length > 0 && chunk[length - 1] == '\r')
+				chunk[--length] = '\0';
+			s.append(chunk, length);
+			return true;
+		}
+		s.append(chunk, length);
+	}
+	return read;
+}
+
+/************************************************************************
+Function: compareLine
+Author: Jake Davidson
+Description: Compares the completed trace line with the next golden line.
+On a difference both lines are kept for the report.
+************************************************************************/
+void GoldenTrace::compareLine() {
+	line++;
+	if (!readGolden(expected))
+		expected = END_OF_TRACE;
+	if (expected != actual)
+		diverged = true;
+	else
+		actual.clear();
+}
+
+/************************************************************************
+Function: overflow
+Author: Jake Davidson
+Description: Adds a character written to the trace to the current line,
+comparing the line when it is completed.
+Parameters: c - character written
+Returns: c, or EOF once the trace has diverged so the stream fails
+************************************************************************/
+int GoldenTrace::overflow(int c) {
+	if (diverged)
+		return traits_type::eof();
+	if (c == '\n')
+		this->compareLine();
+	else if (c != traits_type::eof())
+		actual.push_back((char)c);
+	return diverged ? traits_type::eof() : c;
+}
+
+/************************************************************************
+Function: xsputn
+Author: Jake Davidson
+Description: Adds a string written to the trace to the current line.
+Parameters: s - characters written
+			n - number of characters
+Returns: number of characters accepted
+************************************************************************/
+streamsize GoldenTrace::xsputn(const char *s, streamsize n) {
+	for (streamsize i = 0; i < n; i++) {
+		if (this->overflow((unsigned char)s[i]) == traits_type::eof())
+			return i;
+	}
+	return n;
+}
+
+/************************************************************************
+Function: finish
+Author: Jake Davidson
+Description: Checks the end of the run against the golden trace. Any 
+partial trace line is compared, then the golden trace must have no lines
+left.
+Returns: true if the trace matched the golden trace
+************************************************************************/
+bool GoldenTrace::finish() {
+	if (!diverged && !actual.empty())
+		this->compareLine();
+	if (!diverged && readGolden(expected)) {
+		line++;
+		actual = END_OF_TRACE;
+		diverged = true;
+	}
+	return !diverged;
+}
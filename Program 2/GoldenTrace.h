@@ -0,0 +1,42 @@
+//Streaming comparison of the trace against a golden trace. The trace is
+//written into a GoldenTrace stream buffer, which compares every completed line
+//with the next line of the golden file and fails the stream at the first
+//difference, so the full trace is never stored or written out.
+//Golden files ending in .gz, .xz or .zst are decompressed through a pipe.
+#ifndef GOLDENTRACE_H
+#define GOLDENTRACE_H
+
+#include <cstdio>
+#include <cstring>
+#include <streambuf>
+#include <string>
+
+using namespace std;
+
+class GoldenTrace : public streambuf {
+public:
+	GoldenTrace();
+	~GoldenTrace();
+	bool open(string file); //start reading the golden trace, false if it could not be opened
+	bool finish(); //call after the run, checks the golden trace has no lines left. Returns true if the traces matched
+	bool hasDiverged() { return diverged; } //true once a line has differed
+	unsigned long long getLine() { return line; } //number of the line that differed (or lines compared)
+	string getExpected() { return expected; } //golden line at the difference
+	string getActual() { return actual; } //trace line at the difference
+protected:
+	int overflow(int c); //add a character to the current line
+	streamsize xsputn(const char *s, streamsize n); //add characters to the current line
+private:
+	bool readGolden(string &s); //read the next golden line, false at the end of the file
+	void compareLine(); //compare the completed trace line with the next golden line
+	FILE *startDecompressor(string program, string file); //read file through program, nullptr if it cannot be started
+	FILE *golden; //golden trace being read
+	bool piped; //true if golden is a decompressor pipe
+	int decompressor; //process id of the decompressor on POSIX systems, -1 if none
+	string actual; //trace line being built
+	string expected; //golden line the trace line is compared with
+	unsigned long long line; //number of trace lines completed
+	bool diverged; //true once a line has differed
+};
+
+#endif
@@ -0,0 +1,259 @@
+#include "HostCounters.h"
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+#include "ExecuteInstruction.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+//reads of the counters used to measure the cost of reading them
+const int CALIBRATION_READS = 256;
+
+//names of the events and addressing modes in the tables
+static const char *EVENT_NAMES[HOST_EVENTS] = { "cycles", "instructions", "branch-misses", "L1D-misses" };
+static const char *MODE_NAMES[Illegal + 1] = { "Direct", "Immediate", "Indexed", "Indirect", "Idx-Ind", "Illegal" };
+
+/************************************************************************
+Function: HostCounters
+Author: Jake Davidson
+Description: Constructs an empty set of counters, call open before use.
+Parameters: interval - dispatches between measurements, at least 1
+************************************************************************/
+HostCounters::HostCounters(unsigned long long interval)
+	: interval(interval), opened(0), useClock(false), opCode(HALT), addressMode(Direct)
+{
+	for (int e = 0; e < HOST_EVENTS; e++) {
+		fds[e] = -1;
+		position[e] = -1;
+		start[e] = overhead[e] = 0;
+	}
+	memset(byOpcode, 0, sizeof(byOpcode));
+	memset(byMode, 0, sizeof(byMode));
+}
+
+/************************************************************************
+Function: ~HostCounters
+Author: Jake Davidson
+Description: Closes the counters.
+************************************************************************/
+HostCounters::~HostCounters() {
+#ifdef __linux__
+	for (int e = 0; e < HOST_EVENTS; e++) {
+		if (fds[e] >= 0)
+			close(fds[e]);
+	}
+#endif
+}
+
+/************************************************************************
+Function: open
+Author: Jake Davidson
+Description: Opens the counters as one group led by cycles, so a single
+read returns them all at the same moment. Events the host cannot count
+are left out of the group. If cycles cannot be counted the clock is used
+instead. Then measures the events counted by reading the counters twice
+in a row, which is taken off every measurement.
+************************************************************************/
+void HostCounters::open() {
+#ifdef __linux__
+	//type and config of each event
+	const unsigned int types[HOST_EVENTS] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE };
+	const unsigned long long configs[HOST_EVENTS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) };
+	for (int e = 0; e < HOST_EVENTS; e++) {
+		struct perf_event_attr attr; //description of the event
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = types[e];
+		attr.config = configs[e];
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.disabled = e == HostCycles;
+		fds[e] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, e == HostCycles ? -1 : fds[HostCycles], 0);
+		if (fds[e] < 0) {
+			if (e == HostCycles) {
+				reason = string("perf_event_open: ") + strerror(errno);
+				break;
+			}
+			continue;
+		}
+		position[e] = opened++;
+	}
+	if (fds[HostCycles] >= 0)
+		ioctl(fds[HostCycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+	reason = "perf_event_open is only available on Linux";
+#endif
+	useClock = fds[HostCycles] < 0;
+	epoch = chrono::steady_clock::now();
+
+	//a group the host never schedules opens, but does not count
+	if (!useClock) {
+		double before[HOST_EVENTS], after[HOST_EVENTS]; //values around some work
+		this->read(before);
+		for (volatile int n = 0; n < 100000; n++);
+		this->read(after);
+		if (after[HostCycles] == before[HostCycles]) {
+			reason = "the cycle counter does not count";
+			useClock = true;
+		}
+	}
+
+	//the cheapest pair of reads is the cost of measuring nothing
+	for (int n = 0; n < CALIBRATION_READS; n++) {
+		double before[HOST_EVENTS], after[HOST_EVENTS]; //values around nothing
+		this->read(before);
+		this->read(after);
+		for (int e = 0; e < HOST_EVENTS; e++) {
+			if (n == 0 || after[e] - before[e] < overhead[e])
+				overhead[e] = after[e] - before[e];
+		}
+	}
+}
+
+/************************************************************************
+Function: read
+Author: Jake Davidson
+Description: Reads the counters with one group read. When the clock is
+used instead, the nanoseconds since open are given as cycles and the
+other events are 0.
+Parameters: values - set to the value of each event
+************************************************************************/
+void HostCounters::read(double values[HOST_EVENTS]) {
+	for (int e = 0; e < HOST_EVENTS; e++)
+		values[e] = 0;
+#ifdef __linux__
+	if (!useClock) {
+		unsigned long long group[1 + HOST_EVENTS]; //count of values, then the values
+		if (::read(fds[HostCycles], group, sizeof(group)) > 0) {
+			for (int e = 0; e < HOST_EVENTS; e++) {
+				if (position[e] >= 0 && position[e] < (int)group[0])
+					values[e] = (double)group[1 + position[e]];
+			}
+		}
+		return;
+	}
+#endif
+	values[HostCycles] = (double)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+}
+
+/************************************************************************
+Function: end
+Author: Jake Davidson
+Description: Reads the counters after a measured dispatch and charges
+what it counted, less the cost of reading, to its opcode and addressing
+mode.
+************************************************************************/
+void HostCounters::end() {
+	double now[HOST_EVENTS]; //values after the dispatch
+	this->read(now);
+	byOpcode[opCode].samples++;
+	byMode[addressMode].samples++;
+	for (int e = 0; e < HOST_EVENTS; e++) {
+		double counted = now[e] - start[e] - overhead[e]; //events of the dispatch
+		if (counted < 0)
+			counted = 0;
+		byOpcode[opCode].events[e] += counted;
+		byMode[addressMode].events[e] += counted;
+	}
+}
+
+/************************************************************************
+Function: printRows
+Author: Jake Davidson
+Description: Prints one table, a row for each opcode or addressing mode
+that was dispatched. Events per dispatch are averages over the measured
+dispatches, the share of cycles scales them up to every dispatch.
+Parameters: out - stream to print to
+			heading - name of the first column
+			totals - totals of each row
+			count - number of rows
+			modes - true if the rows are addressing modes, false for opcodes
+************************************************************************/
+void HostCounters::printRows(ostream &out, string heading, hostTotals *totals, int count, bool modes) {
+	double allCycles = 0; //estimated cycles of every dispatch
+	for (int n = 0; n < count; n++) {
+		if (totals[n].samples > 0)
+			allCycles += totals[n].events[HostCycles] / totals[n].samples * totals[n].dispatches;
+	}
+	out << setfill(' ') << left << setw(10) << heading << right << setw(12) << "dispatches" << setw(10) << "samples"
+		<< setw(12) << (useClock ? "ns/disp" : "cycles/disp") << setw(12) << "instr/disp" << setw(8) << "IPC"
+		<< setw(14) << "brmiss/disp" << setw(14) << "L1Dmiss/disp" << setw(9) << "share" << endl;
+	for (int n = 0; n < count; n++) {
+		hostTotals &t = totals[n];
+		string name = modes ? MODE_NAMES[n] : (n == UNDEFINED ? "???" : opCodesPrintMap[(opCodes)n]); //name of the row
+		if (t.dispatches == 0)
+			continue;
+		out << left << setw(10) << name << right << dec << setw(12) << t.dispatches << setw(10) << t.samples << fixed << setprecision(2);
+		if (t.samples == 0) {
+			out << endl;
+			continue;
+		}
+		out << setw(12) << t.events[HostCycles] / t.samples;
+		for (int e = HostInstructions; e < HOST_EVENTS; e++) {
+			out << setw(e == HostInstructions ? 12 : 14);
+			if (useClock || position[e] < 0)
+				out << "n/a";
+			else
+				out << t.events[e] / t.samples;
+			//IPC follows instructions
+			if (e == HostInstructions) {
+				if (useClock || position[e] < 0 || t.events[HostCycles] <= 0)
+					out << setw(8) << "n/a";
+				else
+					out << setw(8) << t.events[e] / t.events[HostCycles];
+			}
+		}
+		out << setw(8) << (allCycles > 0 ? 100.0 * t.events[HostCycles] / t.samples * t.dispatches / allCycles : 0.0) << "%" << endl;
+	}
+	out << defaultfloat;
+}
+
+/************************************************************************
+Function: printTable
+Author: Jake Davidson
+Description: Prints the events counted and the tables by opcode and by
+addressing mode.
+Parameters: out - stream to print to
+************************************************************************/
+void HostCounters::printTable(ostream &out) {
+	if (useClock)
+		out << "Host counters not available (" << reason << "), timing dispatches with the clock instead" << endl;
+	else {
+		out << "Host counters (user mode):";
+		for (int e = 0; e < HOST_EVENTS; e++)
+			out << " " << EVENT_NAMES[e] << (position[e] < 0 ? " (n/a)" : "");
+		out << endl;
+	}
+	out << "Every " << dec << interval << (interval == 1 ? " dispatch" : " dispatches") << " measured, less the cost of reading the counters" << endl << endl;
+	this->printRows(out, "opcode", byOpcode, UNDEFINED + 1, false);
+	out << endl;
+	this->printRows(out, "mode", byMode, Illegal + 1, true);
+}
+
+/************************************************************************
+Function: runWithHostCounters
+Author: Jake Davidson
+Description: Runs the loaded program without a trace, measuring every
+interval-th dispatch with the host counters, then prints how the machine
+halted and the attribution tables.
+Parameters: maxSteps - most instructions to execute, UNLIMITED_STEPS for no limit
+			interval - dispatches between measurements
+************************************************************************/
+void runWithHostCounters(unsigned long long maxSteps, unsigned long long interval) {
+	HostCounters counters(interval); //counters charged by the machine
+	ExecuteInstruction ins(nullptr); //machine, without a trace
+	unsigned long long steps; //instructions executed
+	counters.open();
+	ins.setHostCounters(&counters);
+	steps = ins.run(maxSteps);
+	cout << (ins.isHalted() ? ins.getHaltReason() : "Machine Halted - step limit reached") << " after " << dec << steps << " steps" << endl;
+	ExecuteInstruction(&cout).printRegisters();
+	counters.printTable(cout);
+}
@@ -0,0 +1,87 @@
+//Host hardware counter attribution. With --host-counters <n> the program runs
+//without a trace while every n-th dispatch is measured with the host CPU's
+//performance counters (Linux perf_event_open): cycles, instructions, branch
+//misses and L1D read misses, counted in user mode only. Each measurement is
+//charged to the opcode and addressing mode dispatched, after subtracting the
+//cost of reading the counters, which is measured when they are opened. At the
+//end a table gives, per opcode and per addressing mode, the dispatches, host
+//cycles and instructions per dispatch, IPC and misses per dispatch, and the
+//estimated share of all host cycles.
+//
+//The counters are read around a dispatch rather than sampled by interrupt, so
+//the figures are per dispatch and need no symbol information. Counters the
+//host does not have (common in virtual machines) are shown as n/a. If the
+//cycle counter cannot be opened at all, or on systems without perf_event_open,
+//dispatches are timed with the steady clock instead and the table gives
+//nanoseconds per dispatch.
+#ifndef HOSTCOUNTERS_H
+#define HOSTCOUNTERS_H
+
+#include <string>
+#include <chrono>
+#include <iostream>
+#include "const.h"
+
+using namespace std;
+
+//dispatches between measurements when no interval is given
+const unsigned long long DEFAULT_COUNTER_INTERVAL = 16;
+
+//host events counted, cycles first since it leads the group
+enum hostEvent {
+	HostCycles,
+	HostInstructions,
+	HostBranchMisses,
+	HostL1DMisses,
+	HOST_EVENTS
+};
+
+//what has been charged to one opcode or addressing mode
+struct hostTotals {
+	unsigned long long dispatches; //times dispatched
+	unsigned long long samples; //dispatches measured
+	double events[HOST_EVENTS]; //events counted over the measured dispatches
+};
+
+class HostCounters {
+public:
+	HostCounters(unsigned long long interval);
+	~HostCounters();
+	void open(); //open the counters, falling back to the clock if they are not available
+	//count a dispatch of i, true if it is measured, in which case call end after executing it
+	bool dispatch(const instruction &i, unsigned long long step) {
+		byOpcode[i.opCode].dispatches++;
+		byMode[i.addressMode].dispatches++;
+		if (step % interval != 0)
+			return false;
+		opCode = i.opCode;
+		addressMode = i.addressMode;
+		this->read(start);
+		return true;
+	}
+	void end(); //charge the events since dispatch to its opcode and addressing mode
+	void printTable(ostream &out); //print the attribution tables
+	void read(double values[HOST_EVENTS]); //read every counter (or the clock)
+	bool usesClock() { return useClock; } //true if cycles are nanoseconds from the clock
+	bool counts(hostEvent e) { return useClock ? e == HostCycles : position[e] >= 0; } //true if e is counted
+private:
+	void printRows(ostream &out, string heading, hostTotals *totals, int count, bool modes); //print one table
+	unsigned long long interval; //dispatches between measurements
+	int fds[HOST_EVENTS]; //counter file descriptors, -1 if not open
+	int position[HOST_EVENTS]; //position of each counter in a group read, -1 if not available
+	int opened; //counters in the group
+	bool useClock; //true if the counters are not available
+	string reason; //why the clock is used
+	double start[HOST_EVENTS]; //values when the measured dispatch started
+	double overhead[HOST_EVENTS]; //events counted by reading the counters twice
+	opCodes opCode; //opcode being measured
+	addrModes addressMode; //addressing mode being measured
+	chrono::steady_clock::time_point epoch; //start of the clock used instead of the counters
+	hostTotals byOpcode[UNDEFINED + 1]; //totals for each opcode
+	hostTotals byMode[Illegal + 1]; //totals for each addressing mode
+};
+
+//runs the loaded program without a trace, measuring every interval-th dispatch, then prints the tables
+void runWithHostCounters(unsigned long long maxSteps, unsigned long long interval);
+
+#endif
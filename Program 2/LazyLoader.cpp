@@ -0,0 +1,172 @@
+#include "LazyLoader.h"
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include "globals.h"
+#include "Loader.h"
+#include "MappedFile.h"
+#include "SparseMemory.h"
+
+/************************************************************************
+Function: LazyLoader
+Author: Jake Davidson
+Description: Constructs a loader, call start to load a program.
+************************************************************************/
+LazyLoader::LazyLoader() {
+	memset(index, 0, sizeof(index));
+}
+
+/************************************************************************
+Function: start
+Author: Jake Davidson
+Description: Reads every word of the object file without decoding it,
+reserves room for all of their instructions, then decodes the instruction
+at the start address into the instruction register. A word that is not
+lower case hex, or whose operand is outside memory, halts like
+readInstructions, as does a file with no instructions or none at the
+start address.
+Parameters: file - the object file to load
+Returns: false if the file could not be opened
+************************************************************************/
+bool LazyLoader::start(string file) {
+	MappedFile object; //the object file, only needed while its words are read
+	vector<string> fields; //fields of the current line
+	unsigned int address, startAddress = 0; //address of the current word, address execution starts at
+	bool haveStart = false; //true once the start address line has been read
+	int num; //number of words on the current line
+	if (!object.open(file))
+		return false;
+	const char *data = object.data();
+
+	for (const char *line = data; line < data + object.size();) {
+		const char *newline = (const char *)memchr(line, '\n', data + object.size() - line);
+		const char *lineEnd = newline ? newline : data + object.size();
+		fields = splitString(string(line, lineEnd - line));
+		line = lineEnd + 1;
+		//the last line only contains the start address
+		if (fields.size() == 1) {
+			startAddress = stol(fields[0], nullptr, 16);
+			haveStart = true;
+			continue;
+		}
+		num = stoi(fields.at(1));
+		address = stol(fields[0], nullptr, 16);
+		for (int i = 0; i < num; i++, address++) {
+			const string &hex = fields.at(i + 2); //the word as written
+			lazyWord w; //the word, recorded without decoding it
+			unsigned long long value = 0; //value of the word so far
+			for (char c : hex) {
+				if (c >= '0' && c <= '9')
+					value = value << 4 | (c - '0');
+				else if (c >= 'a' && c <= 'f')
+					value = value << 4 | (c - 'a' + 10);
+				else {
+					cout << "You have an incorrect character in your hex string" << endl;
+					exit(0);
+				}
+				//the operand is every bit above 11, so a wider word has an operand outside memory
+				if (value >> 12 >= memoryWords())
+					break;
+			}
+			if (address >= memoryWords() || value >> 12 >= memoryWords() || hex.size() > 0xff) {
+				cout << "Instruction " << hex << " at " << std::hex << address << " has an address outside memory, "
+					<< "see --address-bits" << endl;
+				exit(0);
+			}
+			w.address = address;
+			w.value = (unsigned int)value;
+			w.digits = (unsigned int)hex.size();
+			w.decoded = -1;
+			words.push_back(w);
+		}
+	}
+	if (words.empty() || !haveStart) {
+		cout << "Machine Halted - No instructions to execute";
+		exit(0);
+	}
+
+	//decode with memory and the index registers as they are before execution
+	image.assign(memory, memory + 4096);
+	index[0] = X0;
+	index[1] = X1;
+	index[2] = X2;
+	index[3] = X3;
+	instructions.clear();
+	instructions.reserve(words.size());
+
+	if (!this->find(startAddress, instructionRegister)) {
+		cout << "Machine Halted - no instruction at start address" << endl;
+		exit(0);
+	}
+	return true;
+}
+
+/************************************************************************
+Function: decode
+Author: Jake Davidson
+Description: Finds the instruction of a word, decoding it and appending
+it to the instructions vector the first time. The vector was reserved for
+every word, so appending never moves an instruction.
+Parameters: w - index of the word
+Returns: the instruction
+************************************************************************/
+vector<instruction>::iterator LazyLoader::decode(size_t w) {
+	lazyWord &word = words[w];
+	if (word.decoded < 0) {
+		char hex[0x100 + 1]; //the word written as it was in the object file
+		snprintf(hex, sizeof(hex), "%0*x", (int)word.digits, (unsigned int)word.value);
+		instructions.push_back(decodeInstruction(hex, word.address, image.data(), index));
+		word.decoded = (int)instructions.size() - 1;
+		wordOf.push_back((unsigned int)w);
+	}
+	return instructions.begin() + word.decoded;
+}
+
+/************************************************************************
+Function: next
+Author: Jake Davidson
+Description: Finds the instruction after another in the object file,
+decoding it if it has not been fetched before.
+Parameters: it - current instruction
+			next - set to the next instruction
+Returns: false if it is the last instruction
+************************************************************************/
+bool LazyLoader::next(vector<instruction>::iterator it, vector<instruction>::iterator &next) {
+	size_t w = wordOf[it - instructions.begin()] + 1; //word after the current one
+	if (w >= words.size())
+		return false;
+	next = this->decode(w);
+	return true;
+}
+
+/************************************************************************
+Function: find
+Author: Jake Davidson
+Description: Finds the first word with an address, like a jump does, and
+decodes its instruction if it has not been fetched before.
+Parameters: address - address to find
+			target - set to the instruction found
+Returns: false if no word has the address
+************************************************************************/
+bool LazyLoader::find(unsigned int address, vector<instruction>::iterator &target) {
+	for (size_t w = 0; w < words.size(); w++) {
+		if (words[w].address == address) {
+			target = this->decode(w);
+			return true;
+		}
+	}
+	return false;
+}
+
+/************************************************************************
+Function: printSummary
+Author: Jake Davidson
+Description: Prints how many words were loaded and how many of them were
+decoded because the machine fetched them.
+Parameters: out - stream to print to
+************************************************************************/
+void LazyLoader::printSummary(ostream &out) {
+	out << dec << "Lazy decoding: " << words.size() << " words loaded, " << instructions.size() << " decoded ("
+		<< fixed << setprecision(2) << 100.0 * instructions.size() / words.size() << "%)" << defaultfloat << endl;
+}
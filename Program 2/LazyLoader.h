@@ -0,0 +1,51 @@
+//Lazy decoding. With --lazy-decode loading the object file only records each
+//word's value, digit count and address, 12 bytes a word, and an instruction is decoded the
+//first time the machine fetches it. Startup then costs a scan of the file
+//rather than decoding every word, and a large program of which little runs
+//only keeps decoded instructions for the code that actually executes.
+//
+//The instructions vector is reserved for every word of the file but filled in
+//the order instructions are first fetched, so it never moves and the pages of
+//the reservation that are never used are never touched. Each word remembers
+//where its instruction was placed, so falling through to the next word in the
+//file or jumping back to an instruction decodes nothing again. A jump finds
+//the first word with its target address like J does, searching the words
+//rather than the instructions. As with --stream, indirect and indexed EAs are
+//decoded from a copy of memory and the index registers taken before the machine
+//starts, so the program behaves exactly as if it had been decoded first.
+#ifndef LAZYLOADER_H
+#define LAZYLOADER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include "const.h"
+
+using namespace std;
+
+//an object file word that may not be decoded yet
+struct lazyWord {
+	unsigned int address; //address of the word
+	unsigned int value : 24; //value of the word
+	unsigned int digits : 8; //hex digits the word was written with, to print it the same way
+	int decoded; //index of its instruction in the instructions vector, -1 until decoded
+};
+
+class LazyLoader {
+public:
+	LazyLoader();
+	bool start(string file); //read the words of file and decode the start instruction, false if it cannot be read
+	//decodes the instruction after it in the file, false if it is the last
+	bool next(vector<instruction>::iterator it, vector<instruction>::iterator &next);
+	//decodes the first instruction with address, false if the program has none
+	bool find(unsigned int address, vector<instruction>::iterator &target);
+	void printSummary(ostream &out); //print the words loaded and decoded
+private:
+	vector<instruction>::iterator decode(size_t w); //instruction of word w, decoding it if needed
+	vector<lazyWord> words; //every word of the object file, in order
+	vector<unsigned int> wordOf; //word each decoded instruction came from
+	vector<int> image; //memory before execution, for indirect EAs
+	int index[4]; //index registers before execution, for indexed EAs
+};
+
+#endif
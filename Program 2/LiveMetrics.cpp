@@ -0,0 +1,134 @@
+#include "LiveMetrics.h"
+#include <chrono>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+volatile sig_atomic_t snapshotRequested = 0;
+
+//name of this process's metrics segment
+static string metricsName;
+
+/************************************************************************
+Function: nowNanoseconds
+Author: Jake Davidson
+Description: Reads the steady clock.
+Returns: current steady clock time in nanoseconds
+************************************************************************/
+static long long nowNanoseconds() {
+	return (long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/************************************************************************
+Function: openMetrics
+Author: Jake Davidson
+Description: Creates the shared memory segment /b17-<pid> and sets up the
+counters in it.
+Returns: the counters, or nullptr if the segment could not be created
+************************************************************************/
+liveMetrics *openMetrics() {
+#ifndef _WIN32
+	metricsName = "/b17-" + to_string(getpid());
+	int fd = shm_open(metricsName.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0)
+		return nullptr;
+	if (ftruncate(fd, sizeof(liveMetrics)) != 0) {
+		close(fd);
+		shm_unlink(metricsName.c_str());
+		return nullptr;
+	}
+	void *p = mmap(nullptr, sizeof(liveMetrics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		shm_unlink(metricsName.c_str());
+		return nullptr;
+	}
+	//the new segment is zero filled, which is a valid state for every counter
+	liveMetrics *metrics = (liveMetrics *)p;
+	metrics->pid = getpid();
+	metrics->version = METRICS_VERSION;
+	metrics->rateStart.store(nowNanoseconds(), memory_order_relaxed);
+	metrics->running.store(1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	metrics->magic = METRICS_MAGIC;
+	return metrics;
+#else
+	return nullptr;
+#endif
+}
+
+/************************************************************************
+Function: closeMetrics
+Author: Jake Davidson
+Description: Marks the machine as halted and removes the segment name.
+Readers that already have the segment open can still read the final 
+counters.
+Parameters: metrics - segment returned by openMetrics
+************************************************************************/
+void closeMetrics(liveMetrics *metrics) {
+#ifndef _WIN32
+	if (!metrics)
+		return;
+	metrics->running.store(0, memory_order_relaxed);
+	shm_unlink(metricsName.c_str());
+	munmap(metrics, sizeof(liveMetrics));
+#endif
+}
+
+/************************************************************************
+Function: updateRate
+Author: Jake Davidson
+Description: Recalculates instructions per second from the time taken by
+the last METRICS_RATE_INTERVAL instructions.
+Parameters: metrics - segment to update
+************************************************************************/
+void updateRate(liveMetrics *metrics) {
+	long long now = nowNanoseconds();
+	long long elapsed = now - metrics->rateStart.load(memory_order_relaxed);
+	if (elapsed > 0)
+		metrics->instructionsPerSecond.store(METRICS_RATE_INTERVAL * 1000000000ULL / elapsed, memory_order_relaxed);
+	metrics->rateStart.store(now, memory_order_relaxed);
+}
+
+/************************************************************************
+Function: requestSnapshot
+Author: Jake Davidson
+Description: SIGUSR1 handler. Only sets a flag, the run loop writes the 
+snapshot between instructions so it is consistent.
+Parameters: signal - signal number
+************************************************************************/
+static void requestSnapshot(int signal) {
+	(void)signal;
+	snapshotRequested = 1;
+}
+
+/************************************************************************
+Function: installSnapshotHandler
+Author: Jake Davidson
+Description: Installs the SIGUSR1 handler that requests a snapshot.
+************************************************************************/
+void installSnapshotHandler() {
+#ifndef _WIN32
+	signal(SIGUSR1, requestSnapshot);
+#endif
+}
+
+/************************************************************************
+Function: nextSnapshotFile
+Author: Jake Davidson
+Description: Names snapshot files b17-<pid>-snapshot-<n>.txt, counting up
+from 1 for each snapshot written by this process.
+Returns: name of the next snapshot file
+************************************************************************/
+string nextSnapshotFile() {
+	static int count = 0; //snapshots written so far
+	int pid = 0; //process id, part of the name
+#ifndef _WIN32
+	pid = getpid();
+#endif
+	return "b17-" + to_string(pid) + "-snapshot-" + to_string(++count) + ".txt";
+}
@@ -0,0 +1,75 @@
+//Live metrics. With --metrics the emulator publishes counters in a shared
+//memory segment named /b17-<pid>, updated from the dispatch loop with relaxed
+//atomic stores so readers never pause the emulator. The b17-top tool
+//(b17-top.cpp) reads and displays the segment.
+//Sending SIGUSR1 to the emulator writes a snapshot of the registers and memory
+//of the running machine to b17-<pid>-snapshot-<n>.txt.
+#ifndef LIVEMETRICS_H
+#define LIVEMETRICS_H
+
+#include <atomic>
+#include <csignal>
+#include <string>
+#include "const.h"
+
+using namespace std;
+
+//identifies a metrics segment, and the layout version of liveMetrics
+const unsigned int METRICS_MAGIC = 0xb17b17;
+const unsigned int METRICS_VERSION = 2;
+//instructions per second is recalculated every time this many instructions retire
+const unsigned long long METRICS_RATE_INTERVAL = 1 << 16;
+
+//layout of the shared memory segment, only the emulator writes to it
+struct liveMetrics {
+	unsigned int magic; //METRICS_MAGIC once the segment is set up
+	unsigned int version; //METRICS_VERSION
+	int pid; //process id of the emulator
+	atomic<int> running; //1 while the machine is running, 0 once it has halted
+	atomic<unsigned long long> retired; //instructions executed
+	atomic<unsigned long long> takenJumps; //jumps taken
+	atomic<unsigned long long> instructionsPerSecond; //rate over the last interval
+	atomic<unsigned int> currentAddress; //address of the instruction in the instruction register
+	atomic<unsigned long long> opcodeCounts[UNDEFINED + 1]; //instructions executed per opcode
+	atomic<long long> rateStart; //steady clock time in nanoseconds of the start of the interval
+};
+
+//set by the SIGUSR1 handler, the run loop writes a snapshot when it sees it
+extern volatile sig_atomic_t snapshotRequested;
+
+//creates the shared memory segment, returns nullptr if it could not be created
+liveMetrics *openMetrics();
+//marks the machine as halted and removes the segment name
+void closeMetrics(liveMetrics *metrics);
+//installs the SIGUSR1 handler
+void installSnapshotHandler();
+//returns the name of the next snapshot file
+string nextSnapshotFile();
+//recalculates instructions per second, called every METRICS_RATE_INTERVAL instructions
+void updateRate(liveMetrics *metrics);
+
+//adds one to a counter only this process writes, without a locked read-modify-write
+inline void bump(atomic<unsigned long long> &counter) {
+	counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/************************************************************************
+Function: recordMetrics
+Author: Jake Davidson
+Description: Publishes one executed instruction. Inline since it runs 
+once per instruction.
+Parameters: metrics - segment to publish to
+			i - instruction executed
+			jump - true if the instruction jumped
+************************************************************************/
+inline void recordMetrics(liveMetrics *metrics, const instruction &i, bool jump) {
+	bump(metrics->retired);
+	bump(metrics->opcodeCounts[i.opCode]);
+	metrics->currentAddress.store(i.instructionAddress, memory_order_relaxed);
+	if (jump)
+		bump(metrics->takenJumps);
+	if (metrics->retired.load(memory_order_relaxed) % METRICS_RATE_INTERVAL == 0)
+		updateRate(metrics);
+}
+
+#endif
@@ -0,0 +1,382 @@
+#include "Loader.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include "globals.h"
+#include "MemoryTracker.h"
+#include "Semantics.h"
+#include "SparseMemory.h"
+#include "BlockOps.h"
+
+/************************************************************************
+Function: readInstructions
+Author: Jake Davidson
+Description: Loops through each line of input object file and decodes
+each instruction. Inserts each instruction into instructions vector.
+Parameters: file - the object file to read from
+************************************************************************/
+void readInstructions(string file) {
+	ifstream fin; //stream to read file from
+	vector<string> instructionList; //list of hex instructions on the current line
+	string currentLine, //current line being read in
+		instructionString; //current instruction being decoded
+	instruction currentInstruction; //instruction to build as we decode instructionString
+	int num; //number of instructions on the current line
+	unsigned int startAddress; //address of the current instruction
+	int index[4] = { X0, X1, X2, X3 }; //index registers used by indexed EAs
+
+	//check that the file was opened successfully
+	fin.open(file);
+	if (!fin) {
+		cout << "Could not open object file, ensure the path is correct." << endl;
+		exit(0);
+	}
+
+	//read in the object file and add instructions to the list
+	while (getline(fin, currentLine)) {
+		instructionList = splitString(currentLine);
+		//if we are not at the last line (last line only contains start address)
+		if (instructionList.size() != 1) {
+			//get the number of instructions on this line
+			num = stoi(instructionList.at(1));
+			//get the start address of the first instruction of the line
+			startAddress = stol(instructionList[0], nullptr, 16);
+			//loop through instructions on the current line adding them to the program
+			for (int i = 0; i < num; i++) {
+				//build current instruction (offset by 2 because of first two items not being instructions)
+				instructionString = instructionList.at(i + 2);
+				//decode it with the registers and memory as they are before execution
+				currentInstruction = decodeInstruction(instructionString, startAddress, memory, index);
+				//addresses must fit the address space, which is wider with --address-bits
+				if (startAddress >= memoryWords() || currentInstruction.operandAddress >= memoryWords()) {
+					cout << "Instruction " << instructionString << " at " << hex << startAddress << " has an address outside memory, "
+						<< "see --address-bits" << endl;
+					exit(0);
+				}
+				//add to instruction vector
+				instructions.push_back(currentInstruction);
+				//increment the starting address for next loop
+				startAddress = startAddress + 1;
+			}
+		}
+		//we are at the last line, which contains the location to start execution
+		else {
+			if (!instructions.empty()) {
+				startAddress = stol(instructionList[0], nullptr, 16);
+				//look through instructions to find the one with startAddress
+				for (vector<instruction>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+					//when we find the start address in the instructions vector, set our instruction register to its location
+					if (it->instructionAddress == startAddress) {
+						instructionRegister = it;
+						break;
+					}
+					//if there was no instruction location at the end of the file to start at
+					if (it == instructions.end()) {
+						cout << "Machine Halted - no instruction at start address" << endl;
+						exit(0);
+					}
+				}
+
+			}
+			else {
+				//no instructions read in
+				cout << "Machine Halted - No instructions to execute";
+				exit(0);
+			}
+		}
+	}
+}
+
+/************************************************************************
+Function: decodeInstruction
+Author: Jake Davidson
+Description: Decodes one instruction from its hex string and calculates
+its EA. Indexed and indirect EAs are calculated now, from the index 
+registers and memory given, not when the instruction executes.
+Parameters: hex - hex string of the instruction
+			address - address of the instruction
+			image - memory to read indirect addresses from
+			index - index registers X0-X3
+Returns: currentInstruction - the decoded instruction
+************************************************************************/
+instruction decodeInstruction(string hex, unsigned int address, const int *image, const int index[4]) {
+	instruction currentInstruction; //instruction to build as we decode hex
+	string instructionString; //instruction as a string of bits
+
+	//store the hex value of the instruction to print in trace line
+	currentInstruction.instructionHexString = hex;
+	//convert the string to binary to extract bits to decode instruction
+	instructionString = convertToBin(hex);
+	//pad with 0s on left if too short
+	instructionString = pad(instructionString);
+	//read in current instruction
+	//get instruction address
+	currentInstruction.instructionAddress = address;
+	//get the 2-bit index register number
+	currentInstruction.indexRegister = getIndexRegister(instructionString);
+	//get the addressing mode (bits 5-2)
+	currentInstruction.addressMode = getAddrMode(instructionString);
+	//get the opcode (bits 11-6)
+	currentInstruction.opCode = getOpCode(instructionString);
+	//get the operand address (bits 23-12, or wider with extended addressing)
+	currentInstruction.operandAddress = getOperandAddress(instructionString);
+
+	//calculate the EA of the instruction
+	currentInstruction.EA = effectiveAddress(currentInstruction, image, index);
+
+	return currentInstruction;
+}
+
+/************************************************************************
+Function: effectiveAddress
+Author: Jake Davidson
+Description: Calculates the EA of a decoded instruction. Indexed and 
+indirect EAs use the index registers and memory given, as they are 
+before execution.
+Parameters: i - instruction with its fields decoded
+			image - memory to read indirect addresses from
+			index - index registers X0-X3
+Returns: EA - the EA of the instruction
+************************************************************************/
+int effectiveAddress(const instruction &i, const int *image, const int index[4]) {
+	int EA = 0; //EA to return
+	if (i.addressMode == Direct) {
+		EA = i.operandAddress;
+	}
+	//technically there is no EA, but I set it to the immediate value to 
+	//not have to have another variable in the struct only used with IMM
+	else if (i.addressMode == Immediate) {
+		EA = i.operandAddress;
+	}
+	//for indexed mode, the ea is the memory location at operandAddress + register contents
+	else if (i.addressMode == Indexed) {
+		//get the index register to add to the operand address
+		switch (i.indexRegister)
+		{
+		case 0:
+			EA = i.operandAddress + index[0];
+		case 1:
+			EA = i.operandAddress + index[1];
+		case 2:
+			EA = i.operandAddress + index[2];
+		case 3:
+			EA = i.operandAddress + index[3];
+		default:
+			break;
+		}
+	}
+	//Indirect addressing mode
+	else {
+		//get EA from memory address
+		TRACK_READ(i.operandAddress);
+		//with extended addressing the global machine's memory is the low page of the page table
+		if (extendedMemory && image == memory)
+			EA = extendedMemory->read(i.operandAddress);
+		else
+			EA = image[i.operandAddress];
+	}
+
+	return EA;
+}
+
+/************************************************************************
+Function: getAddrMode
+Author: Jake Davidson
+Description: Extracts the addressing mode from a string of bits.
+It then matches those bits with an addressing mode enum, using the table
+shared with the compile time evaluator (Semantics.h). Bit patterns that 
+are not an addressing mode give Illegal, so it outputs an error during 
+execution.
+Paramaters: s - string of bits to extract from
+Returns: a - enum of the addressing mode extracted
+************************************************************************/
+addrModes getAddrMode(string s) {
+	addrModes a; //addressing mode to return
+	string addressMode; //holds extracted bits
+	//extract address mode from bitstring
+	addressMode = s.substr(s.size() - 6, 4);
+	//match address mode bits to address mode
+	a = ADDRESS_MODE_TABLE[stoi(addressMode, nullptr, 2)];
+	//return the address mode for the instruction
+	return a;
+}
+
+/************************************************************************
+Function: getOpCode
+Author: Jake Davidson
+Description: Extracts the operation code from a string of bits. Then converts
+those bits into an enum of the op code for use later when executing instruction.
+Paramaters: s - string of bits to extract from
+Returns: op - enum of the operation code extracted
+************************************************************************/
+opCodes getOpCode(string s) {
+	opCodes op = UNDEFINED; //op code to return, with default value of Undefined
+	//strings to hold the category bits and the specifier bits
+	string category = "", specifier = "";
+	//extract category bits
+	category = s.substr(s.size() - 12, 2);
+	//extract specifier bits
+	specifier = s.substr(s.size() - 10, 4);
+	//match bitstrings to opcode
+	//there are 4 categories, and bits within those
+	//categories determine the operation code. The table is in Semantics.h,
+	//shared with the compile time evaluator. Unused specifiers are UNDEFINED,
+	//unless the bulk memory extension gives them a block instruction
+	op = (blockOpsEnabled ? BLOCK_OPCODE_TABLE : OPCODE_TABLE)[stoi(category, nullptr, 2)][stoi(specifier, nullptr, 2)];
+
+	return op;
+}
+
+/************************************************************************
+Function: getIndexRegister
+Author: Jake Davidson
+Description: Extracts the specified index register from the instruction.
+Returns 0-3, to specify the register
+Paramaters: s - string of bits to extract from
+Returns: indexRegister - register specified in the instruction
+************************************************************************/
+int getIndexRegister(string s) {
+	string registerString = ""; //holds extracted string
+	int indexRegister; //number register to return
+	registerString = s.substr(s.size() - 2, 2); //extract the bits
+	//match the bits to an index register
+	if (registerString == R_0)
+		indexRegister = 0;
+	else if (registerString == R_1)
+		indexRegister = 1;
+	else if (registerString == R_2)
+		indexRegister = 2;
+	else if (registerString == R_3)
+		indexRegister = 3;
+	else {
+		//for some reason, you got here. Should be impossible, as we check all
+		//possible 2 bit combinations
+		cout << "Invalid register number, something went horribly wrong." << endl;
+		exit(0);
+	}
+	return indexRegister;
+}
+
+/************************************************************************
+Function: getOperandAddress
+Author: Jake Davidson
+Description: Extracts the operand address from a string of bits. Returns
+the address as an unsigned integer. The address field is every bit above
+bit 11, so it is wider than 12 bits in an extended addressing instruction.
+Paramaters: s - string of bits to extract from
+Returns: address - address in the address field
+************************************************************************/
+unsigned int getOperandAddress(string s) {
+	string addressString = ""; //holds the string of extracted bits
+	unsigned int address = 0; //address to return
+	addressString = s.substr(0, s.size() - 12); //extract the bits
+	//convert to an int
+	address = stoul(addressString, nullptr, 2);
+	//return the address
+	return address;
+}
+
+/************************************************************************
+Function: convertToBin
+Author: Jake Davidson
+Description: Converts a string of hex to a string of binary. It does this
+by replacing each hex char with 4 binary bits.
+Paramaters: s - string to convert
+Returns: binString - string of converted binary
+************************************************************************/
+string convertToBin(string s) {
+	string binString = ""; //holds binary string
+	//for each character in the hex string, replace with corresponding
+	//binary value
+	for (char c : s) {
+		switch (c) {
+		case '0':
+			binString.append("0000");
+			break;
+		case '1':
+			binString.append("0001");
+			break;
+		case '2':
+			binString.append("0010");
+			break;
+		case '3':
+			binString.append("0011");
+			break;
+		case '4':
+			binString.append("0100");
+			break;
+		case '5':
+			binString.append("0101");
+			break;
+		case '6':
+			binString.append("0110");
+			break;
+		case '7':
+			binString.append("0111");
+			break;
+		case '8':
+			binString.append("1000");
+			break;
+		case '9':
+			binString.append("1001");
+			break;
+		case 'a':
+			binString.append("1010");
+			break;
+		case 'b':
+			binString.append("1011");
+			break;
+		case 'c':
+			binString.append("1100");
+			break;
+		case 'd':
+			binString.append("1101");
+			break;
+		case 'e':
+			binString.append("1110");
+			break;
+		case 'f':
+			binString.append("1111");
+			break;
+		default:
+			cout << "You have an incorrect character in your hex string" << endl;
+			break;
+		}
+	}
+	return binString;
+}
+
+/************************************************************************
+Function: splitString
+Author: Jake Davidson
+Description: Splits a string into parts based on whitespace (tokenizer).
+I actually wrote this function for a previous project, but I wrote it.
+Paramaters: s - string to split
+Returns: words - vector of words in string
+************************************************************************/
+vector<string> splitString(string s) {
+	stringstream stream; //stream to use
+	vector<string> words; //container for strings
+	string curr = ""; //current string
+	stream.str(s); //add s to our stream
+				   //read until end of stream, splitting on spaces
+	while (getline(stream, curr, ' ')) {
+		words.push_back(curr); //when we have our word, add it to the vector
+	}
+	return words;
+}
+/************************************************************************
+Function: pad
+Author: Jake Davidson
+Description: Pads a binary instruction so that it has the correct number
+of bits for extraction.
+Paramaters: s - string to pad
+Returns: padString - the padded string
+************************************************************************/
+string pad(string s) {
+	string padString = s;
+	//add 0 until string is correct length
+	while (padString.length() < 24)
+		padString = "0" + padString;
+	return padString;
+}
\ No newline at end of file
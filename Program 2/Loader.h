@@ -0,0 +1,24 @@
+//Object file loading. Reads the object file and decodes each instruction
+//into the instructions vector, setting the instruction register to the start
+//address.
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <string>
+#include <vector>
+#include "const.h"
+
+using namespace std;
+
+void readInstructions(string file);
+instruction decodeInstruction(string hex, unsigned int address, const int *image, const int index[4]);
+int effectiveAddress(const instruction &i, const int *image, const int index[4]);
+vector<string> splitString(string s);
+int getIndexRegister(string s);
+unsigned int getOperandAddress(string s);
+addrModes getAddrMode(string s);
+opCodes getOpCode(string s);
+string convertToBin(string s);
+string pad(string s);
+
+#endif
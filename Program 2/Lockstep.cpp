@@ -0,0 +1,505 @@
+#include "Lockstep.h"
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//words of memory per lane
+const int LANE_WORDS = 4096;
+
+//SIMD vector of lanes. A mask vector holds -1 in selected lanes and 0 elsewhere
+#if defined(__AVX512F__)
+typedef __m512i laneVector;
+const int VECTOR_LANES = 16;
+const char VECTOR_NAME[] = "AVX-512";
+static inline laneVector vload(const int *p) { return _mm512_load_si512((const void *)p); }
+static inline void vstore(int *p, laneVector v) { _mm512_store_si512((void *)p, v); }
+static inline laneVector vset(int x) { return _mm512_set1_epi32(x); }
+static inline laneVector vadd(laneVector a, laneVector b) { return _mm512_add_epi32(a, b); }
+static inline laneVector vsub(laneVector a, laneVector b) { return _mm512_sub_epi32(a, b); }
+static inline laneVector vand(laneVector a, laneVector b) { return _mm512_and_si512(a, b); }
+static inline laneVector vor(laneVector a, laneVector b) { return _mm512_or_si512(a, b); }
+static inline laneVector vxor(laneVector a, laneVector b) { return _mm512_xor_si512(a, b); }
+static inline laneVector vandnot(laneVector a, laneVector b) { return _mm512_ternarylogic_epi32(a, _mm512_setzero_si512(), b, 0xca); }
+static inline laneVector vselect(laneVector m, laneVector a, laneVector b) { return _mm512_ternarylogic_epi32(m, a, b, 0xca); }
+static inline laneVector vmask(__mmask16 k) { return _mm512_maskz_mov_epi32(k, _mm512_set1_epi32(-1)); }
+static inline laneVector vzero(laneVector a) { return vmask(_mm512_cmpeq_epi32_mask(a, _mm512_setzero_si512())); }
+static inline laneVector vnegative(laneVector a) { return vmask(_mm512_cmplt_epi32_mask(a, _mm512_setzero_si512())); }
+static inline laneVector vpositive(laneVector a) { return vmask(_mm512_cmpgt_epi32_mask(a, _mm512_setzero_si512())); }
+static inline bool vany(laneVector m) { return _mm512_test_epi32_mask(m, m) != 0; }
+#elif defined(__AVX2__)
+typedef __m256i laneVector;
+const int VECTOR_LANES = 8;
+const char VECTOR_NAME[] = "AVX2";
+static inline laneVector vload(const int *p) { return _mm256_load_si256((const __m256i *)p); }
+static inline void vstore(int *p, laneVector v) { _mm256_store_si256((__m256i *)p, v); }
+static inline laneVector vset(int x) { return _mm256_set1_epi32(x); }
+static inline laneVector vadd(laneVector a, laneVector b) { return _mm256_add_epi32(a, b); }
+static inline laneVector vsub(laneVector a, laneVector b) { return _mm256_sub_epi32(a, b); }
+static inline laneVector vand(laneVector a, laneVector b) { return _mm256_and_si256(a, b); }
+static inline laneVector vor(laneVector a, laneVector b) { return _mm256_or_si256(a, b); }
+static inline laneVector vxor(laneVector a, laneVector b) { return _mm256_xor_si256(a, b); }
+static inline laneVector vandnot(laneVector a, laneVector b) { return _mm256_andnot_si256(a, b); }
+static inline laneVector vselect(laneVector m, laneVector a, laneVector b) { return _mm256_blendv_epi8(b, a, m); }
+static inline laneVector vzero(laneVector a) { return _mm256_cmpeq_epi32(a, _mm256_setzero_si256()); }
+static inline laneVector vnegative(laneVector a) { return _mm256_cmpgt_epi32(_mm256_setzero_si256(), a); }
+static inline laneVector vpositive(laneVector a) { return _mm256_cmpgt_epi32(a, _mm256_setzero_si256()); }
+static inline bool vany(laneVector m) { return !_mm256_testz_si256(m, m); }
+#else
+typedef int laneVector;
+const int VECTOR_LANES = 1;
+const char VECTOR_NAME[] = "scalar";
+static inline laneVector vload(const int *p) { return *p; }
+static inline void vstore(int *p, laneVector v) { *p = v; }
+static inline laneVector vset(int x) { return x; }
+static inline laneVector vadd(laneVector a, laneVector b) { return (int)((unsigned int)a + (unsigned int)b); }
+static inline laneVector vsub(laneVector a, laneVector b) { return (int)((unsigned int)a - (unsigned int)b); }
+static inline laneVector vand(laneVector a, laneVector b) { return a & b; }
+static inline laneVector vor(laneVector a, laneVector b) { return a | b; }
+static inline laneVector vxor(laneVector a, laneVector b) { return a ^ b; }
+static inline laneVector vandnot(laneVector a, laneVector b) { return ~a & b; }
+static inline laneVector vselect(laneVector m, laneVector a, laneVector b) { return (m & a) | (~m & b); }
+static inline laneVector vzero(laneVector a) { return a == 0 ? -1 : 0; }
+static inline laneVector vnegative(laneVector a) { return a < 0 ? -1 : 0; }
+static inline laneVector vpositive(laneVector a) { return a > 0 ? -1 : 0; }
+static inline bool vany(laneVector m) { return m != 0; }
+#endif
+
+//an instruction prepared for lockstep execution
+struct lockstepInstruction {
+	opCodes opCode; //operation
+	int EA; //memory word or immediate value, the same in every lane
+	int indexRegister; //index register used by index register instructions
+	bool immediate; //true if the value used is EA rather than memory[EA]
+	bool memoryOperand; //true if the instruction reads or writes memory[EA]
+	bool vectorized; //false if lanes reaching the instruction go to the scalar interpreter
+	int next; //index of the next instruction in the program
+	int target; //index of the jump target, -1 if it is not in the program
+};
+
+//state of a group of lanes, every array is aligned for vector loads
+struct lockstepGroup {
+	vector<int> storage; //backing store of the arrays below
+	int *AC; //accumulator of each lane
+	int *X[4]; //index registers of each lane
+	int *memory; //memory, word w of lane l is memory[w * LOCKSTEP_LANES + l]
+	int *active; //-1 for lanes still running in lockstep
+	int *mask; //-1 for lanes executing the current instruction
+	int *taken; //-1 for lanes taking the current conditional jump
+	int pc[LOCKSTEP_LANES]; //instruction each lane is at, kept while the group is split
+	unsigned long long steps[LOCKSTEP_LANES]; //instructions executed by each lane
+	size_t variant[LOCKSTEP_LANES]; //variant run by each lane
+};
+
+//instruction counts of the whole sweep
+struct lockstepCounts {
+	atomic<unsigned long long> lockstep{ 0 }; //lane instructions executed in lockstep
+	atomic<unsigned long long> scalar{ 0 }; //instructions executed by the scalar interpreter
+	atomic<unsigned long long> splits{ 0 }; //times a group split at a conditional jump
+};
+
+/************************************************************************
+Function: prepareProgram
+Author: Jake Davidson
+Description: Prepares each decoded instruction for lockstep execution,
+resolving jump targets to program indexes and deciding which instructions
+are run by the scalar interpreter instead. Those are the instructions that
+halt the machine, that might (illegal addressing modes, undefined opcodes,
+missing jump targets, memory outside of the 4096 words), and the last
+instruction, after which the machine halts unless it jumps.
+Returns: the prepared program, in the order of the instructions vector
+************************************************************************/
+static vector<lockstepInstruction> prepareProgram() {
+	vector<lockstepInstruction> program(instructions.size()); //prepared instructions
+	for (size_t p = 0; p < instructions.size(); p++) {
+		instruction &i = instructions[p];
+		lockstepInstruction &d = program[p];
+		bool jump = i.opCode == J || i.opCode == JZ || i.opCode == JN || i.opCode == JP;
+		d.opCode = i.opCode;
+		d.EA = i.EA;
+		d.indexRegister = i.indexRegister & 3;
+		d.immediate = usesImmediate(i.opCode, i.addressMode);
+		d.memoryOperand = readsMemory(i.opCode, i.addressMode) || writesMemory(i.opCode, i.addressMode);
+		d.next = (int)p + 1;
+		d.target = -1;
+		for (size_t t = 0; jump && t < instructions.size(); t++) {
+			if ((int)instructions[t].instructionAddress == i.EA) {
+				d.target = (int)t;
+				break;
+			}
+		}
+		d.vectorized = i.opCode != HALT && i.opCode != UNDEFINED && !isBlockOp(i.opCode)
+			&& (i.addressMode == Direct || i.addressMode == Immediate || i.addressMode == Indexed || i.addressMode == Indirect)
+			&& !illegalAddressMode(i.opCode, i.addressMode)
+			&& (!d.memoryOperand || (i.EA >= 0 && i.EA < LANE_WORDS))
+			&& (!jump || d.target >= 0)
+			&& (i.opCode == J || d.next < (int)instructions.size());
+	}
+	return program;
+}
+
+/************************************************************************
+Function: executeLanes
+Author: Jake Davidson
+Description: Executes one instruction in every lane selected by the mask,
+a vector of lanes at a time. Lanes outside the mask are left unchanged.
+For a conditional jump the lanes taking it are stored in taken.
+Parameters: d - instruction to execute
+			g - group of lanes
+			anyTaken - set to true if a selected lane takes the jump
+			anyFallthrough - set to true if a selected lane does not take it
+************************************************************************/
+static void executeLanes(const lockstepInstruction &d, lockstepGroup &g, bool &anyTaken, bool &anyFallthrough) {
+	int *word = g.memory + (d.memoryOperand ? (size_t)d.EA * LOCKSTEP_LANES : 0); //memory[EA] of lane 0
+	int *x = g.X[d.indexRegister]; //index register used
+	laneVector immediate = vset(d.EA); //EA in every lane
+	laneVector taken, fallthrough; //lanes taking or not taking a conditional jump
+	laneVector anyT = vset(0), anyF = vset(0); //lanes taking or not taking over every vector
+	for (int c = 0; c < LOCKSTEP_LANES; c += VECTOR_LANES) {
+		laneVector m = vload(g.mask + c);
+		laneVector ac = vload(g.AC + c);
+		laneVector value = d.immediate ? immediate : (d.memoryOperand ? vload(word + c) : immediate);
+		switch (d.opCode) {
+		case LD:
+			vstore(g.AC + c, vselect(m, value, ac));
+			break;
+		case ST:
+			vstore(word + c, vselect(m, ac, value));
+			break;
+		case EM:
+			vstore(word + c, vselect(m, ac, value));
+			vstore(g.AC + c, vselect(m, value, ac));
+			break;
+		case LDX:
+			vstore(x + c, vselect(m, value, vload(x + c)));
+			break;
+		case STX:
+			vstore(word + c, vselect(m, vload(x + c), value));
+			break;
+		case EMX:
+			vstore(word + c, vselect(m, vload(x + c), value));
+			vstore(x + c, vselect(m, value, vload(x + c)));
+			break;
+		case ADD:
+			vstore(g.AC + c, vselect(m, vadd(ac, value), ac));
+			break;
+		case SUB:
+			vstore(g.AC + c, vselect(m, vsub(ac, value), ac));
+			break;
+		case CLR:
+			vstore(g.AC + c, vandnot(m, ac));
+			break;
+		case COM:
+			vstore(g.AC + c, vselect(m, vxor(ac, vset(-1)), ac));
+			break;
+		case AND:
+			vstore(g.AC + c, vselect(m, vand(ac, value), ac));
+			break;
+		case OR:
+			vstore(g.AC + c, vselect(m, vor(ac, value), ac));
+			break;
+		case XOR:
+			vstore(g.AC + c, vselect(m, vxor(ac, value), ac));
+			break;
+		case ADDX:
+			vstore(x + c, vselect(m, vadd(vload(x + c), value), vload(x + c)));
+			break;
+		case SUBX:
+			vstore(x + c, vselect(m, vsub(vload(x + c), value), vload(x + c)));
+			break;
+		case CLRX:
+			vstore(x + c, vandnot(m, vload(x + c)));
+			break;
+		case JZ:
+		case JN:
+		case JP:
+			taken = d.opCode == JZ ? vzero(ac) : d.opCode == JN ? vnegative(ac) : vpositive(ac);
+			fallthrough = vandnot(taken, m);
+			taken = vand(taken, m);
+			vstore(g.taken + c, taken);
+			anyT = vor(anyT, taken);
+			anyF = vor(anyF, fallthrough);
+			break;
+		default:
+			//NOP and J change nothing in the lanes
+			break;
+		}
+	}
+	anyTaken = vany(anyT);
+	anyFallthrough = vany(anyF);
+}
+
+/************************************************************************
+Function: finishLane
+Author: Jake Davidson
+Description: Records the result of a lane that reached the step limit in
+lockstep and takes it out of the group.
+Parameters: g - group of lanes
+			l - lane
+			results - result of each variant
+************************************************************************/
+static void finishLane(lockstepGroup &g, int l, vector<sweepResult> &results) {
+	sweepResult &result = results[g.variant[l]];
+	result.state = {};
+	result.state.AC = g.AC[l];
+	result.state.X0 = g.X[0][l];
+	result.state.X1 = g.X[1][l];
+	result.state.X2 = g.X[2][l];
+	result.state.X3 = g.X[3][l];
+	result.state.instructions = &instructions;
+	result.steps = g.steps[l];
+	result.haltReason = "";
+	result.privatePages = 0;
+	g.active[l] = 0;
+	g.mask[l] = 0;
+}
+
+/************************************************************************
+Function: ejectLane
+Author: Jake Davidson
+Description: Continues a lane on the scalar interpreter from instruction
+p, with the lane's registers and memory, until it halts or reaches the
+step limit, records its result and takes it out of the group.
+Parameters: g - group of lanes
+			l - lane
+			p - index of the instruction the lane is at
+			maxSteps - most instructions the variant may execute
+			results - result of each variant
+			counts - instruction counts to add to
+************************************************************************/
+static void ejectLane(lockstepGroup &g, int l, int p, unsigned long long maxSteps, vector<sweepResult> &results, lockstepCounts &counts) {
+	vector<int> image(LANE_WORDS); //memory of the lane
+	machineState m = {}; //scalar machine continuing the lane
+	sweepResult &result = results[g.variant[l]];
+	for (int w = 0; w < LANE_WORDS; w++)
+		image[w] = g.memory[(size_t)w * LOCKSTEP_LANES + l];
+	m.AC = g.AC[l];
+	m.X0 = g.X[0][l];
+	m.X1 = g.X[1][l];
+	m.X2 = g.X[2][l];
+	m.X3 = g.X[3][l];
+	m.memory = image.data();
+	m.instructions = &instructions;
+	m.instructionRegister = instructions.begin() + p;
+	ExecuteInstruction ins(m, nullptr);
+	unsigned long long scalarSteps = ins.run(maxSteps - g.steps[l]); //instructions run by the interpreter
+	counts.scalar += scalarSteps;
+	m.memory = nullptr;
+	result.state = m;
+	result.steps = g.steps[l] + scalarSteps;
+	result.haltReason = ins.getHaltReason();
+	result.privatePages = 0;
+	g.active[l] = 0;
+	g.mask[l] = 0;
+}
+
+/************************************************************************
+Function: runGroup
+Author: Jake Davidson
+Description: Runs up to LOCKSTEP_LANES variants together until every lane
+has halted or reached the step limit. While converged the group has one
+instruction index and a shared step count; the per-lane step counts are
+brought up to date (flushed) when the group splits, leaves lockstep, or
+the lane closest to the step limit reaches it. While split, the group
+executes the lowest instruction index of any lane, masked to the lanes at
+it, and converges again once every lane is at the same instruction.
+Parameters: program - prepared program
+			g - group of lanes, with memory and registers set up
+			lanes - number of lanes holding variants
+			maxSteps - most instructions each variant may execute
+			results - result of each variant
+			counts - instruction counts to add to
+************************************************************************/
+static void runGroup(vector<lockstepInstruction> &program, lockstepGroup &g, int lanes, unsigned long long maxSteps,
+	vector<sweepResult> &results, lockstepCounts &counts) {
+	int running = lanes; //lanes still in lockstep
+	int pc = (int)(instructionRegister - instructions.begin()); //instruction of the converged group
+	bool converged = true; //true while every running lane is at pc
+	unsigned long long shared = 0; //instructions executed since the step counts were flushed
+	unsigned long long budget; //instructions before the first lane reaches the step limit
+	bool anyTaken, anyFallthrough; //directions of a conditional jump
+	unsigned long long executed = 0; //lane instructions executed in lockstep
+
+	//adds the shared step count to every running lane and finishes lanes at the limit
+	auto flush = [&]() {
+		budget = maxSteps;
+		for (int l = 0; l < lanes; l++) {
+			if (!g.active[l])
+				continue;
+			g.steps[l] += shared;
+			if (g.steps[l] == maxSteps) {
+				finishLane(g, l, results);
+				running--;
+			}
+			else {
+				budget = min(budget, maxSteps - g.steps[l]);
+			}
+		}
+		shared = 0;
+	};
+
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+		g.active[l] = g.mask[l] = l < lanes ? -1 : 0;
+		g.steps[l] = 0;
+	}
+	flush();
+	while (running > 0) {
+		if (converged) {
+			lockstepInstruction &d = program[pc];
+			if (!d.vectorized) {
+				flush();
+				for (int l = 0; l < lanes; l++) {
+					if (g.active[l])
+						ejectLane(g, l, pc, maxSteps, results, counts);
+				}
+				running = 0;
+				break;
+			}
+			executeLanes(d, g, anyTaken, anyFallthrough);
+			shared++;
+			executed += running;
+			if (d.opCode == J) {
+				pc = d.target;
+			}
+			else if (d.opCode == JZ || d.opCode == JN || d.opCode == JP) {
+				if (anyTaken && anyFallthrough) {
+					//the lanes went different ways, split the group
+					for (int l = 0; l < lanes; l++)
+						g.pc[l] = g.taken[l] ? d.target : d.next;
+					converged = false;
+					counts.splits++;
+					flush();
+					continue;
+				}
+				pc = anyTaken ? d.target : d.next;
+			}
+			else {
+				pc = d.next;
+			}
+			if (shared == budget)
+				flush();
+		}
+		else {
+			int p = INT32_MAX; //lowest instruction of any running lane
+			for (int l = 0; l < lanes; l++) {
+				if (g.active[l] && g.pc[l] < p)
+					p = g.pc[l];
+			}
+			for (int l = 0; l < LOCKSTEP_LANES; l++)
+				g.mask[l] = g.active[l] && g.pc[l] == p ? -1 : 0;
+			lockstepInstruction &d = program[p];
+			if (d.vectorized)
+				executeLanes(d, g, anyTaken, anyFallthrough);
+			bool together = true; //true if every running lane is at the same instruction afterwards
+			int first = -1; //instruction of the first running lane afterwards
+			for (int l = 0; l < lanes; l++) {
+				if (g.mask[l] && !d.vectorized) {
+					ejectLane(g, l, p, maxSteps, results, counts);
+					running--;
+					continue;
+				}
+				if (g.mask[l]) {
+					executed++;
+					g.steps[l]++;
+					g.pc[l] = d.opCode == J ? d.target
+						: (d.opCode == JZ || d.opCode == JN || d.opCode == JP) && g.taken[l] ? d.target
+						: d.next;
+					if (g.steps[l] == maxSteps) {
+						finishLane(g, l, results);
+						running--;
+						continue;
+					}
+				}
+				if (g.active[l]) {
+					if (first < 0)
+						first = g.pc[l];
+					together = together && g.pc[l] == first;
+				}
+			}
+			if (running > 0 && together) {
+				//every lane is back at the same instruction, run converged again
+				converged = true;
+				pc = first;
+				for (int l = 0; l < LOCKSTEP_LANES; l++)
+					g.mask[l] = g.active[l];
+				flush();
+			}
+		}
+	}
+	counts.lockstep += executed;
+}
+
+/************************************************************************
+Function: runLockstepSweep
+Author: Jake Davidson
+Description: Runs the loaded program once for each variant in the variants
+file like runSweep, but LOCKSTEP_LANES variants at a time in lockstep.
+Groups run in parallel on a pool of threads. The results are printed the
+same way as runSweep prints them, followed by how many instructions ran
+in lockstep.
+Parameters: file - name of the variants file
+			threads - number of threads to run groups on, 0 for one per core
+			maxSteps - most instructions to execute per variant
+************************************************************************/
+void runLockstepSweep(string file, int threads, unsigned long long maxSteps) {
+	vector<sweepVariant> variants = readVariants(file); //variants to run
+	vector<sweepResult> results(variants.size()); //result of each variant
+	vector<lockstepInstruction> program = prepareProgram(); //program prepared for lockstep
+	size_t groups = (variants.size() + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES; //groups of lanes to run
+	vector<thread> pool; //threads running groups
+	atomic<size_t> next(0); //index of the next group to run
+	lockstepCounts counts; //instructions executed
+
+	if (threads <= 0)
+		threads = max(1u, thread::hardware_concurrency());
+	threads = (int)min((size_t)threads, max((size_t)1, groups));
+	for (int t = 0; t < threads; t++) {
+		pool.push_back(thread([&]() {
+			lockstepGroup g; //lanes of the group being run, reused for each group
+			//arrays: AC, X0-X3, active, mask, taken, then memory, aligned to 64 bytes
+			size_t arrays = 8 * LOCKSTEP_LANES + (size_t)LANE_WORDS * LOCKSTEP_LANES;
+			g.storage.resize(arrays + 16);
+			int *base = g.storage.data() + ((64 - (uintptr_t)g.storage.data() % 64) % 64) / sizeof(int);
+			g.AC = base;
+			for (int r = 0; r < 4; r++)
+				g.X[r] = base + (1 + r) * LOCKSTEP_LANES;
+			g.active = base + 5 * LOCKSTEP_LANES;
+			g.mask = base + 6 * LOCKSTEP_LANES;
+			g.taken = base + 7 * LOCKSTEP_LANES;
+			g.memory = base + 8 * LOCKSTEP_LANES;
+			size_t n;
+			while ((n = next++) < groups) {
+				size_t first = n * LOCKSTEP_LANES; //first variant of the group
+				int lanes = (int)min((size_t)LOCKSTEP_LANES, variants.size() - first);
+				for (int w = 0; w < LANE_WORDS; w++) {
+					for (int l = 0; l < LOCKSTEP_LANES; l++)
+						g.memory[(size_t)w * LOCKSTEP_LANES + l] = memory[w];
+				}
+				for (int l = 0; l < LOCKSTEP_LANES; l++) {
+					g.AC[l] = g.X[0][l] = g.X[1][l] = g.X[2][l] = g.X[3][l] = g.taken[l] = 0;
+					g.pc[l] = 0;
+					g.variant[l] = first + l;
+				}
+				for (int l = 0; l < lanes; l++) {
+					for (pair<int, int> &o : variants[first + l].overrides)
+						g.memory[(size_t)o.first * LOCKSTEP_LANES + l] = o.second;
+				}
+				runGroup(program, g, lanes, maxSteps, results, counts);
+			}
+		}));
+	}
+	for (thread &t : pool)
+		t.join();
+
+	printSweepResults(results);
+	unsigned long long total = counts.lockstep + counts.scalar; //instructions over all variants
+	cout << dec << "Lockstep: " << variants.size() << " variants in " << groups << " groups of " << LOCKSTEP_LANES
+		<< " lanes on " << threads << " threads, " << VECTOR_NAME << " (" << VECTOR_LANES << " lanes per vector)" << endl;
+	cout << "Instructions: " << counts.lockstep << " in lockstep, " << counts.scalar << " on the scalar interpreter";
+	if (total > 0)
+		cout << " (" << (100 * counts.lockstep / total) << "% in lockstep)";
+	cout << ", " << counts.splits << " splits" << endl;
+}
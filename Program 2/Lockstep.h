@@ -0,0 +1,31 @@
+//Lockstep sweep. With --sweep and --lockstep the variants of a sweep run in
+//groups of LOCKSTEP_LANES lanes, one variant per lane. AC, X0-X3 and memory
+//are stored lane by lane (memory word w of every lane is contiguous), so each
+//decoded instruction is executed once for the whole group with SIMD vectors:
+//AVX-512 or AVX2 when the compiler targets them, one lane at a time otherwise.
+//
+//While every lane is at the same instruction the group runs converged. A
+//conditional jump that goes different ways in different lanes splits the
+//group; it then executes the instruction with the lowest address that any
+//lane is at, masked to the lanes at it, until the lanes meet again.
+//
+//Instructions that halt the machine or whose behaviour depends on more than
+//the decoded instruction (HALT, undefined opcodes, illegal addressing modes,
+//jumps to missing addresses, the last instruction) are not run in lockstep:
+//the lanes reaching them continue on the scalar interpreter from their current
+//state, so every variant gets exactly the result of a separate scalar run.
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <string>
+#include "Sweep.h"
+
+using namespace std;
+
+//variants executed together, a multiple of every SIMD width supported
+const int LOCKSTEP_LANES = 64;
+
+//runs every variant of the loaded program in lockstep groups and reports the results
+void runLockstepSweep(string file, int threads, unsigned long long maxSteps);
+
+#endif
@@ -0,0 +1,79 @@
+#include "MappedFile.h"
+#include <fstream>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/************************************************************************
+Function: MappedFile
+Author: Jake Davidson
+Description: Constructs an empty view, call open to map a file.
+************************************************************************/
+MappedFile::MappedFile() : bytes(nullptr), length(0), mapped(false) {
+}
+
+/************************************************************************
+Function: ~MappedFile
+Author: Jake Davidson
+Description: Unmaps the file if one is open.
+************************************************************************/
+MappedFile::~MappedFile() {
+	this->close();
+}
+
+/************************************************************************
+Function: open
+Author: Jake Davidson
+Description: Maps a file read-only. Falls back to reading the file into
+a buffer if it cannot be mapped (including empty files, which cannot be 
+mapped).
+Parameters: file - name of the file to open
+Returns: true if the file was opened
+************************************************************************/
+bool MappedFile::open(string file) {
+	this->close();
+#ifndef _WIN32
+	int fd = ::open(file.c_str(), O_RDONLY);
+	struct stat info;
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &info) == 0 && info.st_size > 0) {
+		void *p = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			bytes = (const char *)p;
+			length = (size_t)info.st_size;
+			mapped = true;
+			::close(fd);
+			return true;
+		}
+	}
+	::close(fd);
+#endif
+	ifstream fin(file, ios::binary);
+	if (!fin)
+		return false;
+	buffer.assign(istreambuf_iterator<char>(fin), istreambuf_iterator<char>());
+	bytes = buffer.data();
+	length = buffer.size();
+	return true;
+}
+
+/************************************************************************
+Function: close
+Author: Jake Davidson
+Description: Unmaps the file and releases its buffer.
+************************************************************************/
+void MappedFile::close() {
+#ifndef _WIN32
+	if (mapped)
+		munmap((void *)bytes, length);
+#endif
+	buffer.clear();
+	bytes = nullptr;
+	length = 0;
+	mapped = false;
+}
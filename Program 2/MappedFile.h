@@ -0,0 +1,28 @@
+//Read-only view of a whole file. On POSIX systems the file is memory-mapped,
+//elsewhere it is read into a buffer.
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+	bool open(string file); //map file, returns false if it could not be opened
+	void close(); //unmap the file
+	const char *data() { return bytes; } //first byte of the file
+	size_t size() { return length; } //length of the file in bytes
+private:
+	MappedFile(const MappedFile &); //not copyable
+	MappedFile &operator=(const MappedFile &);
+	const char *bytes; //contents of the file
+	size_t length; //size of the file
+	bool mapped; //true if bytes is a mapping rather than buffer
+	vector<char> buffer; //contents when the file could not be mapped
+};
+
+#endif
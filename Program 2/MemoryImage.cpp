@@ -0,0 +1,163 @@
+#include "MemoryImage.h"
+#include "MappedFile.h"
+#include "globals.h"
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include "SparseMemory.h"
+
+/************************************************************************
+Function: checkRange
+Author: Jake Davidson
+Description: Halts with an error if a range of the image does not fit in
+memory, which is larger with extended addressing.
+Parameters: file - name of the image, for the error message
+			start - first address of the range
+			count - number of words in the range
+************************************************************************/
+static void checkRange(string file, unsigned long long start, unsigned long long count) {
+	if (start >= memoryWords() || count > memoryWords() - start) {
+		cout << "Data image " << file << " has a range outside of memory (start " << hex << start 
+			<< ", " << dec << count << " words)" << endl;
+		exit(0);
+	}
+}
+
+/************************************************************************
+Function: loadBinaryImage
+Author: Jake Davidson
+Description: Copies the ranges of a binary image into memory. Each range
+is copied with a single memcpy straight from the mapped file, or a word at
+a time through the page table with extended addressing.
+Parameters: file - name of the image, for error messages
+			p - first byte after the magic
+			end - one past the last byte of the file
+************************************************************************/
+static void loadBinaryImage(string file, const char *p, const char *end) {
+	uint32_t header[2]; //start address and word count of the current range
+	while (p < end) {
+		if ((size_t)(end - p) < sizeof(header)) {
+			cout << "Data image " << file << " ends in the middle of a range header" << endl;
+			exit(0);
+		}
+		memcpy(header, p, sizeof(header));
+		p += sizeof(header);
+		checkRange(file, header[0], header[1]);
+		if ((size_t)(end - p) / sizeof(int) < header[1]) {
+			cout << "Data image " << file << " ends in the middle of a range" << endl;
+			exit(0);
+		}
+		if (extendedMemory) {
+			for (uint32_t w = 0; w < header[1]; w++)
+				memcpy(&extendedMemory->write(header[0] + w), p + w * sizeof(int), sizeof(int));
+		}
+		else
+			memcpy(&memory[header[0]], p, header[1] * sizeof(int));
+		p += header[1] * sizeof(int);
+	}
+}
+
+/************************************************************************
+Function: readHex
+Author: Jake Davidson
+Description: Reads the next hex number from a hex image, skipping spaces.
+A leading - makes the number negative.
+Parameters: p - position to read from, moved past the number
+			end - one past the last byte of the file
+			value - set to the number read
+Returns: true if a number was read, false at the end of the line or file
+************************************************************************/
+static bool readHex(const char *&p, const char *end, long long &value) {
+	bool negative = false; //true if the number has a leading -
+	int digit; //value of the current digit
+	int digits = 0; //number of digits read
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	if (p < end && *p == '-') {
+		negative = true;
+		p++;
+	}
+	value = 0;
+	while (p < end) {
+		if (*p >= '0' && *p <= '9')
+			digit = *p - '0';
+		else if (*p >= 'a' && *p <= 'f')
+			digit = *p - 'a' + 10;
+		else if (*p >= 'A' && *p <= 'F')
+			digit = *p - 'A' + 10;
+		else
+			break;
+		value = value * 16 + digit;
+		digits++;
+		p++;
+	}
+	if (negative)
+		value = -value;
+	return digits > 0;
+}
+
+/************************************************************************
+Function: loadHexImage
+Author: Jake Davidson
+Description: Copies the ranges of a hex image into memory, decoding the
+words straight from the mapped file in one pass.
+Parameters: file - name of the image, for error messages
+			p - first byte of the file
+			end - one past the last byte of the file
+************************************************************************/
+static void loadHexImage(string file, const char *p, const char *end) {
+	long long start, count, value; //current range and word
+	int line = 1; //line number, for error messages
+	while (p < end) {
+		//blank lines are allowed between ranges
+		if (readHex(p, end, start)) {
+			if (!readHex(p, end, count) || count < 0) {
+				cout << "Data image " << file << " line " << line << " has no word count" << endl;
+				exit(0);
+			}
+			checkRange(file, start, count);
+			for (long long w = 0; w < count; w++) {
+				if (!readHex(p, end, value)) {
+					cout << "Data image " << file << " line " << line << " has fewer words than its count" << endl;
+					exit(0);
+				}
+				if (extendedMemory)
+					extendedMemory->write((unsigned int)(start + w)) = (int)value;
+				else
+					memory[start + w] = (int)value;
+			}
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+				p++;
+		}
+		if (p < end && *p != '\n') {
+			cout << "Data image " << file << " line " << line << " has an invalid character" << endl;
+			exit(0);
+		}
+		p++;
+		line++;
+	}
+}
+
+/************************************************************************
+Function: loadMemoryImage
+Author: Jake Davidson
+Description: Maps a data image file and copies each of its ranges into
+memory. Binary images are recognised by their magic bytes, any other 
+file is read as a hex image. Halts if the file cannot be read or a range
+does not fit in memory.
+Parameters: file - name of the image file
+************************************************************************/
+void loadMemoryImage(string file) {
+	MappedFile image; //contents of the image file
+	size_t magic = strlen(DATA_IMAGE_MAGIC); //length of the binary magic
+	if (!image.open(file)) {
+		cout << "Could not open data image, ensure the path is correct." << endl;
+		exit(0);
+	}
+	const char *p = image.data();
+	const char *end = p + image.size();
+	if (image.size() >= magic && memcmp(p, DATA_IMAGE_MAGIC, magic) == 0)
+		loadBinaryImage(file, p + magic, end);
+	else
+		loadHexImage(file, p, end);
+}
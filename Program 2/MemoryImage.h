@@ -0,0 +1,27 @@
+//Loading of initial memory contents from a data image file. An image holds
+//one or more ranges of words, each copied into memory at its start address.
+//
+//Hex images use the layout of the object file: each line is a start address,
+//the number of words, then the words, all in hex. For example
+//    100 3 000005 00000a fffff0
+//    800 1 000001
+//Binary images start with the 4 bytes "B17D", followed by ranges of a 32-bit
+//start address, a 32-bit word count, then that many 32-bit words, all in host
+//byte order.
+//
+//Ranges must fit in memory, which with --address-bits (see SparseMemory.h) is
+//the whole extended address space.
+#ifndef MEMORYIMAGE_H
+#define MEMORYIMAGE_H
+
+#include <string>
+
+using namespace std;
+
+//first bytes of a binary image
+const char DATA_IMAGE_MAGIC[] = "B17D";
+
+//copies every range in the image file into memory
+void loadMemoryImage(string file);
+
+#endif
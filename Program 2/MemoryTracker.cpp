@@ -0,0 +1,114 @@
+#include "MemoryTracker.h"
+
+#ifdef TRACK_MEMORY
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+thread_local MemoryTracker memoryTracker;
+
+//number of words shown on each row of the heat map
+const int HEAT_MAP_ROW = 64;
+
+/************************************************************************
+Function: writeRanges
+Author: Jake Davidson
+Description: Writes each run of consecutive set bits as a range of 
+addresses, one range per line.
+Parameters: out - stream to write to
+			bits - bitmap to write ranges for
+Returns: number of words set in bits
+************************************************************************/
+static int writeRanges(ostream &out, bitset<TRACKED_WORDS> &bits) {
+	int start; //first address of the current range
+	int address = 0; //address being checked
+	//walk the bitmap, printing every run of set bits
+	while (address < TRACKED_WORDS) {
+		if (bits[address]) {
+			start = address;
+			while (address < TRACKED_WORDS && bits[address])
+				address++;
+			out << "  " << hex << setw(3) << setfill('0') << start << "-" << setw(3) << (address - 1)
+				<< dec << " (" << (address - start) << " words)" << endl;
+		}
+		else {
+			address++;
+		}
+	}
+	return (int)bits.count();
+}
+
+/************************************************************************
+Function: writeReport
+Author: Jake Davidson
+Description: Writes the dirty ranges, read ranges and a heat map of 
+memory accesses to a file. Each heat map row covers 64 words. Without 
+counters a word is shown as '.' (untouched), 'r' (read), 'w' (written) 
+or 'b' (both). With counters each word shows the magnitude of its total 
+access count, from '1' (1 access) up to '9' (256 or more).
+Parameters: file - name of file to write the report to
+************************************************************************/
+void MemoryTracker::writeReport(string file) {
+	ofstream fout; //stream to write the report to
+	char c; //heat map character for the current word
+	fout.open(file);
+	if (!fout) {
+		cout << "Could not write memory report to " << file << endl;
+		return;
+	}
+	fout << "Dirty ranges:" << endl;
+	fout << dec << writeRanges(fout, writeBits) << " words written" << endl << endl;
+	fout << "Read ranges:" << endl;
+	fout << dec << writeRanges(fout, readBits) << " words read" << endl << endl;
+
+	fout << "Heat map:" << endl;
+	for (int row = 0; row < TRACKED_WORDS; row += HEAT_MAP_ROW) {
+		fout << hex << setw(3) << setfill('0') << row << ": ";
+		for (int address = row; address < row + HEAT_MAP_ROW; address++) {
+#ifdef TRACK_MEMORY_COUNTS
+			unsigned long long total = readCounts[address] + writeCounts[address];
+			//scale total to a single digit, one step per power of two
+			int level = 0;
+			while (total > 0 && level < 9) {
+				level++;
+				total >>= 1;
+			}
+			c = (level == 0) ? '.' : (char)('0' + level);
+#else
+			if (readBits[address] && writeBits[address])
+				c = 'b';
+			else if (writeBits[address])
+				c = 'w';
+			else if (readBits[address])
+				c = 'r';
+			else
+				c = '.';
+#endif
+			fout << c;
+		}
+		fout << endl;
+	}
+
+#ifdef TRACK_MEMORY_COUNTS
+	//list the exact counts of every accessed word
+	fout << endl << "Access counts (address: reads writes):" << endl;
+	for (int address = 0; address < TRACKED_WORDS; address++) {
+		if (readCounts[address] || writeCounts[address])
+			fout << "  " << hex << setw(3) << setfill('0') << address << ": " << dec
+				<< readCounts[address] << " " << writeCounts[address] << endl;
+	}
+#endif
+}
+
+/************************************************************************
+Function: writeMemoryReport
+Author: Jake Davidson
+Description: Writes the report of the running machine's memory accesses.
+Registered with atexit so it runs however the machine halts.
+************************************************************************/
+void writeMemoryReport() {
+	memoryTracker.writeReport(MEMORY_REPORT_FILE);
+}
+
+#endif
@@ -0,0 +1,72 @@
+//Memory access tracking. Records which words of memory are read and written
+//during a run, and optionally how many times each word was accessed.
+//Tracking is selected at compile time: define TRACK_MEMORY to enable the read
+//and write bitmaps, and TRACK_MEMORY_COUNTS to also keep per-word counters.
+//When TRACK_MEMORY is not defined the TRACK_READ/TRACK_WRITE hooks expand to
+//an empty statement, so normal builds pay no cost for them.
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <bitset>
+#include <string>
+
+using namespace std;
+
+//number of words tracked, matches the size of memory in globals.h
+const int TRACKED_WORDS = 4096;
+
+#ifdef TRACK_MEMORY
+
+//file the report is written to when the machine halts
+#ifndef MEMORY_REPORT_FILE
+#define MEMORY_REPORT_FILE "memory_report.txt"
+#endif
+
+class MemoryTracker {
+public:
+	//record a read of memory[address]
+	void recordRead(int address) {
+		if (address >= 0 && address < TRACKED_WORDS) {
+			readBits[address] = true;
+#ifdef TRACK_MEMORY_COUNTS
+			readCounts[address]++;
+#endif
+		}
+	}
+	//record a write to memory[address]
+	void recordWrite(int address) {
+		if (address >= 0 && address < TRACKED_WORDS) {
+			writeBits[address] = true;
+#ifdef TRACK_MEMORY_COUNTS
+			writeCounts[address]++;
+#endif
+		}
+	}
+	bool wasRead(int address) { return readBits[address]; } //true if address was read this run
+	bool wasWritten(int address) { return writeBits[address]; } //true if address was written this run
+	void writeReport(string file); //write the heat map and dirty ranges to file
+private:
+	bitset<TRACKED_WORDS> readBits; //one bit per word, set when the word is read
+	bitset<TRACKED_WORDS> writeBits; //one bit per word, set when the word is written
+#ifdef TRACK_MEMORY_COUNTS
+	unsigned long long readCounts[TRACKED_WORDS] = {}; //number of reads of each word
+	unsigned long long writeCounts[TRACKED_WORDS] = {}; //number of writes to each word
+#endif
+};
+
+//tracker for the machine running on this thread
+extern thread_local MemoryTracker memoryTracker;
+//writes the report for memoryTracker, registered with atexit so it runs however the program ends
+void writeMemoryReport();
+
+#define TRACK_READ(address) memoryTracker.recordRead(address)
+#define TRACK_WRITE(address) memoryTracker.recordWrite(address)
+
+#else
+
+#define TRACK_READ(address) ((void)0)
+#define TRACK_WRITE(address) ((void)0)
+
+#endif
+
+#endif
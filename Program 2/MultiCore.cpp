@@ -0,0 +1,162 @@
+#include "MultiCore.h"
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include "ExecuteInstruction.h"
+#include "globals.h"
+
+/************************************************************************
+Function: LabelledTrace
+Author: Jake Davidson
+Description: Constructs the trace of one core.
+Parameters: target - trace shared by every core
+			lock - lock held while lines are written to target
+			label - written before each line
+************************************************************************/
+LabelledTrace::LabelledTrace(ostream &target, mutex &lock, string label) : target(target), lock(lock), label(label) {
+	setp(buffer, buffer + sizeof(buffer));
+}
+
+/************************************************************************
+Function: overflow
+Author: Jake Davidson
+Description: Moves the full buffer, and the character that did not fit,
+to the lines being built.
+Parameters: c - character written to the trace, or EOF
+Returns: a value other than EOF
+************************************************************************/
+int LabelledTrace::overflow(int c) {
+	lines.append(pbase(), pptr() - pbase());
+	setp(buffer, buffer + sizeof(buffer));
+	if (c != traits_type::eof())
+		lines.push_back((char)c);
+	return traits_type::not_eof(c);
+}
+
+/************************************************************************
+Function: sync
+Author: Jake Davidson
+Description: Writes every complete line built so far to the shared
+trace, each with the label in front. Called by endl, which ends every
+trace line.
+Returns: 0, or -1 if the shared trace could not be written
+************************************************************************/
+int LabelledTrace::sync() {
+	size_t begin = 0, end; //current line
+	this->overflow(traits_type::eof());
+	lock_guard<mutex> guard(lock);
+	while ((end = lines.find('\n', begin)) != string::npos) {
+		target << label;
+		target.write(lines.data() + begin, end + 1 - begin);
+		begin = end + 1;
+	}
+	lines.erase(0, begin);
+	return target ? 0 : -1;
+}
+
+/************************************************************************
+Function: runMultiCore
+Author: Jake Davidson
+Description: Starts the cores at the program's start address, each with
+AC set to its core number and a labelled trace, and runs them over the
+global memory with the chosen scheduler until every core has halted or
+reached the step limit. Then prints the steps and halt reason of each core.
+Parameters: cores - number of cores
+			freeRunning - true to run each core on its own thread
+			quantum - most instructions a core executes per turn when interleaving
+			seed - seed of the interleaving order, 0 to take turns in core order
+			maxSteps - most instructions each core executes, UNLIMITED_STEPS for no limit
+************************************************************************/
+void runMultiCore(int cores, bool freeRunning, unsigned long long quantum, unsigned long long seed, unsigned long long maxSteps) {
+	vector<machineState> machines(cores); //registers and instruction register of each core
+	vector<unique_ptr<LabelledTrace> > labels; //labels the trace lines of each core
+	vector<unique_ptr<ostream> > traces; //trace stream of each core
+	vector<unique_ptr<ExecuteInstruction> > executors; //executor of each core
+	vector<unsigned long long> steps(cores, 0); //instructions executed by each core
+	mutex lock; //keeps trace lines whole
+	size_t width = to_string(cores - 1).size(); //digits of the largest core number
+	double seconds = 0; //host time taken when free running
+
+#if defined(TRACK_MEMORY) || defined(SIMULATE_CACHE)
+	//the memory report and cache simulator are not thread safe
+	freeRunning = false;
+#endif
+	for (int c = 0; c < cores; c++) {
+		machineState &m = machines[c];
+		string number = to_string(c); //core number, right aligned in the label
+		m.AC = c;
+		m.X0 = X0;
+		m.X1 = X1;
+		m.X2 = X2;
+		m.X3 = X3;
+		m.memory = memory;
+		m.instructions = &instructions;
+		m.instructionRegister = instructionRegister;
+		labels.emplace_back(new LabelledTrace(cout, lock, "core " + string(width - number.size(), ' ') + number + ": "));
+		traces.emplace_back(new ostream(labels.back().get()));
+		executors.emplace_back(new ExecuteInstruction(m, traces.back().get()));
+		executors.back()->setShared(true);
+	}
+
+	if (freeRunning) {
+		vector<thread> pool; //one thread per core
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int c = 0; c < cores; c++)
+			pool.push_back(thread([&, c]() { steps[c] = executors[c]->run(maxSteps); }));
+		for (thread &t : pool)
+			t.join();
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+	else {
+		vector<int> running; //cores that have not stopped, in core order
+		size_t next = 0; //position in running of the core whose turn is next
+		uint64_t random = seed; //xorshift state choosing turns
+		for (int c = 0; c < cores && maxSteps > 0; c++)
+			running.push_back(c);
+		while (!running.empty()) {
+			unsigned long long turn = quantum; //instructions in this turn
+			size_t r = next % running.size(); //position of the core taking the turn
+			if (seed) {
+				random ^= random << 13;
+				random ^= random >> 7;
+				random ^= random << 17;
+				r = random % running.size();
+				turn = 1 + (random >> 32) % quantum;
+			}
+			int c = running[r];
+			steps[c] += executors[c]->run(min(turn, maxSteps - steps[c]));
+			//a core that stopped leaves the rotation, the core after it is next
+			if (executors[c]->isHalted() || steps[c] == maxSteps)
+				running.erase(running.begin() + r);
+			else
+				r++;
+			next = r;
+		}
+	}
+
+	for (int c = 0; c < cores; c++) {
+		if (!executors[c]->isHalted())
+			*traces[c] << "Machine Halted - step limit reached" << endl;
+	}
+	unsigned long long total = 0; //instructions executed by every core
+	cout << dec << "Multi-core: " << cores << " cores, ";
+	if (freeRunning)
+		cout << "free running on " << cores << " threads" << endl;
+	else if (seed)
+		cout << "deterministic interleaving with seed " << seed << ", turns of 1 to " << quantum << " instructions" << endl;
+	else
+		cout << "deterministic interleaving, turns of " << quantum << " instructions" << endl;
+	for (int c = 0; c < cores; c++) {
+		cout << "core " << c << ": " << steps[c] << " steps, "
+			<< (executors[c]->isHalted() ? executors[c]->getHaltReason() : "Machine Halted - step limit reached") << endl;
+		total += steps[c];
+	}
+	cout << "Total: " << total << " steps";
+	if (freeRunning && seconds > 0)
+		cout << " in " << seconds << " s (" << total / seconds / 1e6 << " million instructions per second)";
+	cout << endl;
+}
@@ -0,0 +1,77 @@
+//Multi-core mode. With --cores <n> the loaded program is run by n B17 cores
+//(2 to MAX_CORES) sharing the global memory. Each core has its own AC, X0-X3
+//and instruction register and starts at the program's start address with AC
+//set to its core number, index registers as the global machine's, so a program
+//can branch on AC to give each core its own work. EAs are decoded once for the
+//whole program as usual.
+//
+//Memory is shared without locks. Ordinary loads and stores are single word
+//atomic accesses (acquire and release), and EM and EMX are host atomic
+//exchanges, so EM is the machine's test-and-set: exchange 1 with a lock word
+//and the lock was taken if AC comes back 0. Block instructions are not atomic.
+//
+//Two schedulers are offered:
+//  --interleave <n>       deterministic: the cores take turns on one host
+//                         thread, each executing n instructions per turn
+//                         (default 1), in core order or, with
+//                         --interleave-seed <s> (not 0), in an order and for
+//                         turns of 1 to n instructions drawn from a generator
+//                         seeded with s. The same seed gives the same trace.
+//  --free-running         every core runs on its own host thread as fast as
+//                         it can, for throughput; the interleaving is up to
+//                         the host.
+//
+//Each trace line is labelled with the core that executed it, and lines of
+//different cores are never mixed. --steps limits each core. When every core
+//has stopped, the steps and halt reason of each are printed, with the host
+//time taken when free running. Devices, the optimizer and the other run modes
+//only know a single core and cannot be combined with --cores.
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include <string>
+#include <streambuf>
+#include <ostream>
+#include <mutex>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+//most cores that can be started
+const int MAX_CORES = 64;
+
+//accesses to memory shared by cores running at the same time
+#ifdef _MSC_VER
+//volatile accesses have acquire and release semantics with /volatile:ms
+inline int sharedLoad(const int *w) { return *(const volatile int *)w; }
+inline void sharedStore(int *w, int value) { *(volatile int *)w = value; }
+inline int sharedExchange(int *w, int value) { return (int)_InterlockedExchange((volatile long *)w, value); }
+#else
+inline int sharedLoad(const int *w) { return __atomic_load_n(w, __ATOMIC_ACQUIRE); }
+inline void sharedStore(int *w, int value) { __atomic_store_n(w, value, __ATOMIC_RELEASE); }
+inline int sharedExchange(int *w, int value) { return __atomic_exchange_n(w, value, __ATOMIC_SEQ_CST); }
+#endif
+
+//trace of one core: each complete line is written to the shared trace with
+//the core's label in front, holding a lock so lines of cores are not mixed
+class LabelledTrace : public streambuf {
+public:
+	LabelledTrace(ostream &target, mutex &lock, string label);
+protected:
+	int overflow(int c); //move the buffer to the line being built when it is full
+	int sync(); //write the complete lines built so far
+private:
+	ostream &target; //trace shared by every core
+	mutex &lock; //held while lines are written to target
+	string label; //written before each line
+	string lines; //lines being built, the last may not be complete
+	char buffer[256]; //characters written since the last sync
+};
+
+//runs the loaded program on cores cores sharing memory, then prints each core's result
+//quantum - instructions per turn when interleaving, seed - 0 for turns in core order
+void runMultiCore(int cores, bool freeRunning, unsigned long long quantum, unsigned long long seed, unsigned long long maxSteps);
+
+#endif
@@ -0,0 +1,581 @@
+#include "Optimizer.h"
+#include <set>
+#include <bitset>
+#include <iomanip>
+#include <algorithm>
+#include "Semantics.h"
+
+//most rounds of optimization, each round can expose more work for the next
+const int OPTIMIZER_ROUNDS = 16;
+
+//registers and memory words followed by the liveness analysis: memory words
+//0-4095, then AC and X0-X3
+const int LIVE_AC = 4096;
+typedef bitset<4096 + 5> liveSet;
+
+//registers and memory one instruction reads and writes
+struct instructionEffects {
+	bool halts; //may halt the machine, so everything is used after it
+	bool fixed; //cannot be removed even if its results are never used
+	int registersRead, registersWritten; //bit 0 for AC, bits 1-4 for X0-X3
+	int memoryRead, memoryWritten; //memory word read and written, -1 for none
+};
+
+//value of a register or memory word as far as the optimizer knows
+struct knownValue {
+	bool known; //true if value is known
+	int value; //the value, if known
+	int copyOf; //memory word holding the same value, -1 for none
+};
+
+const knownValue UNKNOWN_VALUE = { false, 0, -1 };
+
+/************************************************************************
+Function: isJump
+Author: Jake Davidson
+Description: Checks for the transfer instructions.
+Parameters: op - op code to check
+Returns: true for J, JZ, JN and JP
+************************************************************************/
+static bool isJump(opCodes op) {
+	return op == J || op == JZ || op == JN || op == JP;
+}
+
+/************************************************************************
+Function: effectsOf
+Author: Jake Davidson
+Description: Finds the registers and memory word an instruction reads and
+writes, the same way ExecuteInstruction executes it. Instructions that
+halt the machine, jumps and accesses to device words are fixed.
+Parameters: i - instruction to check
+			validTarget - true if i is a jump to an instruction of the program
+			devices - devices of the machine, nullptr for none
+Returns: the effects of i
+************************************************************************/
+static instructionEffects effectsOf(const instruction &i, bool validTarget, DeviceBus *devices) {
+	instructionEffects e = { false, false, 0, 0, -1, -1 }; //effects found so far
+	int x = 1 << (i.indexRegister + 1); //bit of the index register i uses
+	if (i.opCode == HALT || i.opCode == UNDEFINED || illegalAddressMode(i.opCode, i.addressMode)
+		|| (isJump(i.opCode) && !validTarget)) {
+		e.halts = e.fixed = true;
+		return e;
+	}
+	switch (i.opCode) {
+	case LD:
+	case CLR:
+		e.registersWritten = 1;
+		break;
+	case ADD:
+	case SUB:
+	case COM:
+	case AND:
+	case OR:
+	case XOR:
+	case EM:
+		e.registersRead = e.registersWritten = 1;
+		break;
+	case ST:
+		e.registersRead = 1;
+		break;
+	case LDX:
+	case CLRX:
+		e.registersWritten = x;
+		break;
+	case ADDX:
+	case SUBX:
+	case EMX:
+		e.registersRead = e.registersWritten = x;
+		break;
+	case STX:
+		e.registersRead = x;
+		break;
+	case JZ:
+	case JN:
+	case JP:
+		e.registersRead = 1;
+		e.fixed = true;
+		break;
+	case J:
+		e.fixed = true;
+		break;
+	default:
+		//NOP
+		break;
+	}
+	if (readsMemory(i.opCode, i.addressMode))
+		e.memoryRead = i.EA;
+	if (writesMemory(i.opCode, i.addressMode))
+		e.memoryWritten = i.EA;
+	//an access outside memory is undefined, leave it alone and assume the worst
+	if ((e.memoryRead != -1 || e.memoryWritten != -1) && (i.EA < 0 || i.EA >= 4096))
+		e.halts = e.fixed = true;
+	//reading or writing a device word has effects outside the machine
+	else if (devices && (devices->mapped(e.memoryRead) || devices->mapped(e.memoryWritten)))
+		e.fixed = true;
+	return e;
+}
+
+/************************************************************************
+Function: sameValue
+Author: Jake Davidson
+Description: Checks if two values are known to be equal, either because
+both are known or because both are copies of the same memory word.
+Parameters: a, b - values to compare
+Returns: true if a and b are equal
+************************************************************************/
+static bool sameValue(knownValue a, knownValue b) {
+	return (a.copyOf != -1 && a.copyOf == b.copyOf) || (a.known && b.known && a.value == b.value);
+}
+
+/************************************************************************
+Function: Optimizer
+Author: Jake Davidson
+Description: Constructs an optimizer for a decoded program.
+Parameters: program - instructions to optimize, in place
+			instructionRegister - start instruction, moved if it is removed
+			devices - devices of the machine, nullptr for none
+************************************************************************/
+Optimizer::Optimizer(vector<instruction> &program, vector<instruction>::iterator &instructionRegister, DeviceBus *devices)
+	: program(program), instructionRegister(instructionRegister), devices(devices), originalSize((int)program.size()),
+	nops(0), loads(0), stores(0), dead(0), jumps(0), folded(0), retargeted(0)
+{
+}
+
+/************************************************************************
+Function: optimize
+Author: Jake Davidson
+Description: Runs rounds of value propagation, jump threading and dead
+code removal until a round changes nothing. The program is not changed
+if two instructions have the same address, since jumps would then reach
+a different instruction once one of them is removed.
+Returns: false if the program cannot be optimized
+************************************************************************/
+bool Optimizer::optimize() {
+	set<unsigned int> addresses; //addresses seen so far
+	bool changed = true; //true while a round changes the program
+	if (program.empty())
+		return false;
+	for (instruction &i : program) {
+		if (!addresses.insert(i.instructionAddress).second)
+			return false;
+	}
+	for (int round = 0; round < OPTIMIZER_ROUNDS && changed; round++) {
+		this->findBlocks();
+		changed = this->propagateValues();
+		this->apply();
+		this->findBlocks();
+		changed = this->threadJumps() || changed;
+		this->apply();
+		this->findBlocks();
+		changed = this->removeDeadCode() || changed;
+		this->apply();
+	}
+	return true;
+}
+
+/************************************************************************
+Function: isVolatile
+Author: Jake Davidson
+Description: Checks if the optimizer must not assume anything about a
+memory word, because it is outside memory or belongs to a device.
+Parameters: address - memory word to check
+Returns: true if the word is volatile
+************************************************************************/
+bool Optimizer::isVolatile(int address) {
+	return address < 0 || address >= 4096 || (devices && devices->mapped(address));
+}
+
+/************************************************************************
+Function: findBlocks
+Author: Jake Davidson
+Description: Finds the instruction each jump goes to, the way J does, and
+splits the program into basic blocks. A block starts at the start
+instruction, at each jump target and after each jump or instruction that
+may halt. Clears the instructions marked for removal.
+************************************************************************/
+void Optimizer::findBlocks() {
+	int n = (int)program.size(); //instructions in the program
+	map<unsigned int, int> index; //position of the instruction at each address
+	vector<bool> leader(n + 1, false); //true for the first instruction of each block
+	removed.assign(n, false);
+	target.assign(n, -1);
+	blockStart.clear();
+	for (int k = 0; k < n; k++)
+		index[program[k].instructionAddress] = k;
+	leader[0] = true;
+	leader[instructionRegister - program.begin()] = true;
+	for (int k = 0; k < n; k++) {
+		instruction &i = program[k];
+		if (isJump(i.opCode) && !illegalAddressMode(i.opCode, i.addressMode) && index.count((unsigned int)i.EA)) {
+			target[k] = index[(unsigned int)i.EA];
+			leader[target[k]] = true;
+		}
+		if (isJump(i.opCode) || effectsOf(i, target[k] >= 0, devices).halts)
+			leader[k + 1] = true;
+	}
+	for (int k = 0; k < n; k++) {
+		if (leader[k])
+			blockStart.push_back(k);
+	}
+	blockStart.push_back(n);
+}
+
+/************************************************************************
+Function: propagateValues
+Author: Jake Davidson
+Description: Follows the values of the registers and memory words through
+each basic block, starting with nothing known. A load of a value the
+register already holds, or a store of a value the memory word already
+holds, is removed. An AC operation on known values is folded into an
+immediate LD, and one that adds, ors or xors memory into an AC of 0
+becomes a LD of the memory word. Operations that leave their register
+unchanged, such as ADD of 0 or CLR of a clear AC, are removed.
+Returns: true if the program was changed
+************************************************************************/
+bool Optimizer::propagateValues() {
+	bool changed = false; //true once an instruction is removed or rewritten
+	int last = (int)program.size() - 1; //last instruction, never removed
+	for (size_t b = 0; b + 1 < blockStart.size(); b++) {
+		knownValue reg[5] = { UNKNOWN_VALUE, UNKNOWN_VALUE, UNKNOWN_VALUE, UNKNOWN_VALUE, UNKNOWN_VALUE }; //AC, X0-X3
+		map<int, int> words; //memory words with known values
+
+		//forget what is known about a memory word when it is written
+		auto forget = [&](int address) {
+			words.erase(address);
+			for (knownValue &v : reg) {
+				if (v.copyOf == address)
+					v.copyOf = -1;
+			}
+		};
+		//what is known about a memory word
+		auto word = [&](int address) {
+			if (isVolatile(address))
+				return UNKNOWN_VALUE;
+			knownValue v = { words.count(address) > 0, words.count(address) ? words[address] : 0, address };
+			return v;
+		};
+
+		for (int k = blockStart[b]; k < blockStart[b + 1]; k++) {
+			instruction &i = program[k];
+			int r = (i.opCode >= LDX && i.opCode <= EMX) || (i.opCode >= ADDX && i.opCode <= CLRX)
+				? i.indexRegister + 1 : 0; //register the instruction uses
+			knownValue operand = UNKNOWN_VALUE; //value the instruction takes from its operand
+			bool remove = false; //true if the instruction does nothing
+			if (effectsOf(i, target[k] >= 0, devices).halts)
+				continue;
+			if (usesImmediate(i.opCode, i.addressMode))
+				operand = { true, i.EA, -1 };
+			else if (readsMemory(i.opCode, i.addressMode))
+				operand = word(i.EA);
+
+			switch (i.opCode) {
+			case LD:
+			case LDX:
+				remove = sameValue(reg[r], operand);
+				if (remove)
+					loads += k != last;
+				else
+					reg[r] = operand;
+				break;
+			case ADD:
+			case SUB:
+			case AND:
+			case OR:
+			case XOR:
+				if (reg[0].known && operand.known) {
+					int result = accumulatorResult(i.opCode, reg[0].value, operand.value); //folded value
+					remove = result == reg[0].value;
+					if (!remove) {
+						i.opCode = LD;
+						i.addressMode = Immediate;
+						i.EA = result;
+						folded++;
+						changed = true;
+					}
+					reg[0] = { true, result, -1 };
+				}
+				else if (operand.known && operand.value == (i.opCode == AND ? -1 : 0))
+					remove = true;
+				else if (reg[0].known && reg[0].value == 0 && (i.opCode == ADD || i.opCode == OR || i.opCode == XOR)) {
+					i.opCode = LD;
+					folded++;
+					changed = true;
+					reg[0] = operand;
+				}
+				else
+					reg[0] = UNKNOWN_VALUE;
+				if (remove)
+					loads += k != last;
+				break;
+			case COM:
+				if (reg[0].known) {
+					i.opCode = LD;
+					i.addressMode = Immediate;
+					i.EA = ~reg[0].value;
+					folded++;
+					changed = true;
+					reg[0] = { true, i.EA, -1 };
+				}
+				else
+					reg[0] = UNKNOWN_VALUE;
+				break;
+			case CLR:
+			case CLRX:
+				remove = reg[r].known && reg[r].value == 0;
+				if (remove)
+					loads += k != last;
+				else
+					reg[r] = { true, 0, -1 };
+				break;
+			case ADDX:
+			case SUBX:
+				remove = operand.known && operand.value == 0;
+				if (remove)
+					loads += k != last;
+				else if (reg[r].known && operand.known)
+					reg[r] = { true, indexResult(i.opCode, reg[r].value, operand.value), -1 };
+				else
+					reg[r] = UNKNOWN_VALUE;
+				break;
+			case ST:
+			case STX:
+				remove = !isVolatile(i.EA) && sameValue(reg[r], word(i.EA));
+				if (remove)
+					stores += k != last;
+				else {
+					forget(i.EA);
+					if (!isVolatile(i.EA)) {
+						if (reg[r].known)
+							words[i.EA] = reg[r].value;
+						reg[r].copyOf = i.EA;
+					}
+				}
+				break;
+			case EM:
+			case EMX:
+			{
+				knownValue old = reg[r]; //register before the exchange
+				reg[r] = word(i.EA);
+				reg[r].copyOf = -1;
+				forget(i.EA);
+				if (old.known && !isVolatile(i.EA))
+					words[i.EA] = old.value;
+				break;
+			}
+			default:
+				//NOP and jumps change nothing
+				break;
+			}
+			//the last instruction stays, so the program still ends in the same place
+			if (remove && k != last) {
+				removed[k] = true;
+				changed = true;
+			}
+		}
+	}
+	return changed;
+}
+
+/************************************************************************
+Function: threadJumps
+Author: Jake Davidson
+Description: Removes NOPs, then follows each jump through any J at its
+target to the final target, and removes jumps that go to the instruction
+they would fall through to anyway.
+Returns: true if the program was changed
+************************************************************************/
+bool Optimizer::threadJumps() {
+	bool changed = false; //true once an instruction is removed or retargeted
+	int n = (int)program.size(); //instructions in the program
+	//first instruction at or after k that is not removed, the last instruction is never removed
+	auto kept = [&](int k) {
+		while (removed[k])
+			k++;
+		return k;
+	};
+	for (int k = 0; k + 1 < n; k++) {
+		if (program[k].opCode == NOP) {
+			removed[k] = true;
+			nops++;
+			changed = true;
+		}
+	}
+	for (int k = 0; k < n; k++) {
+		if (target[k] < 0 || removed[k])
+			continue;
+		set<int> seen = { k }; //jumps followed, to stop at loops of jumps
+		int t = kept(target[k]); //final target
+		while (program[t].opCode == J && target[t] >= 0 && seen.insert(t).second)
+			t = kept(target[t]);
+		if (program[t].instructionAddress != (unsigned int)program[k].EA) {
+			program[k].EA = program[t].instructionAddress;
+			target[k] = t;
+			retargeted++;
+			changed = true;
+		}
+		if (k + 1 < n && kept(k + 1) == t) {
+			removed[k] = true;
+			jumps++;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+/************************************************************************
+Function: removeDeadCode
+Author: Jake Davidson
+Description: Finds the registers and memory words live at the start of
+each basic block, iterating until nothing changes, then removes each
+instruction whose results are all overwritten before they are used.
+Everything is live where the machine may halt, including falling off the
+end of the program.
+Returns: true if the program was changed
+************************************************************************/
+bool Optimizer::removeDeadCode() {
+	int n = (int)program.size(); //instructions in the program
+	int blocks = (int)blockStart.size() - 1; //basic blocks in the program
+	vector<int> blockOf(n); //block of each instruction
+	vector<liveSet> liveIn(blocks); //live at the start of each block
+	bool changed = true; //true while liveIn changes
+	for (int b = 0; b < blocks; b++) {
+		for (int k = blockStart[b]; k < blockStart[b + 1]; k++)
+			blockOf[k] = b;
+	}
+
+	//live at the end of a block, from its successors
+	auto liveOut = [&](int b) {
+		int k = blockStart[b + 1] - 1; //last instruction of the block
+		liveSet live; //live after it
+		if (effectsOf(program[k], target[k] >= 0, devices).halts)
+			live.set();
+		if (target[k] >= 0)
+			live |= liveIn[blockOf[target[k]]];
+		if (program[k].opCode != J) {
+			if (k + 1 < n)
+				live |= liveIn[blockOf[k + 1]];
+			else
+				live.set();
+		}
+		return live;
+	};
+	//moves live from after instruction k to before it, removing k if its results are unused
+	auto transfer = [&](int k, liveSet &live, bool removeDead) {
+		instructionEffects e = effectsOf(program[k], target[k] >= 0, devices); //what k reads and writes
+		bool unused = !e.fixed && (e.memoryWritten == -1 || !live[e.memoryWritten]); //true if nothing k writes is live
+		if (e.halts) {
+			live.set();
+			return false;
+		}
+		for (int r = 0; r < 5; r++) {
+			if ((e.registersWritten >> r) & 1)
+				unused = unused && !live[LIVE_AC + r];
+		}
+		if (unused && removeDead && k != n - 1) {
+			removed[k] = true;
+			dead++;
+			return true;
+		}
+		for (int r = 0; r < 5; r++) {
+			if ((e.registersWritten >> r) & 1)
+				live.reset(LIVE_AC + r);
+		}
+		if (e.memoryWritten != -1)
+			live.reset(e.memoryWritten);
+		for (int r = 0; r < 5; r++) {
+			if ((e.registersRead >> r) & 1)
+				live.set(LIVE_AC + r);
+		}
+		if (e.memoryRead != -1)
+			live.set(e.memoryRead);
+		return false;
+	};
+
+	while (changed) {
+		changed = false;
+		for (int b = blocks - 1; b >= 0; b--) {
+			liveSet live = liveOut(b); //live as the block is walked backwards
+			for (int k = blockStart[b + 1] - 1; k >= blockStart[b]; k--)
+				transfer(k, live, false);
+			if (live != liveIn[b]) {
+				liveIn[b] = live;
+				changed = true;
+			}
+		}
+	}
+
+	for (int b = 0; b < blocks; b++) {
+		liveSet live = liveOut(b); //live as the block is walked backwards
+		for (int k = blockStart[b + 1] - 1; k >= blockStart[b]; k--)
+			changed = transfer(k, live, true) || changed;
+	}
+	return changed;
+}
+
+/************************************************************************
+Function: apply
+Author: Jake Davidson
+Description: Removes the instructions marked for removal. Each is
+replaced by the next instruction kept, which jumps to it and the
+instruction register are moved to, and which is recorded against its
+address.
+************************************************************************/
+void Optimizer::apply() {
+	int n = (int)program.size(); //instructions in the program
+	vector<int> successor(n); //instruction executed in place of each one
+	vector<instruction> kept; //instructions not removed
+	int start = (int)(instructionRegister - program.begin()); //index of the start instruction
+	if (find(removed.begin(), removed.end(), true) == removed.end())
+		return;
+	for (int k = n - 1; k >= 0; k--)
+		successor[k] = removed[k] ? successor[k + 1] : k;
+	for (int k = 0; k < n; k++) {
+		if (removed[k]) {
+			replaced[program[k].instructionAddress] = program[successor[k]].instructionAddress;
+			continue;
+		}
+		if (target[k] >= 0 && removed[target[k]])
+			program[k].EA = program[successor[target[k]]].instructionAddress;
+		kept.push_back(program[k]);
+	}
+	start = successor[start];
+	start -= (int)count(removed.begin(), removed.begin() + start, true);
+	program = move(kept);
+	instructionRegister = program.begin() + start;
+}
+
+/************************************************************************
+Function: executedAddress
+Author: Jake Davidson
+Description: Finds the instruction that runs in place of an address,
+following removed instructions to the one kept.
+Parameters: address - original address
+Returns: address of the instruction executed for it
+************************************************************************/
+unsigned int Optimizer::executedAddress(unsigned int address) {
+	map<unsigned int, unsigned int>::iterator it; //removed instruction at address
+	while ((it = replaced.find(address)) != replaced.end())
+		address = it->second;
+	return address;
+}
+
+/************************************************************************
+Function: printSummary
+Author: Jake Davidson
+Description: Prints how many instructions were removed and rewritten,
+and the original address of each removed instruction with the address
+executed in its place.
+Parameters: out - stream to print to
+************************************************************************/
+void Optimizer::printSummary(ostream &out) {
+	out << dec << "Optimized program: " << originalSize << " -> " << program.size() << " instructions ("
+		<< nops << " NOPs, " << loads << " redundant loads, " << stores << " redundant stores, "
+		<< dead << " dead, " << jumps << " jumps removed; " << folded << " folded, "
+		<< retargeted << " jumps retargeted)" << endl;
+	if (replaced.empty())
+		return;
+	out << "Removed instructions (address -> executed instead):";
+	for (auto &r : replaced)
+		out << " " << hex << setw(3) << setfill('0') << r.first << "->" << setw(3) << this->executedAddress(r.first);
+	out << endl;
+}
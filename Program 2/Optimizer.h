@@ -0,0 +1,62 @@
+//Peephole and dataflow optimization of the decoded program. With --optimize the
+//instructions vector is rewritten after readInstructions and before execution,
+//so the machine dispatches fewer instructions:
+//
+//  - NOPs are removed, jumps to jumps are retargeted to the final target and
+//    jumps to the next instruction are removed
+//  - within each basic block the values of AC, X0-X3 and memory words are
+//    followed, so loads of a value a register already holds and stores of a
+//    value memory already holds are removed, and operations on known values
+//    are folded into an immediate LD (CLR then ADD becomes LD)
+//  - liveness of AC, X0-X3 and every memory word over the whole program
+//    removes instructions whose results are never used, such as a store
+//    that is overwritten before it is read
+//
+//Every EA is fixed when the program is decoded, so every memory access and
+//jump target is known here. Instructions that may halt the machine are never
+//removed, and all registers and memory are treated as used when it halts, so
+//an optimized program halts the same way with the same registers and memory.
+//
+//Instructions keep their original address and hex string, so trace lines and
+//halts report the original PCs. A removed instruction is recorded with the
+//address of the instruction now executed in its place, and jumps to it and a
+//start address on it are moved there.
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include "const.h"
+#include "Devices.h"
+
+using namespace std;
+
+class Optimizer {
+public:
+	//optimizes program, moving instructionRegister with it. Words of devices (nullptr for none) are left alone
+	Optimizer(vector<instruction> &program, vector<instruction>::iterator &instructionRegister, DeviceBus *devices);
+	bool optimize(); //optimize the program, false if it cannot be optimized
+	void printSummary(ostream &out); //print what was changed
+	unsigned int executedAddress(unsigned int address); //address executed in place of an original address
+private:
+	bool propagateValues(); //remove redundant loads and stores and fold constants within blocks
+	bool threadJumps(); //remove NOPs and jumps to the next instruction, retarget jump chains
+	bool removeDeadCode(); //remove instructions whose results are never used
+	void findBlocks(); //find jump targets and basic blocks of the current program
+	void apply(); //remove the marked instructions, moving jumps and the instruction register
+	bool isVolatile(int address); //true for words the optimizer must not reason about
+	vector<instruction> &program; //program being optimized
+	vector<instruction>::iterator &instructionRegister; //start instruction
+	DeviceBus *devices; //devices whose words are left alone, nullptr for none
+	vector<bool> removed; //instructions marked for removal
+	vector<int> target; //index of the target of each jump, -1 if it is not a valid jump
+	vector<int> blockStart; //first instruction of each basic block, then the end of the program
+	map<unsigned int, unsigned int> replaced; //address of each removed instruction, and the address executed instead
+	int originalSize; //instructions before optimizing
+	int nops, loads, stores, dead, jumps; //instructions removed, by reason
+	int folded, retargeted; //instructions rewritten, by reason
+};
+
+#endif
@@ -0,0 +1,231 @@
+#include "PipelineModel.h"
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include "Semantics.h"
+#include "globals.h"
+
+//cycles after ID of the stages an operand can be needed in
+const int EX_STAGE = 1;
+const int MEM_STAGE = 2;
+
+//names of the predictors and stall causes, for the report
+const char *PREDICTOR_NAMES[] = { "static", "1bit", "2bit" };
+const char *STALL_NAMES[STALL_CAUSES] = { "AC data hazards", "index register data hazards", "block instructions in MEM",
+	"taken jumps", "mispredicted jumps" };
+
+/************************************************************************
+Function: PipelineModel
+Author: Jake Davidson
+Description: Constructs an empty pipeline, the first instruction is
+fetched in cycle 1.
+Parameters: predictor - jump predictor to use
+			forwarding - true if results are forwarded
+************************************************************************/
+PipelineModel::PipelineModel(predictorKind predictor, bool forwarding)
+	: predictor(predictor), forwarding(forwarding), instructions(0), cycles(0), lastDecode(0), nextFetch(1), memoryFree(0),
+	jumps(0), conditional(0), taken(0), correct(0), memoryDependences(0)
+{
+	memset(produced, 0, sizeof(produced));
+	memset(written, 0, sizeof(written));
+	memset(stalls, 0, sizeof(stalls));
+	memset(storedAddress, 0xff, sizeof(storedAddress));
+	//1-bit entries start not taken, 2-bit counters weakly not taken
+	memset(table, predictor == TWO_BIT_PREDICTOR ? 1 : 0, sizeof(table));
+}
+
+/************************************************************************
+Function: predict
+Author: Jake Davidson
+Description: Predicts whether a conditional jump is taken.
+Parameters: i - the jump
+Returns: true if it is predicted taken
+************************************************************************/
+bool PipelineModel::predict(const instruction &i) {
+	unsigned char entry = table[i.instructionAddress % PREDICTOR_ENTRIES]; //predictor state of the jump
+	switch (predictor) {
+	case STATIC_PREDICTOR:
+		return (unsigned int)i.EA <= i.instructionAddress;
+	case ONE_BIT_PREDICTOR:
+		return entry != 0;
+	default:
+		return entry >= 2;
+	}
+}
+
+/************************************************************************
+Function: train
+Author: Jake Davidson
+Description: Updates the predictor entry of a conditional jump with its
+outcome.
+Parameters: i - the jump
+			outcome - true if it was taken
+************************************************************************/
+void PipelineModel::train(const instruction &i, bool outcome) {
+	unsigned char &entry = table[i.instructionAddress % PREDICTOR_ENTRIES]; //predictor state of the jump
+	if (predictor == ONE_BIT_PREDICTOR)
+		entry = outcome ? 1 : 0;
+	else if (predictor == TWO_BIT_PREDICTOR && outcome)
+		entry = min(entry + 1, 3);
+	else if (predictor == TWO_BIT_PREDICTOR && entry > 0)
+		entry--;
+}
+
+/************************************************************************
+Function: require
+Author: Jake Davidson
+Description: Delays leaving ID until a register will be ready for the
+stage that uses it. With forwarding that is the cycle after the value is
+produced, without it the register must have been written back.
+Parameters: location - 0 for AC, 1-4 for X0-X3
+			stage - cycles after ID of the stage using the register
+			decode - cycle the instruction leaves ID in, delayed if needed
+			cause - set to the register's stall cause if it delays decode
+************************************************************************/
+void PipelineModel::require(int location, int stage, uint64_t &decode, stallCause &cause) {
+	uint64_t ready = forwarding ? produced[location] + 1 : written[location] + stage; //first cycle the stage can use it
+	if (ready > decode + stage) {
+		decode = ready - stage;
+		cause = location == 0 ? STALL_AC : STALL_INDEX;
+	}
+}
+
+/************************************************************************
+Function: record
+Author: Jake Davidson
+Description: Times an executed instruction. It leaves ID once it has
+been fetched, the instruction before it has moved on, its registers will
+be ready and MEM will be free, then its results are produced and written
+back. A jump then decides when the next instruction is fetched.
+Parameters: i - the instruction
+			jumped - true if it jumped
+			length - words of a block instruction
+************************************************************************/
+void PipelineModel::record(const instruction &i, bool jumped, int length) {
+	opCodes op = i.opCode;
+	int x = 1 + i.indexRegister; //location of the instruction's index register
+	bool memoryOperand = readsMemory(op, i.addressMode); //true if it uses memory[EA] in MEM
+	int operandStage = memoryOperand ? MEM_STAGE : EX_STAGE; //stage arithmetic is done in
+	uint64_t earliest = max(lastDecode + 1, nextFetch + 1); //cycle it could leave ID without stalling
+	uint64_t decode = earliest; //cycle it leaves ID
+	uint64_t memoryEnd, result; //last cycle in MEM, cycle its result is produced in
+	stallCause cause = STALL_AC; //cause of the stall in ID, if any
+
+	instructions++;
+	if (op == ADD || op == SUB || op == AND || op == OR || op == XOR || op == COM)
+		this->require(0, operandStage, decode, cause);
+	if (op == JZ || op == JN || op == JP)
+		this->require(0, EX_STAGE, decode, cause);
+	if (op == ST || op == EM || op == BFIL || op == BSUM)
+		this->require(0, MEM_STAGE, decode, cause);
+	if (op == ADDX || op == SUBX)
+		this->require(x, operandStage, decode, cause);
+	if (op == STX || op == EMX)
+		this->require(x, MEM_STAGE, decode, cause);
+	//block instructions compute their addresses from X0-X2 in EX
+	if (isBlockOp(op)) {
+		this->require(1, EX_STAGE, decode, cause);
+		if (op != BFIL)
+			this->require(2, EX_STAGE, decode, cause);
+		if (op != BSUM)
+			this->require(3, EX_STAGE, decode, cause);
+	}
+	if (memoryFree > decode + MEM_STAGE) {
+		decode = memoryFree - MEM_STAGE;
+		cause = STALL_BLOCK;
+	}
+	stalls[cause] += decode - earliest;
+
+	memoryEnd = decode + MEM_STAGE + (isBlockOp(op) && length > 1 ? length - 1 : 0);
+	result = memoryOperand || op == BSUM ? memoryEnd : decode + EX_STAGE;
+	if (op == LD || op == EM || op == ADD || op == SUB || op == CLR || op == COM || op == AND || op == OR || op == XOR || op == BSUM) {
+		produced[0] = result;
+		written[0] = memoryEnd + 1;
+	}
+	if (op == LDX || op == EMX || op == ADDX || op == SUBX || op == CLRX) {
+		produced[x] = result;
+		written[x] = memoryEnd + 1;
+	}
+	//a load of a word one of the last three instructions stored is in order in MEM
+	if (memoryOperand && find(storedAddress, storedAddress + 3, (unsigned int)i.EA) != storedAddress + 3)
+		memoryDependences++;
+	storedAddress[2] = storedAddress[1];
+	storedAddress[1] = storedAddress[0];
+	storedAddress[0] = writesMemory(op, i.addressMode) ? (unsigned int)i.EA : ~0u;
+	memoryFree = memoryEnd + 1;
+	cycles = memoryEnd + 1;
+	lastDecode = decode;
+
+	//the next instruction is fetched while this one is decoded, unless fetch is redirected
+	nextFetch = decode;
+	if (op == J) {
+		jumps++;
+		nextFetch = decode + 1;
+		stalls[STALL_TAKEN]++;
+	}
+	else if (op == JZ || op == JN || op == JP) {
+		jumps++;
+		conditional++;
+		if (jumped)
+			taken++;
+		if (this->predict(i) != jumped) {
+			//resolved at the end of EX
+			nextFetch = decode + 2;
+			stalls[STALL_MISPREDICT] += 2;
+		}
+		else {
+			correct++;
+			if (jumped) {
+				nextFetch = decode + 1;
+				stalls[STALL_TAKEN]++;
+			}
+		}
+		this->train(i, jumped);
+	}
+}
+
+/************************************************************************
+Function: printReport
+Author: Jake Davidson
+Description: Prints the cycles taken, the CPI, the stall cycles of each
+cause and the accuracy of the jump predictor.
+Parameters: out - stream to print to
+************************************************************************/
+void PipelineModel::printReport(ostream &out) {
+	uint64_t stalled = 0; //stall cycles of every cause
+	for (int c = 0; c < STALL_CAUSES; c++)
+		stalled += stalls[c];
+	out << setfill(' ') << dec << "Pipeline model (five stages, " << (forwarding ? "forwarding" : "no forwarding") << ", "
+		<< PREDICTOR_NAMES[predictor] << " jump prediction)" << endl;
+	out << "Instructions: " << instructions << endl;
+	out << "Cycles:       " << cycles << endl;
+	out << fixed << setprecision(2);
+	out << "CPI:          " << (instructions ? (double)cycles / instructions : 0.0) << endl;
+	out << "Stall cycles: " << stalled << " (" << (cycles ? 100.0 * stalled / cycles : 0.0) << "% of cycles)" << endl;
+	for (int c = 0; c < STALL_CAUSES; c++)
+		out << "  " << left << setw(30) << STALL_NAMES[c] << right << setw(14) << stalls[c] << endl;
+	out << "Memory dependences: " << memoryDependences << " (loads of words just stored, in order in MEM, no stall)" << endl;
+	out << "Jumps: " << jumps << ", conditional: " << conditional << ", taken: " << taken << endl;
+	out << "Prediction accuracy: " << correct << " of " << conditional;
+	if (conditional > 0)
+		out << " (" << 100.0 * correct / conditional << "%)";
+	out << endl << defaultfloat;
+}
+
+/************************************************************************
+Function: parsePredictor
+Author: Jake Davidson
+Description: Finds the predictor with a name.
+Parameters: name - static, 1bit or 2bit
+			predictor - set to the predictor
+Returns: false if there is no predictor with the name
+************************************************************************/
+bool parsePredictor(string name, predictorKind &predictor) {
+	for (int p = STATIC_PREDICTOR; p <= TWO_BIT_PREDICTOR; p++) {
+		if (name == PREDICTOR_NAMES[p]) {
+			predictor = (predictorKind)p;
+			return true;
+		}
+	}
+	return false;
+}
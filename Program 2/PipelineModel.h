@@ -0,0 +1,84 @@
+//Pipeline model. With --pipeline <predictor> the program runs as usual, trace
+//and all, while every executed instruction is also timed on a model of a
+//classic five-stage B17 pipeline:
+//
+//    IF  fetch            ID  decode, read registers, predict jumps
+//    EX  ALU and index    MEM memory[EA], ALU on a memory operand
+//    WB  write registers
+//
+//The model only times the instructions the functional machine executed, in the
+//order it executed them, so results are exactly those of a plain run.
+//
+//Data hazards: an instruction needs AC or its index register at the start of
+//the stage using it: EX for jump conditions and arithmetic on an immediate,
+//MEM for arithmetic on a memory operand and the value a store or exchange
+//writes. A result is produced at the end of EX (immediate and register-only
+//instructions) or of MEM (anything reading memory[EA]). With forwarding a
+//result can be used in the cycle after it is produced; with --no-forwarding
+//only once it has been written back (written in the first half of WB, read in
+//the second half of ID). The instruction waits in ID until its operands will
+//be ready. Memory is only accessed in MEM, in
+//program order, so a load of a word stored just before it is a memory
+//dependence that is counted but never stalls. EAs are fixed when the program is
+//decoded, so there are no address hazards.
+//
+//Control hazards: J and jumps predicted taken redirect fetch at the end of ID,
+//one bubble. Conditional jumps are resolved at the end of EX, a misprediction
+//costs two bubbles. The predictor is a table of PREDICTOR_ENTRIES entries
+//indexed by the jump's address:
+//    static  backward taken, forward not taken
+//    1bit    the last outcome of the jump
+//    2bit    a saturating counter of outcomes
+//
+//A block instruction (BlockOps.h) holds MEM for one cycle per word, stalling
+//the instruction behind it. The report gives the cycles and CPI, stall cycles by
+//cause and the accuracy of the predictor.
+#ifndef PIPELINEMODEL_H
+#define PIPELINEMODEL_H
+
+#include <string>
+#include <iostream>
+#include <cstdint>
+#include "const.h"
+
+using namespace std;
+
+//entries in the jump predictor table
+const int PREDICTOR_ENTRIES = 1024;
+
+//jump predictors
+enum predictorKind { STATIC_PREDICTOR, ONE_BIT_PREDICTOR, TWO_BIT_PREDICTOR };
+
+//reasons the pipeline loses cycles
+enum stallCause { STALL_AC, STALL_INDEX, STALL_BLOCK, STALL_TAKEN, STALL_MISPREDICT, STALL_CAUSES };
+
+class PipelineModel {
+public:
+	PipelineModel(predictorKind predictor, bool forwarding);
+	//time an instruction the machine has executed, length words for a block instruction
+	void record(const instruction &i, bool jumped, int length);
+	void printReport(ostream &out); //print the CPI, stalls and prediction accuracy
+private:
+	bool predict(const instruction &i); //true if a conditional jump is predicted taken
+	void train(const instruction &i, bool taken); //update the predictor with an outcome
+	void require(int location, int stage, uint64_t &decode, stallCause &cause); //wait in ID for a register
+	predictorKind predictor; //predictor used
+	bool forwarding; //true if results are forwarded
+	unsigned long long instructions; //instructions timed
+	uint64_t cycles; //cycle the last instruction was written back in
+	uint64_t lastDecode; //cycle the previous instruction left ID in
+	uint64_t nextFetch; //cycle the next instruction is fetched in
+	uint64_t memoryFree; //first cycle MEM is free in
+	uint64_t produced[5]; //cycle AC and X0-X3 are produced in, at the end of the cycle
+	uint64_t written[5]; //cycle AC and X0-X3 are written back in
+	uint64_t stalls[STALL_CAUSES]; //cycles lost for each cause
+	unsigned long long jumps, conditional, taken, correct; //jumps, conditional jumps, those taken and predicted correctly
+	unsigned long long memoryDependences; //loads of a word stored by one of the previous instructions in the pipeline
+	unsigned int storedAddress[3]; //words stored by the last three instructions, ~0 for none
+	unsigned char table[PREDICTOR_ENTRIES]; //last outcome or counter of each entry
+};
+
+//parses a predictor name (static, 1bit or 2bit), false if it is not one
+bool parsePredictor(string name, predictorKind &predictor);
+
+#endif
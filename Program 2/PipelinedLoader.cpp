@@ -0,0 +1,192 @@
+#include "PipelinedLoader.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include "globals.h"
+#include "Loader.h"
+
+/************************************************************************
+Function: PipelinedLoader
+Author: Jake Davidson
+Description: Constructs a loader, call start to begin loading.
+************************************************************************/
+PipelinedLoader::PipelinedLoader() : startAddress(0), published(0), done(false), waiting(0), cancelled(false) {
+}
+
+/************************************************************************
+Function: ~PipelinedLoader
+Author: Jake Davidson
+Description: Stops the producer, which may still be decoding if the
+machine halted early.
+************************************************************************/
+PipelinedLoader::~PipelinedLoader() {
+	this->stop();
+}
+
+/************************************************************************
+Function: start
+Author: Jake Davidson
+Description: Maps the object file, reads the start address from its last
+line and reserves room for every instruction, then starts the producer
+and waits for the instruction at the start address, which is placed in
+the instruction register. Halts like readInstructions if there are no
+instructions or none at the start address.
+Parameters: file - the object file to load
+Returns: false if the file could not be opened
+************************************************************************/
+bool PipelinedLoader::start(string file) {
+	size_t total = 0; //instructions in the file, from the count of each line
+	vector<string> startLine; //fields of the last line
+	if (!object.open(file))
+		return false;
+	const char *data = object.data();
+	size_t end = object.size(), begin; //last line of the file
+
+	//the start address is on the last line, find it from the end
+	while (end > 0 && (data[end - 1] == '\n' || data[end - 1] == '\r'))
+		end--;
+	begin = end;
+	while (begin > 0 && data[begin - 1] != '\n')
+		begin--;
+	startLine = splitString(string(data + begin, end - begin));
+	if (startLine.size() != 1) {
+		cout << "Machine Halted - object file does not end with a start address" << endl;
+		exit(0);
+	}
+	startAddress = stol(startLine[0], nullptr, 16);
+
+	//sum the count field (second field) of every line, without decoding anything
+	for (const char *line = data; line < data + object.size();) {
+		const char *newline = (const char *)memchr(line, '\n', data + object.size() - line);
+		const char *lineEnd = newline ? newline : data + object.size();
+		const char *space = (const char *)memchr(line, ' ', lineEnd - line);
+		if (space)
+			total += strtoul(space + 1, nullptr, 10);
+		line = lineEnd + 1;
+	}
+	if (total == 0) {
+		cout << "Machine Halted - No instructions to execute";
+		exit(0);
+	}
+
+	//decode with memory and the index registers as they are before execution
+	image.assign(memory, memory + 4096);
+	index[0] = X0;
+	index[1] = X1;
+	index[2] = X2;
+	index[3] = X3;
+	instructions.clear();
+	instructions.reserve(total);
+	producer = thread(&PipelinedLoader::produce, this);
+
+	if (!this->waitForAddress(startAddress, instructionRegister)) {
+		cout << "Machine Halted - no instruction at start address" << endl;
+		this->stop();
+		exit(0);
+	}
+	return true;
+}
+
+/************************************************************************
+Function: produce
+Author: Jake Davidson
+Description: Decodes the object file line by line, the same way as
+readInstructions, publishing the instructions of each line as soon as
+they are in the instructions vector.
+************************************************************************/
+void PipelinedLoader::produce() {
+	const char *data = object.data();
+	vector<string> instructionList; //fields of the current line
+	int num; //number of instructions on the current line
+	unsigned int address; //address of the current instruction
+	for (const char *line = data; line < data + object.size() && !cancelled;) {
+		const char *newline = (const char *)memchr(line, '\n', data + object.size() - line);
+		const char *lineEnd = newline ? newline : data + object.size();
+		instructionList = splitString(string(line, lineEnd - line));
+		line = lineEnd + 1;
+		//the start address line has already been read
+		if (instructionList.size() == 1)
+			continue;
+		num = stoi(instructionList.at(1));
+		address = stol(instructionList[0], nullptr, 16);
+		for (int i = 0; i < num && instructions.size() < instructions.capacity(); i++)
+			instructions.push_back(decodeInstruction(instructionList.at(i + 2), address++, image.data(), index));
+		published = instructions.size();
+		//only take the lock if the machine is waiting for an instruction
+		if (waiting > 0) {
+			lock_guard<mutex> guard(lock);
+			decoded.notify_all();
+		}
+	}
+	lock_guard<mutex> guard(lock);
+	done = true;
+	decoded.notify_all();
+}
+
+/************************************************************************
+Function: stop
+Author: Jake Davidson
+Description: Stops the producer after the line it is decoding, so a 
+program that halts early does not wait for the rest of the file.
+************************************************************************/
+void PipelinedLoader::stop() {
+	cancelled = true;
+	if (producer.joinable())
+		producer.join();
+}
+
+/************************************************************************
+Function: waitForCount
+Author: Jake Davidson
+Description: Waits until at least count instructions are published. The
+producer only signals when waiting is non-zero, which is safe because
+both sides update their atomic before reading the other's.
+Parameters: count - instructions needed
+Returns: false if the file has fewer instructions
+************************************************************************/
+bool PipelinedLoader::waitForCount(size_t count) {
+	if (published >= count)
+		return true;
+	unique_lock<mutex> guard(lock);
+	waiting++;
+	decoded.wait(guard, [&]() { return published >= count || done; });
+	waiting--;
+	return published >= count;
+}
+
+/************************************************************************
+Function: waitForNext
+Author: Jake Davidson
+Description: Finds the instruction after it in the program, waiting for
+it to be decoded.
+Parameters: it - current instruction
+			next - set to the next instruction
+Returns: false if it is the last instruction
+************************************************************************/
+bool PipelinedLoader::waitForNext(vector<instruction>::iterator it, vector<instruction>::iterator &next) {
+	//only the beginning of the vector is used, its end moves as the producer appends
+	size_t position = (it - instructions.begin()) + 1; //index of the next instruction
+	if (!this->waitForCount(position + 1))
+		return false;
+	next = instructions.begin() + position;
+	return true;
+}
+
+/************************************************************************
+Function: waitForAddress
+Author: Jake Davidson
+Description: Finds the first instruction with an address, like a jump
+does, waiting for each instruction in turn to be decoded.
+Parameters: address - address to find
+			target - set to the instruction found
+Returns: false if no instruction has the address
+************************************************************************/
+bool PipelinedLoader::waitForAddress(unsigned int address, vector<instruction>::iterator &target) {
+	for (size_t position = 0; this->waitForCount(position + 1); position++) {
+		if (instructions.begin()[position].instructionAddress == address) {
+			target = instructions.begin() + position;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,53 @@
+//Pipelined loading. With --stream the object file is decoded by a producer
+//thread while the machine runs, instead of being decoded completely first.
+//The start address is read first by scanning backwards from the end of the
+//file, and the instruction count of each line is summed so the instructions
+//vector can be reserved once: the producer then appends without ever moving
+//an instruction, and the machine may use any instruction it has published.
+//
+//Falling through to the next instruction or jumping to an address that has not
+//been decoded yet waits for the producer to reach it. Indirect and indexed EAs
+//are decoded from a copy of memory and the index registers taken before the
+//machine starts, so they are the same as when the whole file is read first.
+#ifndef PIPELINEDLOADER_H
+#define PIPELINEDLOADER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "const.h"
+#include "MappedFile.h"
+
+using namespace std;
+
+class PipelinedLoader {
+public:
+	PipelinedLoader();
+	~PipelinedLoader();
+	bool start(string file); //start decoding file into the instructions vector, false if it cannot be read
+	void stop(); //stop decoding, once the machine has halted
+	bool finished() { return done.load(); } //true once every instruction has been published
+	//waits for the instruction after it, false if it is the last instruction of the program
+	bool waitForNext(vector<instruction>::iterator it, vector<instruction>::iterator &next);
+	//waits for the first instruction with address, false if the program has none
+	bool waitForAddress(unsigned int address, vector<instruction>::iterator &target);
+private:
+	void produce(); //decode every line of the file, publishing as it goes
+	bool waitForCount(size_t count); //wait until count instructions are published, false if there will not be
+	MappedFile object; //the object file
+	unsigned int startAddress; //address execution starts at, from the last line
+	vector<int> image; //memory before execution, for indirect EAs
+	int index[4]; //index registers before execution, for indexed EAs
+	thread producer; //decodes the file
+	atomic<size_t> published; //instructions the machine may use
+	atomic<bool> done; //true once the producer has published everything
+	atomic<int> waiting; //machines waiting for the producer
+	atomic<bool> cancelled; //set to stop the producer early
+	mutex lock; //protects waiting on decoded
+	condition_variable decoded; //signalled when instructions are published while someone waits
+};
+
+#endif
@@ -0,0 +1,225 @@
+#include "ProgramImage.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include "globals.h"
+#include "Loader.h"
+#include "MappedFile.h"
+#include "BlockOps.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(programImageHeader) == 40, "image header layout changed, increase PROGRAM_IMAGE_VERSION");
+static_assert(sizeof(programImageRecord) == 20, "image record layout changed, increase PROGRAM_IMAGE_VERSION");
+
+//first bytes of every image
+static const char IMAGE_MAGIC[4] = { 'B', '1', '7', 'C' };
+
+/************************************************************************
+Function: hashBytes
+Author: Jake Davidson
+Description: Hashes bytes with 64-bit FNV-1a, used for the object file
+hash and the image checksum.
+Parameters: data - bytes to hash
+			size - number of bytes
+			hash - hash of any bytes before these, to continue it
+Returns: the hash
+************************************************************************/
+static uint64_t hashBytes(const char *data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+	for (size_t n = 0; n < size; n++) {
+		hash ^= (unsigned char)data[n];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/************************************************************************
+Function: readImage
+Author: Jake Davidson
+Description: Maps an image and, if it is valid for the object file,
+fills the instructions vector from it and sets the instruction register
+to the start instruction. EAs are calculated from memory and the index
+registers as they are now.
+Parameters: path - image file
+			sourceHash - hash of the object file
+			sourceSize - size of the object file
+Returns: false if the image is missing, stale or corrupt, leaving the
+instructions vector empty
+************************************************************************/
+static bool readImage(string path, uint64_t sourceHash, uint64_t sourceSize) {
+	MappedFile image; //the image file
+	programImageHeader header; //header of the image
+	programImageRecord record; //record being copied
+	int32_t first; //index entry of the start instruction's address
+	int index[4] = { X0, X1, X2, X3 }; //index registers used by indexed EAs
+	if (!image.open(path) || image.size() < sizeof(header))
+		return false;
+	memcpy(&header, image.data(), sizeof(header));
+	if (memcmp(header.magic, IMAGE_MAGIC, 4) != 0 || header.version != PROGRAM_IMAGE_VERSION
+		|| header.sourceHash != sourceHash || header.sourceSize != sourceSize
+		|| header.count == 0 || header.startIndex >= header.count
+		|| image.size() != sizeof(header) + (size_t)header.count * sizeof(record) + IMAGE_ADDRESSES * sizeof(first)
+		|| hashBytes(image.data() + sizeof(header), image.size() - sizeof(header)) != header.checksum)
+		return false;
+
+	const char *records = image.data() + sizeof(header); //first record
+	instructions.clear();
+	instructions.reserve(header.count);
+	for (uint32_t n = 0; n < header.count; n++) {
+		instruction i; //instruction being rebuilt
+		memcpy(&record, records + n * sizeof(record), sizeof(record));
+		if (record.opCode > UNDEFINED || record.addressMode > Illegal || record.indexRegister > 3
+			|| record.hexLength > IMAGE_HEX_CHARS || record.operandAddress >= IMAGE_ADDRESSES) {
+			instructions.clear();
+			return false;
+		}
+		i.instructionAddress = record.address;
+		i.operandAddress = record.operandAddress;
+		i.opCode = (opCodes)record.opCode;
+		i.addressMode = (addrModes)record.addressMode;
+		i.indexRegister = record.indexRegister;
+		i.instructionHexString.assign(record.hex, record.hexLength);
+		i.EA = effectiveAddress(i, memory, index);
+		instructions.push_back(i);
+	}
+
+	//the index must agree that the start instruction is the first at its address
+	memcpy(&first, records + header.count * sizeof(record) + instructions[header.startIndex].instructionAddress * sizeof(first), sizeof(first));
+	if (first != (int32_t)header.startIndex) {
+		instructions.clear();
+		return false;
+	}
+	instructionRegister = instructions.begin() + header.startIndex;
+	return true;
+}
+
+/************************************************************************
+Function: writeImage
+Author: Jake Davidson
+Description: Saves the decoded program as an image. Programs that cannot
+be described by an image (no instruction at the start address, an
+address outside memory or a hex string that is too long) are not saved.
+The image is written to a temporary file which is then renamed over any
+old image.
+Parameters: path - image file
+			object - the object file
+			sourceHash - hash of the object file
+Returns: false if the image could not be written
+************************************************************************/
+static bool writeImage(string path, MappedFile &object, uint64_t sourceHash) {
+	programImageHeader header = {}; //header of the image
+	vector<char> payload; //records and address index
+	vector<int32_t> addressIndex(IMAGE_ADDRESSES, -1); //first instruction at each address
+	string lastLine; //last line of the object file, the start address
+	unsigned int startAddress; //address execution starts at
+	const char *data = object.data();
+	size_t end = object.size(), begin; //last line of the file
+	stringstream temporary; //file the image is written to before it is renamed
+	ofstream fout; //stream to write the image to
+
+	//the start address is on the last line, as in readInstructions
+	while (end > 0 && (data[end - 1] == '\n' || data[end - 1] == '\r' || data[end - 1] == ' '))
+		end--;
+	begin = end;
+	while (begin > 0 && data[begin - 1] != '\n')
+		begin--;
+	lastLine = string(data + begin, end - begin);
+	if (splitString(lastLine).size() != 1)
+		return true;
+	startAddress = stoul(lastLine, nullptr, 16);
+
+	for (size_t n = 0; n < instructions.size(); n++) {
+		instruction &i = instructions[n];
+		programImageRecord record = {}; //record for i
+		if (i.instructionAddress >= (unsigned int)IMAGE_ADDRESSES || i.instructionHexString.size() > (size_t)IMAGE_HEX_CHARS)
+			return true;
+		record.address = i.instructionAddress;
+		record.operandAddress = i.operandAddress;
+		record.opCode = (uint8_t)i.opCode;
+		record.addressMode = (uint8_t)i.addressMode;
+		record.indexRegister = (uint8_t)i.indexRegister;
+		record.hexLength = (uint8_t)i.instructionHexString.size();
+		memcpy(record.hex, i.instructionHexString.data(), record.hexLength);
+		payload.insert(payload.end(), (char *)&record, (char *)&record + sizeof(record));
+		if (addressIndex[i.instructionAddress] == -1)
+			addressIndex[i.instructionAddress] = (int32_t)n;
+	}
+	if (startAddress >= (unsigned int)IMAGE_ADDRESSES || addressIndex[startAddress] == -1)
+		return true;
+	payload.insert(payload.end(), (char *)addressIndex.data(), (char *)(addressIndex.data() + IMAGE_ADDRESSES));
+
+	memcpy(header.magic, IMAGE_MAGIC, 4);
+	header.version = PROGRAM_IMAGE_VERSION;
+	header.sourceHash = sourceHash;
+	header.sourceSize = object.size();
+	header.count = (uint32_t)instructions.size();
+	header.startIndex = (uint32_t)addressIndex[startAddress];
+	header.checksum = hashBytes(payload.data(), payload.size());
+
+	temporary << path << "." << getpid() << ".tmp";
+	fout.open(temporary.str(), ios::binary);
+	fout.write((char *)&header, sizeof(header));
+	fout.write(payload.data(), payload.size());
+	fout.close();
+	if (!fout) {
+		remove(temporary.str().c_str());
+		return false;
+	}
+#ifdef _WIN32
+	remove(path.c_str());
+#endif
+	if (rename(temporary.str().c_str(), path.c_str()) != 0) {
+		remove(temporary.str().c_str());
+		return false;
+	}
+	return true;
+}
+
+/************************************************************************
+Function: loadCachedProgram
+Author: Jake Davidson
+Description: Loads an object file through the image cache. The object
+file is hashed, and the image named after the hash is used if it is
+valid. Otherwise the object file is decoded with readInstructions and a
+new image is saved for the next run. The directory is created if it does
+not exist.
+Parameters: file - the object file to load
+			directory - directory holding the images
+************************************************************************/
+void loadCachedProgram(string file, string directory) {
+	MappedFile object; //the object file
+	uint64_t hash; //hash of the object file
+	stringstream path; //image for the object file
+	if (!object.open(file)) {
+		cout << "Could not open object file, ensure the path is correct." << endl;
+		exit(0);
+	}
+	hash = hashBytes(object.data(), object.size());
+	//the extension decodes the same file differently, so it gets its own image
+	if (blockOpsEnabled)
+		hash = hashBytes("block-ops", 9, hash);
+	path << directory << "/" << hex << setw(16) << setfill('0') << hash << ".b17c";
+	if (readImage(path.str(), hash, object.size()))
+		return;
+
+	//no valid image, decode the text and save one
+	readInstructions(file);
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0777);
+#endif
+	if (!writeImage(path.str(), object, hash))
+		cout << "Could not save program image to " << directory << ", continuing without it." << endl;
+}
@@ -0,0 +1,58 @@
+//Predecoded program images. With --image-cache <directory> the decoded program
+//is saved as a binary image (.b17c) named after a content hash of the object
+//file, and later runs of the same object file map the image and copy its
+//records straight into the instructions vector instead of parsing the text.
+//
+//An image holds a header, one fixed size record per instruction and an index
+//of the first instruction at each address. The header carries a magic number,
+//a format version, the hash and size of the object file and a checksum of the
+//rest, so an image from another version, another object file or one that was
+//damaged is detected and rebuilt. Images are written to a temporary file and
+//renamed, so a run never sees half of one. They are in the byte order of the
+//machine that wrote them, and are only meant to be a local cache.
+//
+//Indexed and indirect EAs depend on memory and the index registers before the
+//machine starts (see --data), so they are not kept in the image but calculated
+//when it is loaded, the same way readInstructions does.
+#ifndef PROGRAMIMAGE_H
+#define PROGRAMIMAGE_H
+
+#include <string>
+#include <cstdint>
+#include "const.h"
+
+using namespace std;
+
+//format version, increase whenever the layout below or the opcode numbers change
+const uint32_t PROGRAM_IMAGE_VERSION = 2;
+//longest instruction hex string an image can hold
+const int IMAGE_HEX_CHARS = 8;
+//addresses covered by the address index
+const int IMAGE_ADDRESSES = 4096;
+
+//start of an image
+struct programImageHeader {
+	char magic[4]; //"B17C"
+	uint32_t version; //PROGRAM_IMAGE_VERSION
+	uint64_t sourceHash; //hash of the object file
+	uint64_t sourceSize; //size of the object file in bytes
+	uint32_t count; //instructions in the image
+	uint32_t startIndex; //position of the instruction execution starts at
+	uint64_t checksum; //hash of the records and address index
+};
+
+//one decoded instruction
+struct programImageRecord {
+	uint32_t address; //address of the instruction
+	uint32_t operandAddress; //operand address (or immediate value)
+	uint8_t opCode; //opCodes value
+	uint8_t addressMode; //addrModes value
+	uint8_t indexRegister; //index register specified
+	uint8_t hexLength; //characters used in hex
+	char hex[IMAGE_HEX_CHARS]; //hex string of the instruction, for the trace
+};
+
+//loads file into the instructions vector from the image cache in directory, decoding it and saving an image if there is no valid one
+void loadCachedProgram(string file, string directory);
+
+#endif
@@ -0,0 +1,486 @@
+#include "ResultCache.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include "globals.h"
+#include "MappedFile.h"
+#include "ExecuteInstruction.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#define getpid _getpid
+#define utime _utime
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+//first bytes of every entry
+static const char RESULT_MAGIC[4] = { 'B', '1', '7', 'R' };
+//positions remembered by the compressor when looking for repeats
+const int MATCH_TABLE_SIZE = 1 << 14;
+//shortest repeat the compressor encodes, and the furthest back it looks
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 1 << 20;
+
+//copy of the trace written to another stream, kept to store with the result
+//until it grows past limit, after which the trace is only passed on
+class TraceRecorder : public streambuf {
+public:
+	TraceRecorder(streambuf *target, unsigned long long limit) : target(target), limit(limit) { setp(buffer, buffer + sizeof(buffer)); }
+	const string &getText() { sync(); return text; } //everything written so far, if complete
+	bool isComplete() { sync(); return recording; } //false once the trace outgrew the limit
+protected:
+	int overflow(int c) {
+		if (sync() != 0)
+			return EOF;
+		if (c != EOF) {
+			*pptr() = (char)c;
+			pbump(1);
+		}
+		return c == EOF ? 0 : c;
+	}
+	//pass the buffered characters on, keeping a copy
+	int sync() {
+		streamsize n = pptr() - pbase(); //characters buffered
+		if (recording && text.size() + (size_t)n > limit) {
+			recording = false;
+			string().swap(text);
+		}
+		if (recording)
+			text.append(pbase(), (size_t)n);
+		setp(buffer, buffer + sizeof(buffer));
+		return target->sputn(buffer, n) == n ? target->pubsync() : -1;
+	}
+private:
+	streambuf *target; //stream the trace is passed on to
+	unsigned long long limit; //longest trace kept, in bytes
+	bool recording = true; //false once the trace is longer than limit
+	char buffer[4096]; //characters not yet passed on
+	string text; //the trace
+};
+
+//two independent running hashes of the bytes of a run
+struct runHash {
+	uint64_t first, second;
+	void add(const void *data, size_t size) {
+		for (size_t n = 0; n < size; n++) {
+			unsigned char b = ((const unsigned char *)data)[n];
+			first = (first ^ b) * 0x100000001b3ULL;
+			second = ((second ^ b) * 0x9e3779b97f4a7c15ULL);
+			second ^= second >> 29;
+		}
+	}
+};
+
+/************************************************************************
+Function: putBytes
+Author: Jake Davidson
+Description: Appends bytes to an entry being built.
+Parameters: out - the entry
+			data - bytes to append
+			size - number of bytes
+************************************************************************/
+static void putBytes(vector<char> &out, const void *data, size_t size) {
+	out.insert(out.end(), (const char *)data, (const char *)data + size);
+}
+
+/************************************************************************
+Function: takeBytes
+Author: Jake Davidson
+Description: Reads bytes from an entry, checking it is long enough.
+Parameters: p - next byte of the entry, moved past the bytes read
+			end - one past the last byte of the entry
+			data - where to copy the bytes
+			size - number of bytes
+Returns: false if the entry ends first
+************************************************************************/
+static bool takeBytes(const char *&p, const char *end, void *data, size_t size) {
+	if ((size_t)(end - p) < size)
+		return false;
+	memcpy(data, p, size);
+	p += size;
+	return true;
+}
+
+/************************************************************************
+Function: putNumber
+Author: Jake Davidson
+Description: Appends a number in 7 bit groups, low first, with the top
+bit set on every group but the last.
+Parameters: out - text being built
+			n - number to append
+************************************************************************/
+static void putNumber(string &out, size_t n) {
+	while (n >= 0x80) {
+		out += (char)((n & 0x7f) | 0x80);
+		n >>= 7;
+	}
+	out += (char)n;
+}
+
+/************************************************************************
+Function: takeNumber
+Author: Jake Davidson
+Description: Reads a number written by putNumber.
+Parameters: p - next byte, moved past the number
+			end - one past the last byte
+			n - set to the number
+Returns: false if the data ends first or the number is too long
+************************************************************************/
+static bool takeNumber(const char *&p, const char *end, size_t &n) {
+	n = 0;
+	for (int shift = 0; p < end && shift < 64; shift += 7) {
+		unsigned char b = (unsigned char)*p++;
+		n |= (size_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+/************************************************************************
+Function: compressText
+Author: Jake Davidson
+Description: Compresses text with LZ77. The output is a sequence of
+literal runs, each followed by a repeat (length and distance back) except
+the last. Repeats are found through a table of the last position each
+4 byte sequence was seen, which suits traces: a loop prints lines that
+differ from the previous iteration in only a few characters.
+Parameters: text - text to compress
+Returns: the compressed text
+************************************************************************/
+string compressText(const string &text) {
+	vector<int> table(MATCH_TABLE_SIZE, -1); //last position of each hashed 4 byte sequence
+	const char *data = text.data();
+	size_t size = text.size(), position = 0, anchor = 0; //next byte to look at, first literal not written
+	string out; //compressed text
+	while (position + MIN_MATCH <= size) {
+		uint32_t word; //4 bytes at position
+		memcpy(&word, data + position, 4);
+		uint32_t slot = (word * 2654435761U) >> 18; //table entry for word
+		int candidate = table[slot]; //earlier position with the same hash
+		table[slot] = (int)position;
+		if (candidate < 0 || position - candidate > MAX_OFFSET || memcmp(data + candidate, data + position, MIN_MATCH) != 0) {
+			position++;
+			continue;
+		}
+		size_t length = MIN_MATCH; //length of the repeat
+		while (position + length < size && data[candidate + length] == data[position + length])
+			length++;
+		putNumber(out, position - anchor);
+		out.append(data + anchor, position - anchor);
+		putNumber(out, length - MIN_MATCH);
+		putNumber(out, position - candidate);
+		position += length;
+		anchor = position;
+	}
+	putNumber(out, size - anchor);
+	out.append(data + anchor, size - anchor);
+	return out;
+}
+
+/************************************************************************
+Function: decompressText
+Author: Jake Davidson
+Description: Reverses compressText, checking every length and distance.
+Parameters: data - compressed text
+			size - bytes of compressed text
+			length - length of the original text
+			text - set to the original text
+Returns: false if the data is not valid or is not length bytes long
+************************************************************************/
+bool decompressText(const char *data, size_t size, size_t length, string &text) {
+	const char *p = data, *end = data + size; //next compressed byte, end of the data
+	size_t literals, repeat, offset; //current run
+	text.clear();
+	text.reserve(length);
+	while (true) {
+		if (!takeNumber(p, end, literals) || literals > (size_t)(end - p) || text.size() + literals > length)
+			return false;
+		text.append(p, literals);
+		p += literals;
+		if (p == end)
+			return text.size() == length;
+		if (!takeNumber(p, end, repeat) || !takeNumber(p, end, offset))
+			return false;
+		repeat += MIN_MATCH;
+		if (offset == 0 || offset > text.size() || text.size() + repeat > length)
+			return false;
+		//copied a byte at a time, a repeat may overlap the text it copies
+		for (size_t n = 0, from = text.size() - offset; n < repeat; n++)
+			text += text[from + n];
+	}
+}
+
+/************************************************************************
+Function: ResultCache
+Author: Jake Davidson
+Description: Constructs a cache using a directory of entries.
+Parameters: directory - directory holding the entries, created when the
+			first entry is stored
+			limitBytes - size the directory is kept within
+************************************************************************/
+ResultCache::ResultCache(string directory, unsigned long long limitBytes)
+	: directory(directory), limitBytes(limitBytes), key(0), check(0)
+{
+}
+
+/************************************************************************
+Function: replay
+Author: Jake Davidson
+Description: Hashes the run about to start: the emulator, the step limit,
+the decoded program and start instruction, the registers and memory. If
+a valid entry exists for it, the stored trace is printed, the final
+registers, instruction register and memory are restored and the entry is
+marked as recently used.
+Parameters: maxSteps - most instructions the run may execute
+Returns: true if the result was replayed, false if the program must run
+************************************************************************/
+bool ResultCache::replay(unsigned long long maxSteps) {
+	runHash hash = { 0xcbf29ce484222325ULL, 0x6a09e667f3bcc909ULL }; //hash of the run
+	uint64_t start = (uint64_t)(instructionRegister - instructions.begin()); //position of the start instruction
+	int registers[5] = { AC, X0, X1, X2, X3 }; //registers before the run
+	stringstream name; //entry file name
+	hash.add(EMULATOR_VERSION, sizeof(EMULATOR_VERSION));
+#ifndef _WIN32
+	//a rebuilt emulator may behave differently, so its executable is part of the key
+	struct stat executable;
+	if (stat("/proc/self/exe", &executable) == 0) {
+		hash.add(&executable.st_size, sizeof(executable.st_size));
+		hash.add(&executable.st_mtime, sizeof(executable.st_mtime));
+		hash.add(&executable.st_ino, sizeof(executable.st_ino));
+	}
+	else
+#endif
+		hash.add(__DATE__ __TIME__, sizeof(__DATE__ __TIME__));
+	hash.add(&maxSteps, sizeof(maxSteps));
+	hash.add(&start, sizeof(start));
+	hash.add(registers, sizeof(registers));
+	for (instruction &i : instructions) {
+		uint32_t fields[6] = { i.instructionAddress, (uint32_t)i.indexRegister, (uint32_t)i.addressMode,
+			(uint32_t)i.opCode, i.operandAddress, (uint32_t)i.EA }; //fields that affect the run and trace
+		uint32_t length = (uint32_t)i.instructionHexString.size(); //length of the hex string
+		hash.add(fields, sizeof(fields));
+		hash.add(&length, sizeof(length));
+		hash.add(i.instructionHexString.data(), length);
+	}
+	hash.add(memory, sizeof(memory));
+	key = hash.first;
+	check = hash.second;
+	name << directory << "/" << hex << setw(16) << setfill('0') << key << ".b17r";
+	path = name.str();
+	initialMemory.assign(memory, memory + 4096);
+
+	//read and check the whole entry before changing anything
+	MappedFile entry; //stored result
+	char magic[4];
+	uint32_t version, rangeCount, reasonLength;
+	uint64_t storedKey, storedCheck, steps, finalIndex, traceLength, compressedLength, checksum;
+	uint8_t halted;
+	int32_t finalRegisters[5];
+	vector<pair<uint32_t, vector<int32_t> > > ranges; //changed memory
+	string reason, trace;
+	if (!entry.open(path) || entry.size() < sizeof(checksum))
+		return false;
+	const char *p = entry.data(), *end = entry.data() + entry.size() - sizeof(checksum);
+	runHash sum = { 0xcbf29ce484222325ULL, 0 }; //checksum of the entry
+	sum.add(entry.data(), entry.size() - sizeof(checksum));
+	memcpy(&checksum, end, sizeof(checksum));
+	if (checksum != sum.first)
+		return false;
+	if (!takeBytes(p, end, magic, 4) || memcmp(magic, RESULT_MAGIC, 4) != 0
+		|| !takeBytes(p, end, &version, 4) || version != RESULT_CACHE_VERSION
+		|| !takeBytes(p, end, &storedKey, 8) || storedKey != key
+		|| !takeBytes(p, end, &storedCheck, 8) || storedCheck != check
+		|| !takeBytes(p, end, &steps, 8) || !takeBytes(p, end, &halted, 1)
+		|| !takeBytes(p, end, finalRegisters, sizeof(finalRegisters))
+		|| !takeBytes(p, end, &finalIndex, 8) || finalIndex >= instructions.size()
+		|| !takeBytes(p, end, &reasonLength, 4) || reasonLength > (size_t)(end - p))
+		return false;
+	reason.assign(p, reasonLength);
+	p += reasonLength;
+	if (!takeBytes(p, end, &rangeCount, 4))
+		return false;
+	for (uint32_t r = 0; r < rangeCount; r++) {
+		uint32_t range[2]; //start and length
+		if (!takeBytes(p, end, range, sizeof(range)) || range[0] >= 4096 || range[1] > 4096 - range[0])
+			return false;
+		ranges.push_back(make_pair(range[0], vector<int32_t>(range[1])));
+		if (!takeBytes(p, end, ranges.back().second.data(), range[1] * sizeof(int32_t)))
+			return false;
+	}
+	if (!takeBytes(p, end, &traceLength, 8) || !takeBytes(p, end, &compressedLength, 8)
+		|| compressedLength != (uint64_t)(end - p) || !decompressText(p, compressedLength, traceLength, trace))
+		return false;
+
+	//hit: the machine ends up as the run left it
+	cout.write(trace.data(), trace.size());
+	cout.flush();
+	AC = finalRegisters[0];
+	X0 = finalRegisters[1];
+	X1 = finalRegisters[2];
+	X2 = finalRegisters[3];
+	X3 = finalRegisters[4];
+	for (auto &range : ranges)
+		copy(range.second.begin(), range.second.end(), memory + range.first);
+	instructionRegister = instructions.begin() + finalIndex;
+	utime(path.c_str(), nullptr);
+	return true;
+}
+
+/************************************************************************
+Function: store
+Author: Jake Davidson
+Description: Stores the result of the run hashed by replay: the final
+machine, the ranges of memory that changed and the compressed trace. The
+entry is written to a temporary file and renamed into place, then old
+entries are evicted.
+Parameters: steps - instructions executed
+			halted - true if the machine halted, false if it reached the step limit
+			haltReason - halt message
+			trace - everything the run printed
+************************************************************************/
+void ResultCache::store(unsigned long long steps, bool halted, string haltReason, const string &trace) {
+	vector<char> out; //the entry
+	uint64_t finalIndex = (uint64_t)(instructionRegister - instructions.begin()); //position of the final instruction
+	int32_t registers[5] = { AC, X0, X1, X2, X3 }; //final registers
+	uint32_t reasonLength = (uint32_t)haltReason.size(), rangeCount = 0; //length of the reason, changed ranges
+	uint64_t steps64 = steps, traceLength = trace.size(); //sizes stored
+	uint8_t stopped = halted; //halted flag stored
+	string compressed = compressText(trace); //trace stored
+	uint64_t compressedLength = compressed.size();
+	size_t rangeCountAt; //where rangeCount is in out
+	stringstream temporary; //file the entry is written to before it is renamed
+	ofstream fout;
+
+	putBytes(out, RESULT_MAGIC, 4);
+	putBytes(out, &RESULT_CACHE_VERSION, 4);
+	putBytes(out, &key, 8);
+	putBytes(out, &check, 8);
+	putBytes(out, &steps64, 8);
+	putBytes(out, &stopped, 1);
+	putBytes(out, registers, sizeof(registers));
+	putBytes(out, &finalIndex, 8);
+	putBytes(out, &reasonLength, 4);
+	putBytes(out, haltReason.data(), reasonLength);
+	rangeCountAt = out.size();
+	putBytes(out, &rangeCount, 4);
+	for (uint32_t address = 0; address < 4096;) {
+		uint32_t range[2] = { address, 0 }; //start and length of the changed range
+		while (address + range[1] < 4096 && memory[address + range[1]] != initialMemory[address + range[1]])
+			range[1]++;
+		if (range[1] == 0) {
+			address++;
+			continue;
+		}
+		putBytes(out, range, sizeof(range));
+		putBytes(out, memory + address, range[1] * sizeof(int32_t));
+		address += range[1];
+		rangeCount++;
+	}
+	memcpy(out.data() + rangeCountAt, &rangeCount, 4);
+	putBytes(out, &traceLength, 8);
+	putBytes(out, &compressedLength, 8);
+	putBytes(out, compressed.data(), compressed.size());
+	runHash sum = { 0xcbf29ce484222325ULL, 0 }; //checksum of the entry
+	sum.add(out.data(), out.size());
+	putBytes(out, &sum.first, 8);
+
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0777);
+#endif
+	temporary << path << "." << getpid() << ".tmp";
+	fout.open(temporary.str(), ios::binary);
+	fout.write(out.data(), out.size());
+	fout.close();
+	if (!fout) {
+		remove(temporary.str().c_str());
+		cout << "Could not store result in " << directory << endl;
+		return;
+	}
+#ifdef _WIN32
+	remove(path.c_str());
+#endif
+	if (rename(temporary.str().c_str(), path.c_str()) != 0) {
+		remove(temporary.str().c_str());
+		return;
+	}
+	this->evict();
+}
+
+/************************************************************************
+Function: evict
+Author: Jake Davidson
+Description: Removes entries, least recently used (oldest modification
+time) first, until the entries fit in the size limit. Other processes
+may be removing entries at the same time, so files that have gone are
+skipped. Not available on Windows, where the cache is unbounded.
+************************************************************************/
+void ResultCache::evict() {
+#ifndef _WIN32
+	vector<pair<pair<long long, long long>, pair<string, unsigned long long> > > entries; //(time, (file, size)) of each entry
+	unsigned long long total = 0; //bytes used by the entries
+	DIR *dir = opendir(directory.c_str());
+	struct dirent *file;
+	if (!dir)
+		return;
+	while ((file = readdir(dir)) != nullptr) {
+		string name = file->d_name; //name of the file
+		struct stat info;
+		if (name.size() < 5 || name.compare(name.size() - 5, 5, ".b17r") != 0)
+			continue;
+		name = directory + "/" + name;
+		if (stat(name.c_str(), &info) != 0)
+			continue;
+		entries.push_back(make_pair(make_pair((long long)info.st_mtim.tv_sec, (long long)info.st_mtim.tv_nsec),
+			make_pair(name, (unsigned long long)info.st_size)));
+		total += info.st_size;
+	}
+	closedir(dir);
+	sort(entries.begin(), entries.end());
+	for (size_t n = 0; n < entries.size() && total > limitBytes; n++) {
+		remove(entries[n].second.first.c_str());
+		total -= entries[n].second.second;
+	}
+#endif
+}
+
+/************************************************************************
+Function: runWithResultCache
+Author: Jake Davidson
+Description: Runs the loaded program like execute, unless the result of
+the same run is in the cache, in which case it is replayed instead. A run
+that executes is recorded, with its trace, for next time, unless the trace
+alone is larger than the cache, which would evict it at once.
+Parameters: directory - directory holding the entries
+			limitBytes - size the directory is kept within
+			maxSteps - most instructions to execute, UNLIMITED_STEPS for no limit
+			metrics - live metrics segment to publish to, nullptr for none
+************************************************************************/
+void runWithResultCache(string directory, unsigned long long limitBytes, unsigned long long maxSteps, liveMetrics *metrics) {
+	ResultCache cache(directory, limitBytes); //stored results
+	TraceRecorder recorder(cout.rdbuf(), limitBytes); //prints the trace and keeps a copy
+	ostream trace(&recorder); //stream the trace is written to
+	unsigned long long steps; //instructions executed
+	if (cache.replay(maxSteps))
+		return;
+	ExecuteInstruction ins(&trace); //container class for instructions and ALU operations
+	ins.setMetrics(metrics);
+	steps = ins.run(maxSteps);
+	if (!ins.isHalted())
+		trace << "Machine Halted - step limit reached" << endl;
+	if (recorder.isComplete())
+		cache.store(steps, ins.isHalted(), ins.getHaltReason(), recorder.getText());
+}
@@ -0,0 +1,68 @@
+//Result memoization. With --result-cache <directory> a plain run first looks
+//for a stored result of the same run: the key is a hash of the emulator (its
+//version and executable), the step limit, the decoded program and start
+//instruction, and the registers and memory before execution. On a hit the
+//stored trace is printed and the final registers, instruction register and
+//memory are restored without executing anything. On a miss the program runs
+//as usual and the result is stored for next time.
+//
+//An entry (<key>.b17r) holds the final registers, the position of the final
+//instruction, the halt reason, the step count, the ranges of memory that differ
+//from the initial image, and the trace compressed with a small LZ77 coder. The
+//key and a checksum are checked on every hit, so a damaged entry or one for a
+//different run that happens to share a file name is ignored and replaced.
+//
+//Entries are written to a temporary file and renamed, so processes sharing a
+//directory only ever see whole entries. A hit touches the entry's modification
+//time, and after storing an entry the oldest entries are removed until the
+//directory is within its size limit (--result-cache-size, in MB), giving LRU
+//eviction. Removing an entry another process is reading is harmless.
+//
+//A run whose trace is larger than the size limit is not stored, and its trace
+//is only kept in memory until it gets that large.
+//
+//Runs with devices are never cached since their results depend on the host,
+//and builds with TRACK_MEMORY or SIMULATE_CACHE always execute so that their
+//reports describe a real run.
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "LiveMetrics.h"
+
+using namespace std;
+
+//entry format version, increase whenever the layout changes
+const uint32_t RESULT_CACHE_VERSION = 1;
+//version of the emulator's behaviour, increase when results of a program change
+const char EMULATOR_VERSION[] = "b17-1";
+//size limit of the cache directory when none is given, in MB
+const unsigned long long DEFAULT_RESULT_CACHE_MB = 256;
+
+class ResultCache {
+public:
+	ResultCache(string directory, unsigned long long limitBytes);
+	//hash the run about to start, true if a stored result was printed and restored
+	bool replay(unsigned long long maxSteps);
+	//store the result of the run hashed by replay
+	void store(unsigned long long steps, bool halted, string haltReason, const string &trace);
+private:
+	void evict(); //remove the least recently used entries until the directory is within its limit
+	string directory; //directory holding the entries
+	unsigned long long limitBytes; //size limit of the directory
+	string path; //entry for the current run
+	uint64_t key, check; //two independent hashes of the run, the first names the entry
+	vector<int> initialMemory; //memory before execution, to find the ranges that changed
+};
+
+//text compression used for stored traces
+string compressText(const string &text);
+//reverses compressText, false if data is not valid
+bool decompressText(const char *data, size_t size, size_t length, string &text);
+
+//runs the loaded program like execute, through the result cache in directory
+void runWithResultCache(string directory, unsigned long long limitBytes, unsigned long long maxSteps, liveMetrics *metrics);
+
+#endif
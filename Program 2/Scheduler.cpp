@@ -0,0 +1,167 @@
+#include "Scheduler.h"
+#include "Loader.h"
+#include "MemoryImage.h"
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <functional>
+#include <cstring>
+
+/************************************************************************
+Function: readJobs
+Author: Jake Davidson
+Description: Reads the jobs to schedule. Each non-blank line is one job:
+the object file followed by optional settings, for example 
+"prog.obj priority=2 budget=100000 data=prog.hex". data= may be given more
+than once. Lines starting with # are comments.
+Parameters: file - name of the jobs file
+			budget - instruction budget of jobs that do not set one
+Returns: jobs - the jobs, in file order
+************************************************************************/
+vector<schedulerJob> readJobs(string file, unsigned long long budget) {
+	ifstream fin; //stream to read the jobs from
+	vector<schedulerJob> jobs; //jobs read so far
+	string line, //current line of the file
+		setting; //current name=value setting
+
+	fin.open(file);
+	if (!fin) {
+		cout << "Could not open jobs file, ensure the path is correct." << endl;
+		exit(0);
+	}
+	while (getline(fin, line)) {
+		stringstream stream(line);
+		schedulerJob job = {};
+		if (line.empty() || line[0] == '#' || !(stream >> job.objectFile))
+			continue;
+		job.priority = 1;
+		job.budget = budget;
+		while (stream >> setting) {
+			if (setting.compare(0, 9, "priority=") == 0)
+				job.priority = max(1, stoi(setting.substr(9)));
+			else if (setting.compare(0, 7, "budget=") == 0)
+				job.budget = stoull(setting.substr(7));
+			else if (setting.compare(0, 5, "data=") == 0)
+				job.dataFiles.push_back(setting.substr(5));
+			else {
+				cout << "Unknown job setting " << setting << endl;
+				exit(0);
+			}
+		}
+		jobs.push_back(job);
+	}
+	return jobs;
+}
+
+/************************************************************************
+Function: loadJob
+Author: Jake Davidson
+Description: Loads the data images and program of a job. The global loader
+is used, then the decoded program and memory are moved into the job, 
+leaving the globals empty for the next job.
+Parameters: job - job to load
+************************************************************************/
+static void loadJob(schedulerJob &job) {
+	memset(memory, 0, sizeof(memory));
+	instructions.clear();
+	for (string &file : job.dataFiles)
+		loadMemoryImage(file);
+	readInstructions(job.objectFile);
+	if (instructions.empty()) {
+		cout << "No instructions loaded from " << job.objectFile << ", ensure object file is not empty." << endl;
+		exit(0);
+	}
+	//swapping keeps instructionRegister valid, it now points into the job's program
+	job.program.swap(instructions);
+	job.memory.assign(memory, memory + sizeof(memory) / sizeof(memory[0]));
+	job.state.memory = job.memory.data();
+	job.state.instructions = &job.program;
+	job.state.instructionRegister = instructionRegister;
+}
+
+/************************************************************************
+Function: runScheduler
+Author: Jake Davidson
+Description: Loads every job, then runs them on a pool of worker threads.
+A worker takes the job with the lowest virtual run time, runs it for one
+quantum (or what is left of its budget), then either finishes it or puts
+it back in the queue. When all jobs are done the final registers, 
+instructions executed, wall time and running time of each job are printed.
+Parameters: file - name of the jobs file
+			threads - number of worker threads, 0 for one per core
+			quantum - instructions a job runs before it is preempted
+			budget - instruction budget of jobs that do not set one
+************************************************************************/
+void runScheduler(string file, int threads, unsigned long long quantum, unsigned long long budget) {
+	vector<schedulerJob> jobs = readJobs(file, budget); //jobs to run
+	typedef pair<double, size_t> queueEntry; //virtual run time and index of a job
+	priority_queue<queueEntry, vector<queueEntry>, greater<queueEntry> > runQueue; //jobs waiting to run
+	mutex lock; //protects runQueue, running and job bookkeeping
+	condition_variable changed; //signalled when a job is queued or finishes
+	int running = 0; //jobs currently on a worker
+	vector<thread> pool; //worker threads
+
+	//the jobs vector is not resized after this, so pointers into the jobs stay valid
+	for (size_t j = 0; j < jobs.size(); j++) {
+		loadJob(jobs[j]);
+		runQueue.push(make_pair(0.0, j));
+	}
+	if (threads <= 0)
+		threads = max(1u, thread::hardware_concurrency());
+	if (quantum == 0)
+		quantum = DEFAULT_QUANTUM;
+
+	for (int t = 0; t < threads; t++) {
+		pool.push_back(thread([&]() {
+			unique_lock<mutex> guard(lock);
+			while (true) {
+				//wait for a job, unless none are queued or running (then all are done)
+				changed.wait(guard, [&]() { return !runQueue.empty() || running == 0; });
+				if (runQueue.empty())
+					break;
+				schedulerJob &job = jobs[runQueue.top().second];
+				runQueue.pop();
+				running++;
+				if (!job.started) {
+					job.started = true;
+					job.startTime = chrono::steady_clock::now();
+				}
+				guard.unlock();
+
+				//run one quantum without holding the lock
+				chrono::steady_clock::time_point sliceStart = chrono::steady_clock::now();
+				ExecuteInstruction ins(job.state, nullptr);
+				unsigned long long steps = ins.run(min(quantum, job.budget - job.steps));
+				chrono::steady_clock::time_point sliceEnd = chrono::steady_clock::now();
+
+				guard.lock();
+				running--;
+				job.steps += steps;
+				job.virtualTime += (double)steps / job.priority;
+				job.runSeconds += chrono::duration<double>(sliceEnd - sliceStart).count();
+				if (ins.isHalted() || job.steps >= job.budget) {
+					job.haltReason = ins.isHalted() ? ins.getHaltReason() : "Machine Halted - instruction budget exhausted";
+					job.wallSeconds = chrono::duration<double>(sliceEnd - job.startTime).count();
+				}
+				else {
+					runQueue.push(make_pair(job.virtualTime, (size_t)(&job - &jobs[0])));
+				}
+				changed.notify_all();
+			}
+		}));
+	}
+	for (thread &t : pool)
+		t.join();
+
+	for (size_t j = 0; j < jobs.size(); j++) {
+		cout << dec << "job " << j << " " << jobs[j].objectFile << ": ";
+		ExecuteInstruction(jobs[j].state, &cout).printRegisters();
+		cout << dec << fixed << setprecision(3) << "  priority " << jobs[j].priority << ", steps " << jobs[j].steps
+			<< ", wall " << jobs[j].wallSeconds * 1000 << " ms, run " << jobs[j].runSeconds * 1000 << " ms, "
+			<< jobs[j].haltReason << endl;
+	}
+	cout << dec << "Scheduler: " << jobs.size() << " jobs on " << threads << " workers, quantum " << quantum << endl;
+}
@@ -0,0 +1,43 @@
+//Scheduler mode. Runs many B17 programs (jobs) on a fixed pool of worker
+//threads. Each job runs for at most one quantum of instructions before it is
+//preempted and put back in the run queue, so a job that loops forever cannot
+//hold a worker. Jobs are picked by weighted fair share: a job's virtual run
+//time grows by the instructions it executes divided by its priority, and the
+//job with the lowest virtual run time runs next.
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include "ExecuteInstruction.h"
+
+using namespace std;
+
+//instructions a job runs before it is preempted, unless --quantum is given
+const unsigned long long DEFAULT_QUANTUM = 10000;
+
+//one program run by the scheduler
+struct schedulerJob {
+	string objectFile; //program to run
+	vector<string> dataFiles; //data images loaded before the program
+	int priority; //share of the workers relative to other jobs, at least 1
+	unsigned long long budget; //most instructions the job may execute
+	vector<instruction> program; //decoded program
+	vector<int> memory; //memory of the job
+	machineState state; //registers and instruction register of the job
+	double virtualTime; //instructions executed divided by priority
+	unsigned long long steps; //instructions executed so far
+	bool started; //true once the job has been given a worker
+	chrono::steady_clock::time_point startTime; //when the job first ran
+	double wallSeconds; //time from first run to finishing
+	double runSeconds; //time spent running on a worker
+	string haltReason; //halt message once the job has finished
+};
+
+//reads the jobs file, one job per line
+vector<schedulerJob> readJobs(string file, unsigned long long budget);
+//runs every job in the jobs file and reports the instructions and time of each
+void runScheduler(string file, int threads, unsigned long long quantum, unsigned long long budget);
+
+#endif
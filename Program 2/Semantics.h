@@ -0,0 +1,110 @@
+//Instruction semantics shared by the runtime interpreter (Loader.cpp and
+//ExecuteInstruction.cpp) and the compile time evaluator (ConstexprB17.h), so
+//the two cannot drift apart. Everything here is constexpr in the C++11 sense.
+#ifndef SEMANTICS_H
+#define SEMANTICS_H
+
+#include "const.h"
+
+//opcode for each category (bits 11-10) and specifier (bits 9-6) of an instruction
+constexpr opCodes OPCODE_TABLE[4][16] = {
+	//MISC
+	{ HALT, NOP, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED,
+	UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED },
+	//MEM
+	{ LD, ST, EM, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED,
+	LDX, STX, EMX, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED },
+	//ALU
+	{ ADD, SUB, CLR, COM, AND, OR, XOR, UNDEFINED,
+	ADDX, SUBX, CLRX, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED },
+	//TRANS
+	{ J, JZ, JN, JP, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED,
+	UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED }
+};
+
+//opcode table with the bulk memory extension (BlockOps.h), which uses undefined specifiers
+constexpr opCodes BLOCK_OPCODE_TABLE[4][16] = {
+	//MISC
+	{ HALT, NOP, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED,
+	UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED },
+	//MEM
+	{ LD, ST, EM, BCPY, BFIL, UNDEFINED, UNDEFINED, UNDEFINED,
+	LDX, STX, EMX, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED },
+	//ALU
+	{ ADD, SUB, CLR, COM, AND, OR, XOR, BSUM,
+	ADDX, SUBX, CLRX, BXOR, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED },
+	//TRANS
+	{ J, JZ, JN, JP, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED,
+	UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED }
+};
+
+//true if op is a block instruction of the bulk memory extension
+constexpr bool isBlockOp(opCodes op) {
+	return op == BCPY || op == BFIL || op == BSUM || op == BXOR;
+}
+
+//addressing mode for each value of bits 5-2 of an instruction
+constexpr addrModes ADDRESS_MODE_TABLE[16] = {
+	Direct, Immediate, Indexed, Illegal, Indirect, Illegal, Indexed_Indrect, Illegal,
+	Illegal, Illegal, Illegal, Illegal, Illegal, Illegal, Illegal, Illegal
+};
+
+//fields of a 24-bit instruction word
+constexpr unsigned int decodeOperandAddress(unsigned int word) { return (word >> 12) & 0xfff; }
+constexpr opCodes decodeOpCode(unsigned int word) { return OPCODE_TABLE[(word >> 10) & 3][(word >> 6) & 15]; }
+constexpr addrModes decodeAddrMode(unsigned int word) { return ADDRESS_MODE_TABLE[(word >> 2) & 15]; }
+constexpr int decodeIndexRegister(unsigned int word) { return (int)(word & 3); }
+
+//true if op cannot be used with addressing mode mode, the machine halts if it is executed
+constexpr bool illegalAddressMode(opCodes op, addrModes mode) {
+	return (op == ST || op == EM || op == J || op == JZ || op == JN || op == JP) ? mode == Immediate
+		: (op == LDX || op == ADDX || op == SUBX) ? (mode == Indexed || mode == Indirect)
+		: (op == STX || op == EMX || isBlockOp(op)) ? mode != Direct
+		: false;
+}
+
+//true if op takes its value from the instruction rather than memory[EA] (LDX always reads memory)
+constexpr bool usesImmediate(opCodes op, addrModes mode) {
+	return mode == Immediate && op != LDX;
+}
+
+//new AC after an AC instruction, value is the immediate value or memory word used.
+//Arithmetic wraps around rather than overflowing
+constexpr int accumulatorResult(opCodes op, int ac, int value) {
+	return op == LD ? value
+		: op == ADD ? (int)((unsigned int)ac + (unsigned int)value)
+		: op == SUB ? (int)((unsigned int)ac - (unsigned int)value)
+		: op == CLR ? 0
+		: op == COM ? ~ac
+		: op == AND ? (ac & value)
+		: op == OR ? (ac | value)
+		: op == XOR ? (ac ^ value)
+		: ac;
+}
+
+//new index register after an index register instruction
+constexpr int indexResult(opCodes op, int x, int value) {
+	return op == LDX ? value
+		: op == ADDX ? (int)((unsigned int)x + (unsigned int)value)
+		: op == SUBX ? (int)((unsigned int)x - (unsigned int)value)
+		: op == CLRX ? 0
+		: x;
+}
+
+//true if the instruction reads memory[EA] when executed (legal addressing mode assumed)
+constexpr bool readsMemory(opCodes op, addrModes mode) {
+	return ((op == LD || op == ADD || op == SUB || op == AND || op == OR || op == XOR || op == ADDX || op == SUBX) && mode != Immediate)
+		|| op == LDX || op == EM || op == EMX;
+}
+
+//true if the instruction writes memory[EA] when executed (legal addressing mode assumed)
+constexpr bool writesMemory(opCodes op, addrModes mode) {
+	return (op == ST || op == EM || op == STX || op == EMX) && !illegalAddressMode(op, mode);
+}
+
+//true if a transfer instruction jumps with the given AC
+constexpr bool jumpTaken(opCodes op, int ac) {
+	return op == J || (op == JZ && ac == 0) || (op == JN && ac < 0) || (op == JP && ac > 0);
+}
+
+#endif
@@ -0,0 +1,60 @@
+#include "SparseMemory.h"
+#include <cstdlib>
+#include <iostream>
+
+int SparseMemory::zeroPage[PAGE_WORDS];
+SparseMemory *extendedMemory = nullptr;
+
+/************************************************************************
+Function: SparseMemory
+Author: Jake Davidson
+Description: Constructs an address space with every page but page 0
+unallocated.
+Parameters: addressBits - width of an address, MIN_ADDRESS_BITS to MAX_ADDRESS_BITS
+			low - the 4096 words used as page 0
+************************************************************************/
+SparseMemory::SparseMemory(int addressBits, int *low)
+	: addressBits(addressBits), mask((1u << addressBits) - 1),
+	pages(1u << (addressBits - PAGE_BITS), zeroPage), allocatedPages(0)
+{
+	pages[0] = low;
+}
+
+/************************************************************************
+Function: ~SparseMemory
+Author: Jake Davidson
+Description: Frees the allocated pages. Page 0 belongs to the caller.
+************************************************************************/
+SparseMemory::~SparseMemory() {
+	for (size_t page = 1; page < pages.size(); page++) {
+		if (pages[page] != zeroPage)
+			free(pages[page]);
+	}
+}
+
+/************************************************************************
+Function: allocate
+Author: Jake Davidson
+Description: Allocates a zero filled page. Halts if the host is out of
+memory, as the write cannot be completed.
+Returns: the page
+************************************************************************/
+int *SparseMemory::allocate() {
+	int *page = (int *)calloc(PAGE_WORDS, sizeof(int)); //the new page
+	if (!page) {
+		cout << "Machine Halted - out of host memory for memory pages" << endl;
+		exit(0);
+	}
+	allocatedPages++;
+	return page;
+}
+
+/************************************************************************
+Function: memoryWords
+Author: Jake Davidson
+Description: Gives the size of the global machine's address space.
+Returns: 2^address bits with extended addressing, otherwise 4096
+************************************************************************/
+unsigned int memoryWords() {
+	return extendedMemory ? extendedMemory->words() : PAGE_WORDS;
+}
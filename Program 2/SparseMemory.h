@@ -0,0 +1,72 @@
+//Extended addressing. With --address-bits <n> (13 to 24) the machine started
+//from the command line has 2^n words of memory instead of 4096, and the
+//operand field of an instruction is widened to match: an instruction word in
+//the object file may have more than 6 hex digits, the digits above bit 11 all
+//being the operand. Instruction and data image addresses may be as wide.
+//
+//The address space is a two-level page table: a directory indexed by the
+//address above bit 11 points at pages of 4096 words. A page is allocated,
+//zero filled, the first time one of its words is written; until then the
+//directory entry points at a shared page of zeros, so reads need no check and
+//an access is always one directory lookup plus an offset. Page 0 is the global
+//memory array itself, so everything that only knows the classic 4K machine
+//(devices, snapshots of the low page) keeps working, and when no width is
+//given no page table exists and memory is accessed directly as before.
+//Addresses wrap at 2^n.
+#ifndef SPARSEMEMORY_H
+#define SPARSEMEMORY_H
+
+#include <vector>
+
+using namespace std;
+
+//address bits below the page number, and words per page
+const int PAGE_BITS = 12;
+const unsigned int PAGE_WORDS = 1u << PAGE_BITS;
+//widths of the address space that can be selected
+const int MIN_ADDRESS_BITS = 12;
+const int MAX_ADDRESS_BITS = 24;
+
+class SparseMemory {
+public:
+	SparseMemory(int addressBits, int *low);
+	~SparseMemory();
+	//value of the word at address, 0 if its page was never written
+	int read(unsigned int address) const {
+		address &= mask;
+		return pages[address >> PAGE_BITS][address & (PAGE_WORDS - 1)];
+	}
+	//the word at address, to be written, allocating its page if needed
+	int &write(unsigned int address) {
+		address &= mask;
+		int *&page = pages[address >> PAGE_BITS];
+		if (page == zeroPage)
+			page = this->allocate();
+		return page[address & (PAGE_WORDS - 1)];
+	}
+	//the word at address, the words after it up to the end of its page follow it
+	const int *span(unsigned int address) const {
+		address &= mask;
+		return &pages[address >> PAGE_BITS][address & (PAGE_WORDS - 1)];
+	}
+	unsigned int words() const { return mask + 1; } //words in the address space
+	int bits() const { return addressBits; } //width of an address
+	unsigned int pageCount() const { return (unsigned int)pages.size(); } //pages in the address space
+	bool allocated(unsigned int page) const { return pages[page] != zeroPage; } //true if page has been written
+	unsigned int pagesAllocated() const { return allocatedPages + 1; } //pages in use, including page 0
+private:
+	int *allocate(); //allocate a zero filled page
+	int addressBits; //width of an address
+	unsigned int mask; //address bits kept
+	vector<int *> pages; //page directory, zeroPage for pages never written
+	unsigned int allocatedPages; //pages allocated, not counting page 0
+	static int zeroPage[PAGE_WORDS]; //shared page of zeros, never written
+};
+
+//address space of the global machine, nullptr for the classic 4096 words
+extern SparseMemory *extendedMemory;
+
+//words the global machine can address
+unsigned int memoryWords();
+
+#endif
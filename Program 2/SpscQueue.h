@@ -0,0 +1,50 @@
+//Bounded lock-free queue for exactly one producer thread and one consumer
+//thread. Neither side ever waits on the other: push fails when the queue is
+//full and pop fails when it is empty, and the caller decides what to do.
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+using namespace std;
+
+//N must be a power of two
+template <typename T, size_t N>
+class SpscQueue {
+public:
+	SpscQueue() : head(0), tail(0) {}
+	//adds item at the tail, false if the queue is full (producer only)
+	bool push(const T &item) {
+		size_t t = tail.load(memory_order_relaxed);
+		if (t - head.load(memory_order_acquire) == N)
+			return false;
+		items[t & (N - 1)] = item;
+		tail.store(t + 1, memory_order_release);
+		return true;
+	}
+	//removes the item at the head into item, false if the queue is empty (consumer only)
+	bool pop(T &item) {
+		size_t h = head.load(memory_order_relaxed);
+		if (h == tail.load(memory_order_acquire))
+			return false;
+		item = items[h & (N - 1)];
+		head.store(h + 1, memory_order_release);
+		return true;
+	}
+	//items waiting, exact for the consumer and producer, approximate for anyone else
+	size_t size() const {
+		return tail.load(memory_order_acquire) - head.load(memory_order_acquire);
+	}
+private:
+	static_assert((N & (N - 1)) == 0, "queue size must be a power of two");
+	//head and tail are written by different threads, padding keeps them on separate
+	//cache lines (padding rather than alignas, so queues can be allocated with new)
+	atomic<size_t> head; //index of the next item to pop
+	char headPad[64]; //keeps tail off the cache line of head
+	atomic<size_t> tail; //index of the next free slot
+	char tailPad[64]; //keeps the items off the cache line of tail
+	T items[N]; //ring buffer
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "Sweep.h"
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//words in the memory image shared by the variants, matches memory in globals.h
+const int IMAGE_WORDS = 4096;
+const size_t IMAGE_BYTES = IMAGE_WORDS * sizeof(int);
+
+/************************************************************************
+Function: readVariants
+Author: Jake Davidson
+Description: Reads the variants of a sweep. Each non-blank line is one 
+variant, given as whitespace separated address=value pairs in hex, for 
+example "100=5 101=ff". A line containing only "-" runs the base image
+unchanged. Lines starting with # are comments.
+Parameters: file - name of the variants file
+Returns: variants - the list of variants, in file order
+************************************************************************/
+vector<sweepVariant> readVariants(string file) {
+	ifstream fin; //stream to read the variants from
+	vector<sweepVariant> variants; //variants read so far
+	string line, //current line of the file
+		token; //current address=value pair
+	size_t equals; //position of = in token
+	int address, value; //decoded override
+
+	fin.open(file);
+	if (!fin) {
+		cout << "Could not open variants file, ensure the path is correct." << endl;
+		exit(0);
+	}
+	while (getline(fin, line)) {
+		stringstream stream(line);
+		sweepVariant variant;
+		//a line of only spaces or tabs is blank too, not a base variant
+		if ((stream >> ws).eof() || line[0] == '#')
+			continue;
+		while (stream >> token) {
+			if (token == "-")
+				continue;
+			equals = token.find('=');
+			if (equals == string::npos) {
+				cout << "Invalid variant override " << token << ", expected address=value" << endl;
+				exit(0);
+			}
+			address = stoi(token.substr(0, equals), nullptr, 16);
+			value = (int)stol(token.substr(equals + 1), nullptr, 16);
+			if (address < 0 || address >= IMAGE_WORDS) {
+				cout << "Variant override address " << token.substr(0, equals) << " is outside of memory" << endl;
+				exit(0);
+			}
+			variant.overrides.push_back(make_pair(address, value));
+		}
+		variants.push_back(variant);
+	}
+	return variants;
+}
+
+#ifdef __linux__
+/************************************************************************
+Function: countPrivatePages
+Author: Jake Davidson
+Description: Counts the pages of a private mapping of the base image that
+the kernel has copied. A copied page is present and no longer backed by 
+the shared file, which /proc/self/pagemap reports per page. If pagemap 
+cannot be read, pages whose contents differ from the base are counted 
+instead, which misses pages rewritten with their old values.
+Parameters: image - private mapping of the base image
+			base - the base image
+			pageSize - host page size
+Returns: number of copied pages
+************************************************************************/
+static int countPrivatePages(int *image, int *base, size_t pageSize) {
+	int pages = 0; //copied pages found
+	unsigned long long entry; //pagemap entry of the current page
+	int fd = open("/proc/self/pagemap", O_RDONLY);
+	for (size_t offset = 0; offset < IMAGE_BYTES; offset += pageSize) {
+		char *page = (char *)image + offset;
+		if (fd >= 0 && pread(fd, &entry, sizeof(entry), ((uintptr_t)page / pageSize) * sizeof(entry)) == sizeof(entry)) {
+			//bit 63 is page present, bit 61 is file backed or shared
+			if ((entry >> 63 & 1) && !(entry >> 61 & 1))
+				pages++;
+		}
+		else if (memcmp(page, (char *)base + offset, min(pageSize, IMAGE_BYTES - offset)) != 0) {
+			pages++;
+		}
+	}
+	if (fd >= 0)
+		close(fd);
+	return pages;
+}
+#endif
+
+/************************************************************************
+Function: runSweep
+Author: Jake Davidson
+Description: Runs the loaded program once for each variant in the variants
+file. The program is decoded once and the current contents of memory are
+the base image. On Linux the base image is placed in a memory file and 
+each variant maps it privately, so the kernel shares every page until a 
+variant writes to it. Elsewhere each variant gets its own copy. Variants
+run in parallel, then the registers and halt reason of each variant are 
+printed along with how much memory sharing saved compared with running 
+each variant as a separate process.
+Parameters: file - name of the variants file
+			threads - number of threads to run variants on, 0 for one per core
+			maxSteps - most instructions to execute per variant
+************************************************************************/
+void runSweep(string file, int threads, unsigned long long maxSteps) {
+	vector<sweepVariant> variants = readVariants(file); //variants to run
+	vector<sweepResult> results(variants.size()); //result of each variant
+	vector<thread> pool; //threads running variants
+	atomic<size_t> next(0); //index of the next variant to run
+	size_t pageSize = 4096; //granularity of sharing
+	int fd = -1; //memory file holding the base image
+	bool shared = false; //true if variants share the base image copy-on-write
+
+	if (threads <= 0)
+		threads = max(1u, thread::hardware_concurrency());
+#ifdef __linux__
+	pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	fd = memfd_create("b17-sweep", 0);
+	if (fd >= 0 && ftruncate(fd, IMAGE_BYTES) == 0 && pwrite(fd, memory, IMAGE_BYTES, 0) == (ssize_t)IMAGE_BYTES)
+		shared = true;
+#endif
+
+	//each thread takes the next variant until there are none left
+	for (int t = 0; t < threads; t++) {
+		pool.push_back(thread([&]() {
+			size_t v;
+			while ((v = next++) < variants.size()) {
+				sweepResult &result = results[v];
+				vector<int> copy; //private image when the base cannot be shared
+				machineState m = {}; //machine for this variant
+#ifdef __linux__
+				if (shared) {
+					m.memory = (int *)mmap(nullptr, IMAGE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+					if (m.memory == MAP_FAILED)
+						m.memory = nullptr;
+				}
+#endif
+				if (!m.memory) {
+					copy.assign(memory, memory + IMAGE_WORDS);
+					m.memory = copy.data();
+				}
+				//apply this variant's overrides and start from the program's start address
+				for (pair<int, int> &o : variants[v].overrides)
+					m.memory[o.first] = o.second;
+				m.instructions = &instructions;
+				m.instructionRegister = instructionRegister;
+
+				ExecuteInstruction ins(m, nullptr);
+				result.steps = ins.run(maxSteps);
+				result.haltReason = ins.getHaltReason();
+				result.privatePages = (int)((IMAGE_BYTES + pageSize - 1) / pageSize);
+#ifdef __linux__
+				if (copy.empty()) {
+					result.privatePages = countPrivatePages(m.memory, memory, pageSize);
+					munmap(m.memory, IMAGE_BYTES);
+				}
+#endif
+				m.memory = nullptr;
+				result.state = m;
+			}
+		}));
+	}
+	for (thread &t : pool)
+		t.join();
+#ifdef __linux__
+	if (fd >= 0)
+		close(fd);
+#endif
+
+	//per-variant results
+	int copiedPages = 0; //pages copied over all variants
+	printSweepResults(results);
+	for (sweepResult &r : results)
+		copiedPages += r.privatePages;
+
+	//memory sharing compared with one process per variant, which would each
+	//hold their own decoded program and full memory image
+	size_t programBytes = instructions.size() * sizeof(instruction);
+	size_t separate = variants.size() * (programBytes + IMAGE_BYTES);
+	size_t used = programBytes + IMAGE_BYTES + copiedPages * pageSize;
+	cout << dec << "Sweep: " << variants.size() << " variants on " << threads << " threads, "
+		<< (shared ? "base image shared copy-on-write" : "base image copied per variant") << endl;
+	cout << "Pages copied: " << copiedPages << " of " << pageSize << " bytes" << endl;
+	cout << "Memory used: " << used << " bytes, separate processes: " << separate << " bytes";
+	if (separate > used)
+		cout << ", saved " << (separate - used) << " bytes (" << (100 * (separate - used) / separate) << "%)";
+	cout << endl;
+}
+
+/************************************************************************
+Function: printSweepResults
+Author: Jake Davidson
+Description: Prints the final registers, instructions executed and halt
+reason of each variant, in variant order.
+Parameters: results - result of each variant
+************************************************************************/
+void printSweepResults(vector<sweepResult> &results) {
+	for (size_t v = 0; v < results.size(); v++) {
+		cout << dec << "variant " << v << ": ";
+		ExecuteInstruction(results[v].state, &cout).printRegisters();
+		cout << dec << "  steps " << results[v].steps << ", "
+			<< (results[v].haltReason.empty() ? "Step limit reached" : results[v].haltReason) << endl;
+	}
+}
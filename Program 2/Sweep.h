@@ -0,0 +1,34 @@
+//Sweep mode. Runs the loaded program once per variant, where each variant is
+//the base memory image with a few words overridden. Variants share the base
+//image copy-on-write and run in parallel on a pool of threads.
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include "ExecuteInstruction.h"
+
+using namespace std;
+
+//one variant of the sweep: the memory words to override before running
+struct sweepVariant {
+	vector<pair<int, int> > overrides; //address, value pairs
+};
+
+//result of running one variant
+struct sweepResult {
+	machineState state; //final registers (memory is not kept)
+	unsigned long long steps; //instructions executed
+	string haltReason; //halt message, empty if the step limit was reached
+	int privatePages; //pages of memory the variant copied from the base image
+};
+
+//reads the variants file, one variant per line of hex address=value pairs
+vector<sweepVariant> readVariants(string file);
+//runs every variant of the loaded program and reports the results and memory sharing
+void runSweep(string file, int threads, unsigned long long maxSteps);
+//prints the registers, steps and halt reason of every variant
+void printSweepResults(vector<sweepResult> &results);
+
+#endif
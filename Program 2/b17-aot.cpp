@@ -0,0 +1,369 @@
+/************************************************************************
+Program: b17-aot
+Author: Jake Davidson
+Description: Ahead-of-time compiler for B17 object files. The object file is
+read with the emulator's decoder and translated into a C++ source file with
+one labelled block per instruction. Every block does what the matching 
+ExecuteInstruction function does, on local AC and X registers and a memory
+array, computing results with the same Semantics.h helpers (so the generated
+file includes Semantics.h and const.h from the emulator's source directory),
+and direct jumps become gotos (jump targets are known because the EA 
+of every instruction is calculated when the program is loaded). Compiling 
+the generated file gives a program that prints the same trace as b17 at 
+native speed.
+
+The generated file has these hooks, which can be defined before compiling:
+  B17_TRACE_INSTRUCTION(text)  called with the first part of each trace line
+  B17_TRACE_REGISTERS()        called after each instruction to finish the line
+  B17_FINAL_STATE(state)       called with the b17_state after the machine halts
+  B17_NO_MAIN                  leave out main, to build a shared object exporting b17_run
+
+Input: object file, and optionally data images baked in as initial memory
+Output: C++ source file
+Compilation instructions: g++ -pthread -o b17-aot b17-aot.cpp Loader.cpp ExecuteInstruction.cpp
+	MemoryTracker.cpp LiveMetrics.cpp MemoryImage.cpp MappedFile.cpp SparseMemory.cpp BlockOps.cpp
+	Devices.cpp PipelinedLoader.cpp LazyLoader.cpp HostCounters.cpp DependencyAnalysis.cpp
+	PipelineModel.cpp BlockLayout.cpp CacheSimulator.cpp const.cpp globals.cpp (link with -lrt on older systems)
+Usage: ./b17-aot [--data <file>]... <object file> <output.cpp>
+	g++ -O2 -I<b17 source directory> -o prog output.cpp (executable, run with --no-trace to print only the final state)
+	g++ -O2 -I<b17 source directory> -shared -fPIC -DB17_NO_MAIN -o prog.so output.cpp (shared object)
+************************************************************************/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ExecuteInstruction.h"
+#include "Loader.h"
+#include "MemoryImage.h"
+#include "globals.h"
+
+using namespace std;
+
+/************************************************************************
+Function: quote
+Author: Jake Davidson
+Description: Makes a C string literal out of s.
+Parameters: s - text to quote
+Returns: s in double quotes, with quotes and backslashes escaped
+************************************************************************/
+string quote(string s) {
+	string quoted = "\""; //literal being built
+	for (char c : s) {
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+/************************************************************************
+Function: registerName
+Author: Jake Davidson
+Description: Names the index register an instruction specifies.
+Parameters: i - instruction
+Returns: name of the register variable in the generated code
+************************************************************************/
+string registerName(instruction &i) {
+	return "X" + to_string(i.indexRegister);
+}
+
+/************************************************************************
+Function: findTarget
+Author: Jake Davidson
+Description: Finds the instruction a jump goes to. Like ExecuteInstruction::J
+the first instruction in the list with the address is used.
+Parameters: address - address jumped to
+Returns: index of the instruction, or -1 if there is none
+************************************************************************/
+int findTarget(int address) {
+	for (size_t t = 0; t < instructions.size(); t++) {
+		if ((int)instructions[t].instructionAddress == address)
+			return (int)t;
+	}
+	return -1;
+}
+
+/************************************************************************
+Function: opCodeName
+Author: Jake Davidson
+Description: Names an opcode the way Semantics.h does, for the calls to
+its helpers in the generated code.
+Parameters: op - opcode
+Returns: the enumerator of op
+************************************************************************/
+string opCodeName(opCodes op) {
+	string name = opCodesPrintMap[op]; //trace name, padded with spaces
+	return name.substr(0, name.find(' '));
+}
+
+/************************************************************************
+Function: operand
+Author: Jake Davidson
+Description: Expression for the value an instruction uses: the immediate
+value when usesImmediate (Semantics.h) says so, otherwise the memory word
+at EA.
+Parameters: i - instruction
+Returns: C++ expression for the operand
+************************************************************************/
+string operand(instruction &i) {
+	if (usesImmediate(i.opCode, i.addressMode))
+		return to_string(i.EA);
+	return "memory[" + to_string(i.EA) + "]";
+}
+
+/************************************************************************
+Function: emitJump
+Author: Jake Davidson
+Description: Writes the code for a jump, a goto to the target block (after
+finishing the trace line) or a halt if there is no instruction at the 
+target address.
+Parameters: out - generated source
+			i - jump instruction
+************************************************************************/
+void emitJump(ostream &out, instruction &i) {
+	int target = findTarget(i.EA);
+	if (target >= 0)
+		out << "B17_TRACE_REGISTERS(); goto i" << target << ";";
+	else
+		out << "B17_STOP(\"Machine Halted - invalid jump address\", 0);";
+}
+
+/************************************************************************
+Function: emitInstruction
+Author: Jake Davidson
+Description: Writes the block for one instruction. The checks on addressing
+modes and addresses that ExecuteInstruction makes at run time are made 
+here, so blocks for illegal instructions only contain the halt. The new 
+register values are computed by the Semantics.h helpers the interpreter
+uses, which the generated source includes.
+Parameters: out - generated source
+			i - instruction to translate
+************************************************************************/
+void emitInstruction(ostream &out, instruction &i) {
+	string x = registerName(i); //index register of the instruction
+	string op = opCodeName(i.opCode); //opcode passed to the helpers
+	bool touchesMemory = readsMemory(i.opCode, i.addressMode) || writesMemory(i.opCode, i.addressMode);
+	if (illegalAddressMode(i.opCode, i.addressMode)) {
+		//the conditional jumps have their own message in ExecuteInstruction
+		if (i.opCode == JZ || i.opCode == JN || i.opCode == JP)
+			out << "B17_STOP(\"Machine Halted, invalid address mode\", 1);";
+		else
+			out << "B17_STOP(\"Machine Halted - illegal addressing mode\", 1);";
+		return;
+	}
+	//an indirect EA from a data image can be outside memory, ExecuteInstruction::step halts on it
+	if (touchesMemory && (i.EA < 0 || i.EA >= 4096)) {
+		out << "B17_STOP(\"Machine Halted - illegal address\", 1);";
+		return;
+	}
+	switch (i.opCode) {
+	case HALT:
+		out << "B17_STOP(\"Machine Halted - HALT instruction executed\", 1);";
+		break;
+	case NOP:
+		break;
+	case ST:
+		out << "memory[" << i.EA << "] = AC;";
+		break;
+	case EM:
+		out << "tmp = memory[" << i.EA << "]; memory[" << i.EA << "] = AC; AC = tmp;";
+		break;
+	case STX:
+		out << "memory[" << i.EA << "] = " << x << ";";
+		break;
+	case EMX:
+		out << "tmp = memory[" << i.EA << "]; memory[" << i.EA << "] = " << x << "; " << x << " = tmp;";
+		break;
+	case LD:
+	case ADD:
+	case SUB:
+	case AND:
+	case OR:
+	case XOR:
+		out << "AC = accumulatorResult(" << op << ", AC, " << operand(i) << ");";
+		break;
+	case CLR:
+	case COM:
+		out << "AC = accumulatorResult(" << op << ", AC, 0);";
+		break;
+	case LDX:
+	case ADDX:
+	case SUBX:
+		out << x << " = indexResult(" << op << ", " << x << ", " << operand(i) << ");";
+		break;
+	case CLRX:
+		out << x << " = indexResult(" << op << ", " << x << ", 0);";
+		break;
+	case J:
+	case JZ:
+	case JN:
+	case JP:
+		out << "if (jumpTaken(" << op << ", AC)) { ";
+		emitJump(out, i);
+		out << " }";
+		break;
+	default:
+		out << "B17_STOP(\"Machine Halted - undefined opcode\", 1);";
+		break;
+	}
+}
+
+/************************************************************************
+Function: findLabels
+Author: Jake Davidson
+Description: Marks the instructions the generated code jumps to: the
+start instruction and the target of every jump. Only those blocks get a
+label, so the generated source has no unused labels.
+Parameters: start - index of the first instruction to run
+Returns: true for each instruction that needs a label
+************************************************************************/
+vector<bool> findLabels(int start) {
+	vector<bool> labelled(instructions.size(), false); //instructions needing a label
+	labelled[start] = true;
+	for (instruction &i : instructions) {
+		bool jump = i.opCode == J || i.opCode == JZ || i.opCode == JN || i.opCode == JP; //true if it may jump
+		int target = jump && i.addressMode != Immediate ? findTarget(i.EA) : -1; //instruction jumped to
+		if (target >= 0)
+			labelled[target] = true;
+	}
+	return labelled;
+}
+
+/************************************************************************
+Function: generate
+Author: Jake Davidson
+Description: Writes the whole translation unit for the loaded program: the
+state struct, the hooks, b17_run with one block per instruction, and main.
+Parameters: out - generated source
+			objectFile - name of the object file, for the header comment
+************************************************************************/
+void generate(ostream &out, string objectFile) {
+	ostringstream traceText; //first part of the trace line of an instruction
+	ExecuteInstruction printer(&traceText); //prints trace lines exactly like the interpreter
+	int start = (int)(instructionRegister - instructions.begin()); //index of the first instruction to run
+	vector<bool> labelled = findLabels(start); //blocks that are jumped to
+
+	out << "// Generated by b17-aot from " << objectFile << ", do not edit.\n"
+		<< "#include <cstdio>\n#include <cstring>\n#include <cstdlib>\n"
+		<< "//the instruction semantics shared with the interpreter\n#include \"Semantics.h\"\n\n"
+		<< "struct b17_state {\n"
+		<< "\tint AC, X0, X1, X2, X3; //registers\n"
+		<< "\tint memory[4096]; //main memory\n"
+		<< "\tunsigned int instructionAddress; //address of the last instruction executed\n"
+		<< "\tunsigned long long steps; //instructions executed\n"
+		<< "\tconst char *haltReason; //halt message, nullptr if the step limit was reached\n"
+		<< "};\n\n"
+		<< "static void b17_print_registers(int AC, int X0, int X1, int X2, int X3) {\n"
+		<< "\tprintf(\"AC[%06x]   X0[%03x]   X1[%03x]   X2[%03x]   X3[%03x]\\n\", (unsigned)AC, (unsigned)X0, (unsigned)X1, (unsigned)X2, (unsigned)X3);\n"
+		<< "}\n\n"
+		<< "#ifndef B17_TRACE_INSTRUCTION\n#define B17_TRACE_INSTRUCTION(text) if (trace) fputs(text, stdout)\n#endif\n"
+		<< "#ifndef B17_TRACE_REGISTERS\n#define B17_TRACE_REGISTERS() if (trace) b17_print_registers(AC, X0, X1, X2, X3)\n#endif\n"
+		<< "#ifndef B17_FINAL_STATE\n#define B17_FINAL_STATE(state)\n#endif\n"
+		<< "//halt: print the registers (if registers is 1) and the message, then leave b17_run\n"
+		<< "#define B17_STOP(message, registers) do { if (trace) { if (registers) b17_print_registers(AC, X0, X1, X2, X3); puts(message); } "
+		<< "s->haltReason = message; goto done; } while (0)\n"
+		<< "//count the instruction, stopping at the step limit\n"
+		<< "#define B17_STEP(address) do { if (steps == maxSteps) goto done; steps++; s->instructionAddress = address; } while (0)\n\n"
+		<< "//runs the program on s, maxSteps of 0 for no limit. Returns 1 if the machine halted\n"
+		<< "extern \"C\" int b17_run(b17_state *s, int trace, unsigned long long maxSteps) {\n"
+		<< "\tint AC = s->AC, X0 = s->X0, X1 = s->X1, X2 = s->X2, X3 = s->X3;\n"
+		<< "\tint *memory = s->memory;\n"
+		<< "\tunsigned long long steps = 0;\n"
+		<< "\tint tmp;\n"
+		<< "\t(void)tmp;\n"
+		<< "\t(void)memory;\n"
+		<< "\tif (maxSteps == 0)\n\t\tmaxSteps = ~0ULL;\n"
+		<< "\ts->haltReason = nullptr;\n"
+		<< "\tgoto i" << start << ";\n";
+
+	for (size_t n = 0; n < instructions.size(); n++) {
+		instruction &i = instructions[n];
+		traceText.str("");
+		printer.printInstruction(i);
+		if (labelled[n])
+			out << "i" << n << ":";
+		out << " B17_STEP(" << i.instructionAddress << "); B17_TRACE_INSTRUCTION(" << quote(traceText.str()) << ");\n\t";
+		emitInstruction(out, i);
+		out << "\n\tB17_TRACE_REGISTERS();\n";
+	}
+	out << "\tB17_STOP(\"Machine Halted - no more instructions to execute\", 0);\n"
+		<< "done:\n"
+		<< "\ts->AC = AC; s->X0 = X0; s->X1 = X1; s->X2 = X2; s->X3 = X3;\n"
+		<< "\ts->steps += steps;\n"
+		<< "\tB17_FINAL_STATE(s);\n"
+		<< "\treturn s->haltReason != nullptr;\n"
+		<< "}\n\n";
+
+	//initial memory, the data images given to b17-aot
+	out << "//nonzero words of the initial memory\n"
+		<< "static const int b17_initial_memory[][2] = {\n";
+	for (int address = 0; address < 4096; address++) {
+		if (memory[address] != 0)
+			out << "\t{ " << address << ", " << memory[address] << " },\n";
+	}
+	out << "\t{ -1, 0 }\n};\n\n"
+		<< "//sets up a machine with the initial memory and zeroed registers\n"
+		<< "extern \"C\" void b17_init(b17_state *s) {\n"
+		<< "\tmemset(s, 0, sizeof(*s));\n"
+		<< "\tfor (int w = 0; b17_initial_memory[w][0] >= 0; w++)\n"
+		<< "\t\ts->memory[b17_initial_memory[w][0]] = b17_initial_memory[w][1];\n"
+		<< "}\n\n"
+		<< "#ifndef B17_NO_MAIN\n"
+		<< "//runs the program like b17 would. --no-trace prints only the final state, --steps <n> sets a step limit\n"
+		<< "int main(int argc, char *argv[]) {\n"
+		<< "\tstatic b17_state s;\n"
+		<< "\tint trace = 1;\n"
+		<< "\tunsigned long long maxSteps = 0;\n"
+		<< "\tfor (int a = 1; a < argc; a++) {\n"
+		<< "\t\tif (strcmp(argv[a], \"--no-trace\") == 0)\n\t\t\ttrace = 0;\n"
+		<< "\t\telse if (strcmp(argv[a], \"--steps\") == 0 && a + 1 < argc)\n\t\t\tmaxSteps = strtoull(argv[++a], nullptr, 10);\n"
+		<< "\t}\n"
+		<< "\tb17_init(&s);\n"
+		<< "\tif (!b17_run(&s, trace, maxSteps))\n\t\tputs(\"Machine Halted - step limit reached\");\n"
+		<< "\tif (!trace) {\n"
+		<< "\t\tb17_print_registers(s.AC, s.X0, s.X1, s.X2, s.X3);\n"
+		<< "\t\tprintf(\"steps %llu, %s\\n\", s.steps, s.haltReason ? s.haltReason : \"step limit reached\");\n"
+		<< "\t}\n"
+		<< "\treturn 0;\n"
+		<< "}\n"
+		<< "#endif\n";
+}
+
+/************************************************************************
+Function: main
+Author: Jake Davidson
+Description: Loads the data images and object file, then writes the 
+generated source.
+Parameters: argc - number of cmd line args
+			argv - array of cmd line args
+Returns: 0 - End of program
+************************************************************************/
+int main(int argc, char* argv[]) {
+	vector<string> dataFiles; //data images to bake into the initial memory
+	vector<string> files; //object file and output file
+	for (int a = 1; a < argc; a++) {
+		if (string(argv[a]) == "--data" && a + 1 < argc)
+			dataFiles.push_back(argv[++a]);
+		else
+			files.push_back(argv[a]);
+	}
+	if (files.size() != 2) {
+		cout << "Usage: b17-aot [--data <file>]... <object file> <output.cpp>" << endl;
+		return 0;
+	}
+	for (string &file : dataFiles)
+		loadMemoryImage(file);
+	readInstructions(files[0]);
+	if (instructions.empty()) {
+		cout << "No instructions loaded, ensure object file is not empty." << endl;
+		return 0;
+	}
+	ofstream fout(files[1]);
+	if (!fout) {
+		cout << "Could not write " << files[1] << endl;
+		return 0;
+	}
+	generate(fout, files[0]);
+	return 0;
+}
@@ -0,0 +1,196 @@
+/************************************************************************
+Program: b17-client
+Author: Jake Davidson
+Description: Runs a program on the B17 emulator daemon (b17d, see Daemon.h)
+instead of starting a new emulator. Takes the same arguments as b17 for a
+plain run and prints the same output, so scripts can use it in place of
+b17. Runs that need anything else, or find no daemon listening, are
+handed to b17 itself (next to b17-client, or on the PATH).
+Compilation instructions: g++ -o b17-client b17-client.cpp (link with -lrt on older systems)
+Usage: ./b17-client [--socket <path>] [--shm <bytes>] [--no-trace] [--data <file>]... [--steps <n>] [--block-ops] <object file>
+************************************************************************/
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include "Daemon.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifndef _WIN32
+/************************************************************************
+Function: runLocally
+Author: Jake Davidson
+Description: Replaces the client with b17, given the command line without
+the options only b17-client knows. Only returns if b17 cannot be started.
+Parameters: argc - number of cmd line args
+			argv - array of cmd line args
+			trace - false if --no-trace was given, which b17 cannot honour
+************************************************************************/
+void runLocally(int argc, char* argv[], bool trace) {
+	vector<char *> args; //command line of b17
+	string self = argv[0]; //path b17-client was started with
+	size_t slash = self.rfind('/'); //end of its directory
+	string b17 = slash == string::npos ? "b17" : self.substr(0, slash + 1) + "b17"; //b17 next to the client
+	args.push_back((char *)"b17");
+	for (int a = 1; a < argc; a++) {
+		string arg = argv[a];
+		if ((arg == "--socket" || arg == "--shm") && a + 1 < argc)
+			a++;
+		else if (arg != "--no-trace")
+			args.push_back(argv[a]);
+	}
+	args.push_back(nullptr);
+	//b17 has no --no-trace, say so rather than surprise the caller with a trace (on stderr, to keep the output b17's)
+	if (!trace)
+		cerr << "b17-client: b17d not available, running b17, which traces every instruction despite --no-trace" << endl;
+	cout.flush();
+	if (slash != string::npos)
+		execv(b17.c_str(), args.data());
+	execvp("b17", args.data());
+}
+
+/************************************************************************
+Function: connectDaemon
+Author: Jake Davidson
+Description: Connects to the daemon's socket.
+Parameters: path - socket path
+Returns: the connected socket, or -1 if no daemon is listening
+************************************************************************/
+int connectDaemon(string path) {
+	struct sockaddr_un address = {};
+	int connection = socket(AF_UNIX, SOCK_STREAM, 0); //socket to the daemon
+	if (connection < 0 || path.size() >= sizeof(address.sun_path))
+		return -1;
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path.c_str());
+	if (connect(connection, (struct sockaddr *)&address, sizeof(address)) != 0) {
+		close(connection);
+		return -1;
+	}
+	return connection;
+}
+
+/************************************************************************
+Function: copyOutput
+Author: Jake Davidson
+Description: Copies everything the daemon sends to standard output, until
+it closes the connection.
+Parameters: connection - socket to the daemon
+************************************************************************/
+void copyOutput(int connection) {
+	char chunk[1 << 16]; //bytes of the current read
+	ssize_t received; //bytes read
+	while ((received = recv(connection, chunk, sizeof(chunk), 0)) != 0) {
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received < 0)
+			break;
+		cout.write(chunk, received);
+	}
+	cout.flush();
+}
+#endif
+
+/************************************************************************
+Function: main
+Author: Jake Davidson
+Description: Sends the run on the command line to the daemon and prints
+its output, read from the connection or, with --shm, from a result
+segment of the given size that is created for the run and removed after.
+Parameters: argc - number of cmd line args
+			argv - array of cmd line args
+Returns: 0 - End of program, 1 - neither the daemon nor b17 could be used
+************************************************************************/
+int main(int argc, char* argv[]) {
+#ifndef _WIN32
+	daemonRequest request; //the run to ask for
+	string socketPath = daemonSocketPath(); //socket of the daemon
+	size_t shmBytes = 0; //output the result segment holds, 0 to read it from the connection
+	string arg; //current command line argument
+	char directory[4096]; //working directory, where the daemon runs the program from
+	request.maxSteps = ~0ULL;
+	request.blockOps = false;
+	request.trace = true;
+
+	//the same options as b17 for a plain run, anything else is run by b17
+	for (int a = 1; a < argc; a++) {
+		arg = argv[a];
+		if (arg == "--data" && a + 1 < argc)
+			request.dataFiles.push_back(argv[++a]);
+		else if (arg == "--steps" && a + 1 < argc)
+			request.maxSteps = stoull(argv[++a]);
+		else if (arg == "--block-ops")
+			request.blockOps = true;
+		else if (arg == "--no-trace")
+			request.trace = false;
+		else if (arg == "--socket" && a + 1 < argc)
+			socketPath = argv[++a];
+		else if (arg == "--shm" && a + 1 < argc)
+			shmBytes = stoull(argv[++a]);
+		else if (a == argc - 1 && arg.compare(0, 2, "--") != 0)
+			request.objectFile = arg;
+		else
+			break;
+	}
+	if (getcwd(directory, sizeof(directory)))
+		request.directory = directory;
+	int connection = request.objectFile.empty() || request.directory.empty() ? -1 : connectDaemon(socketPath); //socket to the daemon
+	if (connection < 0) {
+		runLocally(argc, argv, request.trace);
+		cout << "Could not reach b17d on " << socketPath << " or start b17" << endl;
+		return 1;
+	}
+
+	daemonResult *result = nullptr; //result segment, with --shm
+	size_t segmentBytes = sizeof(daemonResult) + shmBytes; //size of the segment
+	if (shmBytes > 0) {
+		request.shmName = "/b17-result-" + to_string(getpid());
+		int fd = shm_open(request.shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		void *p = fd < 0 || ftruncate(fd, segmentBytes) != 0 ? MAP_FAILED
+			: mmap(nullptr, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (fd >= 0)
+			close(fd);
+		if (p == MAP_FAILED) {
+			cout << "Could not create result segment " << request.shmName << endl;
+			shm_unlink(request.shmName.c_str());
+			return 1;
+		}
+		result = (daemonResult *)p;
+	}
+
+	string text = formatRequest(request); //request sent to the daemon
+	if (send(connection, text.data(), text.size(), MSG_NOSIGNAL) != (ssize_t)text.size()) {
+		cout << "Could not send the run to b17d on " << socketPath << endl;
+		close(connection);
+		if (result)
+			shm_unlink(request.shmName.c_str());
+		return 1;
+	}
+	//with a result segment, the connection only carries errors about the request
+	copyOutput(connection);
+	close(connection);
+	if (result) {
+		if (result->magic == DAEMON_RESULT_MAGIC) {
+			cout.write((char *)(result + 1), result->length);
+			if (result->state == RESULT_TRUNCATED)
+				cout << endl << "b17-client: output truncated at " << result->capacity << " bytes, see --shm" << endl;
+		}
+		cout.flush();
+		munmap(result, segmentBytes);
+		shm_unlink(request.shmName.c_str());
+	}
+#else
+	cout << "b17-client needs POSIX sockets" << endl;
+#endif
+	return 0;
+}
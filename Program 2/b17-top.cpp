@@ -0,0 +1,99 @@
+/************************************************************************
+Program: b17-top
+Author: Jake Davidson
+Description: Displays the live metrics of a running B17 emulator started
+with --metrics. The metrics are read from the shared memory segment 
+/b17-<pid> without pausing the emulator, and redrawn every second until
+the machine halts.
+Compilation instructions: g++ -o b17-top b17-top.cpp const.cpp (link with -lrt on older systems)
+Usage: ./b17-top <pid of b17>
+************************************************************************/
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include "LiveMetrics.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/************************************************************************
+Function: printMetrics
+Author: Jake Davidson
+Description: Prints the counters and the opcode histogram, most executed
+opcode first.
+Parameters: metrics - segment to print
+************************************************************************/
+void printMetrics(liveMetrics *metrics) {
+	vector<pair<unsigned long long, int> > histogram; //count and opcode, for sorting
+	unsigned long long retired = metrics->retired.load(memory_order_relaxed);
+	cout << "b17 pid " << dec << metrics->pid << (metrics->running.load(memory_order_relaxed) ? " running" : " halted") << endl;
+	cout << "  instructions retired: " << retired << endl;
+	cout << "  instructions/second:  " << metrics->instructionsPerSecond.load(memory_order_relaxed) << endl;
+	cout << "  taken jumps:          " << metrics->takenJumps.load(memory_order_relaxed) << endl;
+	cout << "  instruction register: " << hex << setw(3) << setfill('0')
+		<< metrics->currentAddress.load(memory_order_relaxed) << dec << endl;
+	for (int op = 0; op <= UNDEFINED; op++)
+		histogram.push_back(make_pair(metrics->opcodeCounts[op].load(memory_order_relaxed), op));
+	sort(histogram.rbegin(), histogram.rend());
+	for (pair<unsigned long long, int> &h : histogram) {
+		if (h.first == 0)
+			break;
+		cout << "  " << setw(5) << setfill(' ') << left << (h.second == UNDEFINED ? "???" : opCodesPrintMap[(opCodes)h.second])
+			<< right << setw(16) << h.first << setw(7) << fixed << setprecision(2) << (100.0 * h.first / max(1ULL, retired)) << "%" << endl;
+	}
+}
+
+/************************************************************************
+Function: main
+Author: Jake Davidson
+Description: Opens the metrics segment of the given process and prints it
+every second until the machine halts.
+Parameters: argc - number of cmd line args
+			argv - array of cmd line args
+Returns: 0 - End of program, 1 - the segment could not be opened
+************************************************************************/
+int main(int argc, char* argv[]) {
+	if (argc != 2) {
+		cout << "Usage: b17-top <pid of b17>" << endl;
+		return 0;
+	}
+#ifndef _WIN32
+	string name = string("/b17-") + argv[1];
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		cout << "No metrics for process " << argv[1] << ", was b17 started with --metrics?" << endl;
+		return 1;
+	}
+	void *p = mmap(nullptr, sizeof(liveMetrics), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		cout << "Could not map metrics segment " << name << endl;
+		return 1;
+	}
+	liveMetrics *metrics = (liveMetrics *)p;
+	if (metrics->magic != METRICS_MAGIC || metrics->version != METRICS_VERSION) {
+		cout << "Metrics segment " << name << " is not from a compatible b17" << endl;
+		return 1;
+	}
+	while (true) {
+		//clear the screen and redraw
+		cout << "\033[H\033[2J";
+		printMetrics(metrics);
+		cout << flush;
+		if (!metrics->running.load(memory_order_relaxed))
+			break;
+		sleep(1);
+	}
+	munmap(p, sizeof(liveMetrics));
+#else
+	cout << "b17-top needs POSIX shared memory" << endl;
+#endif
+	return 0;
+}
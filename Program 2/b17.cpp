@@ -48,10 +48,14 @@ is executed.
 Input: instructions.obj as a command line argument
 Output: trace line of each instruction and the contents of the registers after its execution
 Compilation instructions: run "make" in program directory
-Usage: ./b17 <object file>
+Compilation options: define TRACK_MEMORY to write a report of the memory words read and written
+(dirty ranges and a heat map) to memory_report.txt when the machine halts. Also define
+TRACK_MEMORY_COUNTS to count every access to each word. Define SIMULATE_CACHE to simulate a
+cache hierarchy (--cache, see CacheSimulator.h) and write cache_report.txt when the machine halts.
+Usage: ./b17 [options] <object file>, run without arguments to list the options
 Known bugs/missing features: In the example object files and output on the handout, it appears that program memory is 
-already populated. In this program, all memory starts at 0, so many of the accumulator values do not match. This is not
-technically a bug, since it is just a difference of implementation, but it is important to note nonetheless.
+already populated. In this program, all memory starts at 0 unless a data image is loaded with --data (see MemoryImage.h),
+so without one many of the accumulator values do not match.
 ************************************************************************/
 #include <iostream>
 #include <fstream>
@@ -61,18 +65,37 @@ technically a bug, since it is just a difference of implementation, but it is im
 #include "ExecuteInstruction.h"
 #include "globals.h"
 #include "const.h"
+#include "MemoryTracker.h"
+#include "Sweep.h"
+#include "Lockstep.h"
+#include "MemoryImage.h"
+#include "GoldenTrace.h"
+#include "Loader.h"
+#include "Scheduler.h"
+#include "LiveMetrics.h"
+#include "GdbStub.h"
+#include "PipelinedLoader.h"
+#include "LazyLoader.h"
+#include "Optimizer.h"
+#include "ProgramImage.h"
+#include "HostCounters.h"
+#include "ResultCache.h"
+#include "SparseMemory.h"
+#include "DependencyAnalysis.h"
+#include "BlockOps.h"
+#include "MultiCore.h"
+#include "PipelineModel.h"
+#include "BlockLayout.h"
+#include "Daemon.h"
 
 using namespace std;
 
-void readInstructions(string file);
-void execute();
-vector<string> splitString(string s);
-int getIndexRegister(string s);
-unsigned int getOperandAddress(string s);
-addrModes getAddrMode(string s);
-opCodes getOpCode(string s);
-string convertToBin(string s);
-string pad(string s);
+void execute(unsigned long long maxSteps, liveMetrics *metrics, DeviceBus *devices, PipelinedLoader *loader, LazyLoader *lazy,
+	PipelineModel *pipeline);
+void expectTrace(string file, unsigned long long maxSteps);
+void dropOption(bool &option, string name, string reason);
+void dropOption(string &option, string name, string reason);
+void printUsage();
 
 /************************************************************************
 Function: main
@@ -84,516 +107,477 @@ Parameters: argc - number of cmd line args
 Returns: 0 - End of program
 ************************************************************************/
 int main(int argc, char* argv[]) {
-	//verify command line arguments
-	if (argc != 2) {
-		cout << "Please only supply the program with the object file as cmd args." << endl;
-		return 0;
-	}
-	//read instructions from object file
-	//this function populates the instructions vector
-	readInstructions(argv[1]); 
-	//done reading in instructions
-	//start executing instructions
-	if(!instructions.empty())
-		execute();
-	else 
-		cout << "No instructions loaded, ensure object file is not empty." << endl;
-	return 0;
-}
-
-/************************************************************************
-Function: readInstructions
-Author: Jake Davidson
-Description: Loops through each line of input object file and decodes
-each instruction. Inserts each instruction into instructions vector.
-Parameters: file - the object file to read from
-************************************************************************/
-void readInstructions(string file) {
-	ifstream fin; //stream to read file from
-	vector<string> instructionList; //list of hex instructions on the current line
-	string currentLine, //current line being read in
-		instructionString; //current instruction being decoded
-	instruction currentInstruction; //instruction to build as we decode instructionString
-	int num; //number of instructions on the current line
-	unsigned int startAddress; //address of the current instruction
+	string objectFile = ""; //object file to run
+	string sweepFile = ""; //variants file, set for sweep mode
+	string expectFile = ""; //golden trace to compare the trace with
+	string jobsFile = ""; //jobs file, set for scheduler mode
+	string gdbTarget = ""; //port or socket path to wait for a debugger on
+	string daemonSocket = ""; //socket to serve runs on as a daemon, empty to run a program
+	string devicesFile = ""; //memory-mapped devices of the machine
+	string cacheFile = ""; //cache hierarchy to simulate, when built with SIMULATE_CACHE
+	string imageCache = ""; //directory of predecoded program images, empty to always decode
+	string resultCache = ""; //directory of stored run results, empty to always execute
+	string layoutProfile = ""; //profile to reorder the program from, empty for none
+	string profileOut = ""; //profile to write, empty for none
+	unsigned long long layoutWarmup = 0; //steps profiled before reordering the program, 0 for none
+	unsigned long long resultCacheMB = DEFAULT_RESULT_CACHE_MB; //size limit of the result cache
+	static DeviceBus devices; //devices placed from devicesFile, static so a loader error's exit() still closes their output
+	unsigned long long quantum = DEFAULT_QUANTUM; //instructions a scheduled job runs before preemption
+	unsigned long long counterInterval = 0; //dispatches between host counter measurements, 0 for none
+	bool publishMetrics = false; //true to publish live metrics in shared memory
+	bool lockstep = false; //true to run sweep variants in lockstep groups
+	bool stream = false; //true to start executing while the object file is decoded
+	bool lazyDecode = false; //true to decode each instruction when it is first fetched
+	bool optimize = false; //true to optimize the program before running it
+	bool dependencies = false; //true to analyse the dependencies of the run
+	bool blockOps = false; //true to decode the bulk memory extension
+	bool pipelined = false; //true to time the run on the pipeline model
+	bool forwarding = true; //true if the pipeline model forwards results
+	predictorKind predictor = TWO_BIT_PREDICTOR; //jump predictor of the pipeline model
+	PipelinedLoader loader; //decodes the object file while it runs, with --stream
+	LazyLoader lazy; //decodes instructions as they are fetched, with --lazy-decode
+	liveMetrics *metrics = nullptr; //published metrics, if enabled
+	vector<string> dataFiles; //data images to load into memory, in order
+	int jobs = 0; //threads to run sweep variants on, 0 for one per core
+	int cores = 1; //B17 cores running the program over shared memory
+	bool freeRunning = false; //true to run the cores on their own threads instead of interleaving them
+	unsigned long long interleave = 1; //instructions per turn when the cores are interleaved
+	unsigned long long interleaveSeed = 0; //seed of the interleaving order, 0 for core order
+	int addressBits = MIN_ADDRESS_BITS; //width of an address, wider than 12 for extended addressing
+	unsigned long long maxSteps = UNLIMITED_STEPS; //most instructions to execute
+	string arg; //current command line argument
+	string name = argv[0]; //name the emulator was started with
 
-	//check that the file was opened successfully
-	fin.open(file);
-	if (!fin) {
-		cout << "Could not open object file, ensure the path is correct." << endl;
-		exit(0);
-	}
-
-	//read in the object file and add instructions to the list
-	while (getline(fin, currentLine)) {
-		instructionList = splitString(currentLine);
-		//if we are not at the last line (last line only contains start address)
-		if (instructionList.size() != 1) {
-			//get the number of instructions on this line
-			num = stoi(instructionList.at(1));
-			//get the start address of the first instruction of the line
-			startAddress = stol(instructionList[0], nullptr, 16);
-			//loop through instructions on the current line adding them to the program
-			for (int i = 0; i < num; i++) {
-				//build current instruction (offset by 2 because of first two items not being instructions)
-				instructionString = instructionList.at(i + 2);
-				//store the hex value of the instruction to print in trace line
-				currentInstruction.instructionHexString = instructionString;
-				//convert the string to binary to extract bits to decode instruction
-				instructionString = convertToBin(instructionString);
-				//pad with 0s on left if too short
-				instructionString = pad(instructionString);
-				//read in current instruction
-				//get instruction address
-				currentInstruction.instructionAddress = startAddress;
-				//get the 2-bit index register number
-				currentInstruction.indexRegister = getIndexRegister(instructionString);
-				//get the addressing mode (bits 5-2)
-				currentInstruction.addressMode = getAddrMode(instructionString);
-				//get the opcode (bits 11-6)
-				currentInstruction.opCode = getOpCode(instructionString);
-				//get the operand address (bits 23-12)
-				currentInstruction.operandAddress = getOperandAddress(instructionString);
-
-				//calculate the EA of the instruction
-				if (currentInstruction.addressMode == Direct) {
-					currentInstruction.EA = currentInstruction.operandAddress;
-				}
-				//technically there is no EA, but I set it to the immediate value to 
-				//not have to have another variable in the struct only used with IMM
-				else if (currentInstruction.addressMode == Immediate) {
-					currentInstruction.EA = currentInstruction.operandAddress;
-				}
-				//for indexed mode, the ea is the memory location at operandAddress + register contents
-				else if (currentInstruction.addressMode == Indexed) {
-					//get the index register to add to the operand address
-					switch (currentInstruction.indexRegister)
-					{
-					case 0:
-						currentInstruction.EA = currentInstruction.operandAddress + X0;
-					case 1:
-						currentInstruction.EA = currentInstruction.operandAddress + X1;
-					case 2:
-						currentInstruction.EA = currentInstruction.operandAddress + X2;
-					case 3:
-						currentInstruction.EA = currentInstruction.operandAddress + X3;
-					default:
-						break;
-					}
-				}
-				//Indirect addressing mode
-				else {
-					//get EA from memory address
-					currentInstruction.EA = memory[currentInstruction.operandAddress];
-				}
-
-				//add to instruction vector
-				instructions.push_back(currentInstruction);
-				//increment the starting address for next loop
-				startAddress = startAddress + 1;
-			}
+	//started as b17d, the emulator is the daemon
+	if (name.size() >= 4 && name.compare(name.size() - 4, 4, "b17d") == 0)
+		daemonSocket = daemonSocketPath();
+	//verify command line arguments
+	//options come first, the last argument is the object file
+	for (int a = 1; a < argc; a++) {
+		arg = argv[a];
+		if (arg == "--sweep" && a + 1 < argc)
+			sweepFile = argv[++a];
+		else if (arg == "--data" && a + 1 < argc)
+			dataFiles.push_back(argv[++a]);
+		else if (arg == "--expect" && a + 1 < argc)
+			expectFile = argv[++a];
+		else if (arg == "--schedule" && a + 1 < argc)
+			jobsFile = argv[++a];
+		else if (arg == "--quantum" && a + 1 < argc)
+			quantum = stoull(argv[++a]);
+		else if (arg == "--host-counters" && a + 1 < argc && stoull(argv[a + 1]) > 0)
+			counterInterval = stoull(argv[++a]);
+		else if (arg == "--gdb" && a + 1 < argc)
+			gdbTarget = argv[++a];
+		else if (arg == "--daemon" && a + 1 < argc)
+			daemonSocket = argv[++a];
+#ifdef SIMULATE_CACHE
+		else if (arg == "--cache" && a + 1 < argc)
+			cacheFile = argv[++a];
+#endif
+		else if (arg == "--image-cache" && a + 1 < argc)
+			imageCache = argv[++a];
+		else if (arg == "--result-cache" && a + 1 < argc)
+			resultCache = argv[++a];
+		else if (arg == "--result-cache-size" && a + 1 < argc)
+			resultCacheMB = stoull(argv[++a]);
+		else if (arg == "--layout" && a + 1 < argc)
+			layoutProfile = argv[++a];
+		else if (arg == "--layout-warmup" && a + 1 < argc)
+			layoutWarmup = stoull(argv[++a]);
+		else if (arg == "--profile-out" && a + 1 < argc)
+			profileOut = argv[++a];
+		else if (arg == "--devices" && a + 1 < argc)
+			devicesFile = argv[++a];
+		else if (arg == "--address-bits" && a + 1 < argc && stoi(argv[a + 1]) >= MIN_ADDRESS_BITS && stoi(argv[a + 1]) <= MAX_ADDRESS_BITS)
+			addressBits = stoi(argv[++a]);
+		else if (arg == "--stream")
+			stream = true;
+		else if (arg == "--lazy-decode")
+			lazyDecode = true;
+		else if (arg == "--block-ops")
+			blockOps = true;
+		else if (arg == "--pipeline" && a + 1 < argc && parsePredictor(argv[a + 1], predictor)) {
+			pipelined = true;
+			a++;
 		}
-		//we are at the last line, which contains the location to start execution
+		else if (arg == "--no-forwarding")
+			forwarding = false;
+		else if (arg == "--dependencies")
+			dependencies = true;
+		else if (arg == "--optimize")
+			optimize = true;
+		else if (arg == "--lockstep")
+			lockstep = true;
+		else if (arg == "--metrics")
+			publishMetrics = true;
+		else if (arg == "--cores" && a + 1 < argc && stoi(argv[a + 1]) >= 1 && stoi(argv[a + 1]) <= MAX_CORES)
+			cores = stoi(argv[++a]);
+		else if (arg == "--interleave" && a + 1 < argc && stoull(argv[a + 1]) > 0)
+			interleave = stoull(argv[++a]);
+		else if (arg == "--interleave-seed" && a + 1 < argc)
+			interleaveSeed = stoull(argv[++a]);
+		else if (arg == "--free-running")
+			freeRunning = true;
+		else if (arg == "--jobs" && a + 1 < argc)
+			jobs = stoi(argv[++a]);
+		else if (arg == "--steps" && a + 1 < argc)
+			maxSteps = stoull(argv[++a]);
+		else if (a == argc - 1 && arg.compare(0, 2, "--") != 0)
+			objectFile = arg;
 		else {
-			if (!instructions.empty()) {
-				startAddress = stol(instructionList[0], nullptr, 16);
-				//look through instructions to find the one with startAddress
-				for (vector<instruction>::iterator it = instructions.begin(); it != instructions.end(); it++) {
-					//when we find the start address in the instructions vector, set our instruction register to its location
-					if (it->instructionAddress == startAddress) {
-						instructionRegister = it;
-						break;
-					}
-					//if there was no instruction location at the end of the file to start at
-					if (it == instructions.end()) {
-						cout << "Machine Halted - no instruction at start address" << endl;
-						exit(0);
-					}
-				}
-
-			}
-			else {
-				//no instructions read in
-				cout << "Machine Halted - No instructions to execute";
-				exit(0);
-			}
+			printUsage();
+			return 0;
 		}
 	}
-}
-
-/************************************************************************
-Function: execute
-Author: Jake Davidson
-Description: Loops throught the list of instructions, exectuing them 
-one by one. If there is a jump, it sets instructionRegister to the address
-of the jump if it is a valid jump. It also prints a trace line
-for each instruction, and the contents of the AC and 4 index registers
-after each instruction has finished executing. This runs in an infinite loop
-until it reaches an error, a halt instruction, or the end of the instructions
-************************************************************************/
-void execute() {
-	ExecuteInstruction ins; //container class for instructions and ALU operations
-	bool jump; //bool to keep track of whether or not we have jumped or not
-	//run instructions until we hit halt or have an error
-	while (true) {
-		jump = false;
-		instruction i = *instructionRegister;
-		//print current instructions and all related data
-		ins.printInstruction(i);
-
-		//execute the instruction based on op code
-		switch (instructionRegister->opCode)
-		{
-		case HALT:
-			ins.halt();
-			break;
-		case NOP:
-			//do nothing
-			break;
-		case LD:
-			ins.LD(i);
-			break;
-		case ST:
-			ins.ST(i);
-			break;
-		case EM:
-			ins.EM(i);
-			break;
-		case LDX:
-			ins.LDX(i);
-			break;
-		case STX:
-			ins.STX(i);
-			break;
-		case EMX:
-			ins.EMX(i);
-			break;
-		case ADD:
-			ins.ADD(i);
-			break;
-		case SUB:
-			ins.SUB(i);
-			break;
-		case CLR:
-			ins.CLR();
-			break;
-		case COM:
-			ins.COM();
-			break;
-		case AND:
-			ins.AND(i);
-			break;
-		case OR:
-			ins.OR(i);
-			break;
-		case XOR:
-			ins.XOR(i);
-			break;
-		case ADDX:
-			ins.ADDX(i);
-			break;
-		case SUBX:
-			ins.SUBX(i);
-			break;
-		case CLRX:
-			ins.CLRX(i);
-			break;
-		case J:
-			jump = ins.J(i);
-			break;
-		case JZ:
-			jump = ins.JZ(i);
-			break;
-		case JN:
-			jump = ins.JN(i);
-			break;
-		case JP:
-			jump = ins.JP(i);
-			break;
-		default:
-			ins.printRegisters();
-			cout << "Machine Halted - undefined opcode" << endl;
-			exit(0);
-			break;
+	//SIGUSR1 writes a snapshot of the running machine
+	installSnapshotHandler();
+	//the extension changes how every program is decoded, including scheduled jobs
+	if (blockOps)
+		enableBlockOps();
+	//extended addressing pages the global machine's memory, other machines keep 4096 words
+	if (addressBits > MIN_ADDRESS_BITS) {
+		if (!sweepFile.empty() || !jobsFile.empty() || !gdbTarget.empty()) {
+			cout << "--address-bits cannot be used with --sweep, --schedule or --gdb" << endl;
+			return 0;
 		}
-		//print contents of registers after instruction is executed
-		ins.printRegisters();
-
-		//if we do not jump, we need to point instructionRegister to the 
-		//next instruction in the list
-		if (!jump) {
-			//if we are not at the end of the list
-			if (instructionRegister + 1 != instructions.end()) {
-				instructionRegister++;
-			}
-			//we have executed the last instruction and there was no jump
-			//end the program
-			else {
-				cout << "Machine Halted - no more instructions to execute" << endl;
-				exit(0);
-			}
+		extendedMemory = new SparseMemory(addressBits, memory);
+		//these only know the 4096 word machine
+		dropOption(stream, "--stream", "with --address-bits");
+		dropOption(optimize, "--optimize", "with --address-bits");
+		dropOption(lazyDecode, "--lazy-decode", "with --address-bits");
+		dropOption(resultCache, "--result-cache", "with --address-bits");
+	}
+	//the other modes only know a single core
+	if (cores > 1) {
+		if (!sweepFile.empty() || !jobsFile.empty() || !gdbTarget.empty() || !expectFile.empty() || !devicesFile.empty()
+			|| counterInterval > 0 || dependencies || addressBits > MIN_ADDRESS_BITS) {
+			cout << "--cores cannot be used with --sweep, --schedule, --gdb, --expect, --devices, --host-counters, "
+				<< "--dependencies or --address-bits" << endl;
+			return 0;
 		}
+		//the optimizer would remove loads of words other cores write
+		dropOption(stream, "--stream", "with --cores");
+		dropOption(lazyDecode, "--lazy-decode", "with --cores");
+		dropOption(optimize, "--optimize", "with --cores");
+		dropOption(resultCache, "--result-cache", "with --cores");
 	}
-}
-
-/************************************************************************
-Function: getAddrMode
-Author: Jake Davidson
-Description: Extracts the addressing mode from a string of bits.
-It then matches those bits with an addressing mode enum. 
-Paramaters: s - string of bits to extract from
-Returns: a - enum of the addressing mode extracted
-************************************************************************/
-addrModes getAddrMode(string s) {
-	addrModes a; //addressing mode to return
-	string addressMode; //holds extracted bits
-	//iterator to a key, value in map, the map maps bits to an address mode enum
-	map<string, addrModes>::iterator it;
-	//extract address mode from bitstring
-	addressMode = s.substr(18, 4);
-	//match address mode bits to address mode
-	it = addressMap.find(addressMode);
-	//if we found a match in the map, assign it to a
-	if (it != addressMap.end()) {
-		a = it->second;
+	//devices are only wired into a plain run
+	if (!devicesFile.empty() && (!sweepFile.empty() || !jobsFile.empty() || !expectFile.empty() || !gdbTarget.empty()
+		|| counterInterval > 0 || dependencies || !daemonSocket.empty())) {
+		cout << "--devices cannot be used with --sweep, --schedule, --expect, --gdb, --host-counters, --dependencies "
+			<< "or --daemon" << endl;
+		return 0;
 	}
-	//otherwise, make a illegal so it outputs error during execution
-	else {
-		a = Illegal;
+	//the pipeline model only times a plain run
+	if (pipelined && (!sweepFile.empty() || !jobsFile.empty() || !expectFile.empty() || counterInterval > 0 || dependencies
+		|| cores > 1 || !gdbTarget.empty() || !daemonSocket.empty())) {
+		cout << "--pipeline cannot be used with --sweep, --schedule, --expect, --host-counters, --dependencies, --cores, "
+			<< "--gdb or --daemon" << endl;
+		return 0;
 	}
-	//return the address mode for the instruction
-	return a;
-}
-
-/************************************************************************
-Function: getOpCode
-Author: Jake Davidson
-Description: Extracts the operation code from a string of bits. Then converts
-those bits into an enum of the op code for use later when executing instruction.
-Paramaters: s - string of bits to extract from
-Returns: op - enum of the operation code extracted
-************************************************************************/
-opCodes getOpCode(string s) {
-	opCodes op = UNDEFINED; //op code to return, with default value of Undefined
-	//strings to hold the category bits and the specifier bits
-	string category = "", specifier = "";
-	//extract category bits
-	category = s.substr(12, 2);
-	//extract specifier bits
-	specifier = s.substr(14, 4);
-	//match bitstrings to opcode
-	//there are 4 categories, and bits within those
-	//categories determine the operation code
-	//String that are compared here are defined in const.h
-	if (category == MISC) {
-		if (specifier == S_HALT)
-			op = HALT;
-		else if (specifier == S_NOP)
-			op = NOP;
+	//a replayed result would not time anything
+	if (pipelined)
+		dropOption(resultCache, "--result-cache", "with --pipeline");
+	//the layout replaces file order, which the other loaders and the optimizer rely on
+	bool layout = !layoutProfile.empty() || layoutWarmup > 0 || !profileOut.empty(); //true to profile or reorder the program
+	if (layout) {
+		if (!devicesFile.empty() || pipelined) {
+			cout << "--layout, --layout-warmup and --profile-out cannot be used with --devices or --pipeline" << endl;
+			return 0;
+		}
+		dropOption(stream, "--stream", "with --layout, --layout-warmup or --profile-out");
+		dropOption(lazyDecode, "--lazy-decode", "with --layout, --layout-warmup or --profile-out");
+		dropOption(optimize, "--optimize", "with --layout, --layout-warmup or --profile-out");
+		dropOption(resultCache, "--result-cache", "with --layout, --layout-warmup or --profile-out");
+	}
+	//the daemon runs the programs its clients ask for
+	if (!daemonSocket.empty()) {
+		runDaemon(daemonSocket, jobs, imageCache);
+		return 0;
+	}
+	//scheduler mode reads its programs from the jobs file
+	if (!jobsFile.empty() && !objectFile.empty()) {
+		cout << "--schedule cannot be used with an object file, the jobs file names the programs" << endl;
+		return 0;
+	}
+	if (!jobsFile.empty()) {
+		runScheduler(jobsFile, jobs, quantum, maxSteps);
+		return 0;
+	}
+	if (objectFile.empty()) {
+		printUsage();
+		return 0;
+	}
+#ifdef TRACK_MEMORY
+	//report memory accesses however the machine halts
+	atexit(writeMemoryReport);
+#endif
+#ifdef SIMULATE_CACHE
+	//report cache behaviour however the machine halts
+	if (cacheFile.empty())
+		cacheSimulator.useDefault();
+	else if (!cacheSimulator.configure(cacheFile))
+		return 0;
+	cacheSimulator.reportTo(CACHE_REPORT_FILE);
+#endif
+#if defined(TRACK_MEMORY) || defined(SIMULATE_CACHE)
+	//the reports must describe a run, not a replayed result
+	dropOption(resultCache, "--result-cache", "when memory is tracked or caches are simulated");
+#endif
+	//load initial memory before decoding, so indirect addresses see it
+	for (string &file : dataFiles)
+		loadMemoryImage(file);
+	//streaming, lazy decoding and stored results only apply when the program is simply run
+	if (!sweepFile.empty() || !expectFile.empty() || !gdbTarget.empty() || counterInterval > 0 || dependencies) {
+		dropOption(stream, "--stream", "with --sweep, --expect, --gdb, --host-counters or --dependencies");
+		dropOption(lazyDecode, "--lazy-decode", "with --sweep, --expect, --gdb, --host-counters or --dependencies");
+		dropOption(resultCache, "--result-cache", "with --sweep, --expect, --gdb, --host-counters or --dependencies");
+	}
+	//results depend on the host when there are devices, so those runs always execute
+	if (!devicesFile.empty())
+		dropOption(resultCache, "--result-cache", "with --devices");
+	//a streamed program is never whole, so it is neither saved as an image nor replayed
+	if (stream) {
+		dropOption(lazyDecode, "--lazy-decode", "with --stream");
+		dropOption(imageCache, "--image-cache", "with --stream");
+		dropOption(resultCache, "--result-cache", "with --stream");
 	}
-	else if (category == MEM) {
-		if (specifier == S_LD)
-			op = LD;
-		else if (specifier == S_ST)
-			op = ST;
-		else if (specifier == S_EM)
-			op = EM;
-		else if (specifier == S_LDX)
-			op = LDX;
-		else if (specifier == S_STX)
-			op = STX;
-		else if (specifier == S_EMX)
-			op = EMX;
+	//lazy decoding has nothing to gain from a cached image or result
+	if (lazyDecode) {
+		dropOption(imageCache, "--image-cache", "with --lazy-decode");
+		dropOption(resultCache, "--result-cache", "with --lazy-decode");
 	}
-	else if (category == ALU) {
-		if (specifier == S_ADD)
-			op = ADD;
-		else if (specifier == S_SUB)
-			op = SUB;
-		else if (specifier == S_CLR)
-			op = CLR;
-		else if (specifier == S_COM)
-			op = COM;
-		else if (specifier == S_AND)
-			op = AND;
-		else if (specifier == S_OR)
-			op = OR;
-		else if (specifier == S_XOR)
-			op = XOR;
-		else if (specifier == S_ADDX)
-			op = ADDX;
-		else if (specifier == S_SUBX)
-			op = SUBX;
-		else if (specifier == S_CLRX)
-			op = CLRX;
+	//the optimizer needs the whole program, and changes the trace and what a debugger sees
+	if (stream || lazyDecode)
+		dropOption(optimize, "--optimize", "with --stream or --lazy-decode");
+	if (!expectFile.empty() || !gdbTarget.empty())
+		dropOption(optimize, "--optimize", "with --expect or --gdb");
+	if (blockOps)
+		dropOption(optimize, "--optimize", "with --block-ops");
+	//devices are placed before the program is optimized, which leaves their words alone
+	if (!devicesFile.empty() && !devices.configure(devicesFile))
+		return 0;
+	if (stream) {
+		//decode the object file while the program runs
+		if (!loader.start(objectFile)) {
+			cout << "Could not open object file, ensure the path is correct." << endl;
+			return 0;
+		}
+	}
+	else if (lazyDecode) {
+		//only read the words of the object file, decoding the start instruction
+		if (!lazy.start(objectFile)) {
+			cout << "Could not open object file, ensure the path is correct." << endl;
+			return 0;
 		}
-	else if (category == TRANS) {
-		if (specifier == S_J)
-			op = J;
-		else if (specifier == S_JZ)
-			op = JZ;
-		else if (specifier == S_JN)
-			op = JN;
-		else if (specifier == S_JP)
-			op = JP;
+	}
+	else if (!imageCache.empty()) {
+		//load the predecoded program, decoding and saving it if there is no valid image
+		loadCachedProgram(objectFile, imageCache);
 	}
 	else {
-		//op code was undefined
-		op = UNDEFINED;
+		//read instructions from object file
+		//this function populates the instructions vector
+		readInstructions(objectFile);
 	}
-
-	return op;
+	//optimize the program between loading and running it
+	if (optimize && !instructions.empty()) {
+		Optimizer optimizer(instructions, instructionRegister, devicesFile.empty() ? nullptr : &devices);
+		if (optimizer.optimize())
+			optimizer.printSummary(cout);
+		else
+			cout << "Instructions share an address, running the program unoptimized." << endl;
+	}
+	//done reading in instructions
+	//start executing instructions
+	if (!stream && instructions.empty())
+		cout << "No instructions loaded, ensure object file is not empty." << endl;
+	else if (!sweepFile.empty() && lockstep)
+		runLockstepSweep(sweepFile, jobs, maxSteps);
+	else if (!sweepFile.empty())
+		runSweep(sweepFile, jobs, maxSteps);
+	else if (!expectFile.empty())
+		expectTrace(expectFile, maxSteps);
+	else if (counterInterval > 0)
+		runWithHostCounters(maxSteps, counterInterval);
+	else if (dependencies)
+		runWithDependencyAnalysis(maxSteps);
+	else if (cores > 1)
+		runMultiCore(cores, freeRunning, interleave, interleaveSeed, maxSteps);
+	else if (layout && gdbTarget.empty())
+		runWithLayout(maxSteps, layoutProfile, layoutWarmup, profileOut);
+	else if (!gdbTarget.empty()) {
+		GdbStub stub;
+		if (stub.listen(gdbTarget))
+			stub.serve();
+		else
+			cout << "Could not wait for a debugger on " << gdbTarget << endl;
+	}
+	else {
+		if (publishMetrics) {
+			metrics = openMetrics();
+			if (!metrics)
+				cout << "Could not create live metrics segment, running without it." << endl;
+		}
+		if (!resultCache.empty())
+			runWithResultCache(resultCache, resultCacheMB << 20, maxSteps, metrics);
+		else {
+			PipelineModel pipeline(predictor, forwarding); //times the run, with --pipeline
+			execute(maxSteps, metrics, devicesFile.empty() ? nullptr : &devices, stream ? &loader : nullptr, lazyDecode ? &lazy : nullptr,
+				pipelined ? &pipeline : nullptr);
+			if (pipelined)
+				pipeline.printReport(cout);
+		}
+		closeMetrics(metrics);
+		if (lazyDecode)
+			lazy.printSummary(cout);
+	}
+	delete extendedMemory;
+	return 0;
 }
 
 /************************************************************************
-Function: getIndexRegister
+Function: dropOption
 Author: Jake Davidson
-Description: Extracts the specified index register from the instruction.
-Returns 0-3, to specify the register
-Paramaters: s - string of bits to extract from
-Returns: indexRegister - register specified in the instruction
+Description: Turns off an option the rest of the command line rules out,
+saying so if it was given.
+Parameters: option - the option's setting, cleared
+			name - the option on the command line
+			reason - what rules it out, such as "with --cores"
 ************************************************************************/
-int getIndexRegister(string s) {
-	string registerString = ""; //holds extracted string
-	int indexRegister; //number register to return
-	registerString = s.substr(22, 2); //extract the bits
-	//match the bits to an index register
-	if (registerString == R_0)
-		indexRegister = 0;
-	else if (registerString == R_1)
-		indexRegister = 1;
-	else if (registerString == R_2)
-		indexRegister = 2;
-	else if (registerString == R_3)
-		indexRegister = 3;
-	else {
-		//for some reason, you got here. Should be impossible, as we check all
-		//possible 2 bit combinations
-		cout << "Invalid register number, something went horribly wrong." << endl;
-		exit(0);
-	}
-	return indexRegister;
+void dropOption(bool &option, string name, string reason) {
+	if (option)
+		cout << name << " is ignored " << reason << endl;
+	option = false;
 }
 
 /************************************************************************
-Function: getOperandAddress
+Function: dropOption
 Author: Jake Davidson
-Description: Extracts the operand address from a string of bits. Returns
-the address as an unsigned integer.
-Paramaters: s - string of bits to extract from
-Returns: address - address in the address field
+Description: Turns off an option naming a file or directory that the rest
+of the command line rules out, saying so if it was given.
+Parameters: option - the option's setting, cleared
+			name - the option on the command line
+			reason - what rules it out, such as "with --cores"
 ************************************************************************/
-unsigned int getOperandAddress(string s) {
-	string addressString = ""; //holds the string of extracted bits
-	int address = 0; //address to return
-	addressString = s.substr(0, 12); //extract the bits
-	//convert to an int
-	address = stoi(addressString, nullptr, 2);
-	//return the address
-	return address;
+void dropOption(string &option, string name, string reason) {
+	if (!option.empty())
+		cout << name << " is ignored " << reason << endl;
+	option.clear();
 }
 
 /************************************************************************
-Function: convertToBin
+Function: printUsage
 Author: Jake Davidson
-Description: Converts a string of hex to a string of binary. It does this
-by replacing each hex char with 4 binary bits.
-Paramaters: s - string to convert
-Returns: binString - string of converted binary
+Description: Prints the command line usage and the supported options.
 ************************************************************************/
-string convertToBin(string s) {
-	string binString = ""; //holds binary string
-	//for each character in the hex string, replace with corresponding
-	//binary value
-	for (char c : s) {
-		switch (c) {
-		case '0':
-			binString.append("0000");
-			break;
-		case '1':
-			binString.append("0001");
-			break;
-		case '2':
-			binString.append("0010");
-			break;
-		case '3':
-			binString.append("0011");
-			break;
-		case '4':
-			binString.append("0100");
-			break;
-		case '5':
-			binString.append("0101");
-			break;
-		case '6':
-			binString.append("0110");
-			break;
-		case '7':
-			binString.append("0111");
-			break;
-		case '8':
-			binString.append("1000");
-			break;
-		case '9':
-			binString.append("1001");
-			break;
-		case 'a':
-			binString.append("1010");
-			break;
-		case 'b':
-			binString.append("1011");
-			break;
-		case 'c':
-			binString.append("1100");
-			break;
-		case 'd':
-			binString.append("1101");
-			break;
-		case 'e':
-			binString.append("1110");
-			break;
-		case 'f':
-			binString.append("1111");
-			break;
-		default:
-			cout << "You have an incorrect character in your hex string" << endl;
-			break;
-		}
-	}
-	return binString;
+void printUsage() {
+	cout << "Usage: b17 [options] <object file>" << endl;
+	cout << "       b17 [options] --schedule <jobs file>" << endl;
+	cout << "  --data <file>      load initial memory from a hex or binary data image (repeatable)" << endl;
+	cout << "  --steps <n>        halt after executing n instructions (per variant or job)" << endl;
+	cout << "  --sweep <file>     run once per variant in file (hex address=value overrides per line)" << endl;
+	cout << "  --block-ops        decode the bulk memory extension: BCPY, BFIL, BSUM and BXOR (see BlockOps.h)" << endl;
+	cout << "  --address-bits <n> extended addressing, 2^n words of memory (13 to 24) in lazily allocated pages" << endl;
+	cout << "  --stream           start running while the object file is still being decoded" << endl;
+	cout << "  --lazy-decode      decode each instruction when it is first fetched, reporting how many were" << endl;
+	cout << "  --image-cache <dir> keep predecoded program images (.b17c) in dir, skipping decoding on later runs" << endl;
+	cout << "  --result-cache <dir> keep run results (.b17r) in dir, replaying the trace when the same run is repeated" << endl;
+	cout << "  --result-cache-size <MB> size the result cache is kept within, least recently used first (default 256)" << endl;
+	cout << "  --profile-out <file> write the execution profile of the run to file" << endl;
+	cout << "  --layout <file>    reorder basic blocks from a profile so hot paths are contiguous (see BlockLayout.h)" << endl;
+	cout << "  --layout-warmup <n> profile the first n steps, then reorder basic blocks for the rest of the run" << endl;
+	cout << "  --optimize         remove redundant instructions before running (traces keep the original addresses)" << endl;
+	cout << "  --lockstep         with --sweep, run variants in SIMD lockstep groups of 64" << endl;
+	cout << "  --expect <golden>  compare the trace with a golden trace (.gz/.xz/.zst allowed), stop at the first difference" << endl;
+	cout << "  --schedule <file>  run the jobs in file (object file [priority=n] [budget=n] [data=file] per line)" << endl;
+	cout << "  --quantum <n>      instructions a scheduled job runs before it is preempted (default 10000)" << endl;
+#ifdef SIMULATE_CACHE
+	cout << "  --cache <file>     cache hierarchy to simulate (see CacheSimulator.h), report in cache_report.txt" << endl;
+#endif
+	cout << "  --devices <file>   place memory-mapped input, output and timer devices listed in file" << endl;
+	cout << "  --host-counters <n> run without a trace, measuring every n-th dispatch with host CPU counters, per opcode" << endl;
+	cout << "  --pipeline <p>     time the run on a five-stage pipeline model with jump predictor p: static, 1bit or 2bit" << endl;
+	cout << "  --no-forwarding    with --pipeline, model a pipeline without forwarding" << endl;
+	cout << "  --dependencies     run without a trace, reporting the critical path and parallelism of the dependencies" << endl;
+	cout << "  --gdb <port|path>  run under a debugger connecting to localhost:port or a Unix socket (gdb remote protocol)" << endl;
+	cout << "  --daemon <socket>  serve runs for b17-client on a Unix socket, with --jobs worker processes (see Daemon.h)" << endl;
+	cout << "  --metrics          publish live metrics in shared memory /b17-<pid> for b17-top" << endl;
+	cout << "  --cores <n>        run the program on n cores sharing memory, AC holding the core number (see MultiCore.h)" << endl;
+	cout << "  --interleave <n>   with --cores, interleave the cores deterministically n instructions at a time (default 1)" << endl;
+	cout << "  --interleave-seed <s> with --interleave, take turns in a random order and length seeded with s" << endl;
+	cout << "  --free-running     with --cores, run every core on its own thread" << endl;
+	cout << "  --jobs <n>         threads to run sweep variants or scheduled jobs on, or daemon workers (default one per core)" << endl;
 }
 
 /************************************************************************
-Function: splitString
+Function: execute
 Author: Jake Davidson
-Description: Splits a string into parts based on whitespace (tokenizer).
-I actually wrote this function for a previous project, but I wrote it.
-Paramaters: s - string to split
-Returns: words - vector of words in string
+Description: Loops throught the list of instructions, exectuing them 
+one by one. If there is a jump, it sets instructionRegister to the address
+of the jump if it is a valid jump. It also prints a trace line
+for each instruction, and the contents of the AC and 4 index registers
+after each instruction has finished executing. This runs until it reaches 
+an error, a halt instruction, the end of the instructions or the step limit.
+Parameters: maxSteps - most instructions to execute, UNLIMITED_STEPS for no limit
+			metrics - live metrics segment to publish to, nullptr for none
+			devices - memory-mapped devices, nullptr for none
+			loader - loader still decoding the program, nullptr if it is loaded
+			lazy - loader decoding instructions as they are fetched, nullptr if they are decoded
+			pipeline - pipeline model timing the run, nullptr for none
 ************************************************************************/
-vector<string> splitString(string s) {
-	stringstream stream; //stream to use
-	vector<string> words; //container for strings
-	string curr = ""; //current string
-	stream.str(s); //add s to our stream
-				   //read until end of stream, splitting on spaces
-	while (getline(stream, curr, ' ')) {
-		words.push_back(curr); //when we have our word, add it to the vector
-	}
-	return words;
+void execute(unsigned long long maxSteps, liveMetrics *metrics, DeviceBus *devices, PipelinedLoader *loader, LazyLoader *lazy,
+	PipelineModel *pipeline) {
+	ExecuteInstruction ins; //container class for instructions and ALU operations
+	ins.setPipelineModel(pipeline);
+	ins.setLoader(loader);
+	ins.setLazyLoader(lazy);
+	ins.setMetrics(metrics);
+	ins.setDevices(devices);
+	if (devices)
+		devices->start();
+	//run instructions until we hit halt, have an error or reach the step limit
+	ins.run(maxSteps);
+	if (!ins.isHalted())
+		cout << "Machine Halted - step limit reached" << endl;
+	//let output devices finish writing
+	if (devices)
+		devices->stop();
 }
+
 /************************************************************************
-Function: pad
+Function: expectTrace
 Author: Jake Davidson
-Description: Pads a binary instruction so that it has the correct number
-of bits for extraction.
-Paramaters: s - string to pad
-Returns: padString - the padded string
+Description: Runs the program like execute, but instead of printing the 
+trace each line is compared with the next line of a golden trace as it is
+produced. Execution stops at the first line that differs, and the line 
+number, both lines and the machine state are printed. Only the result of
+the comparison is output.
+Parameters: file - golden trace to compare with
+			maxSteps - most instructions to execute, UNLIMITED_STEPS for no limit
 ************************************************************************/
-string pad(string s) {
-	string padString = s;
-	//add 0 until string is correct length
-	while (padString.length() < 24)
-		padString = "0" + padString;
-	return padString;
-}
\ No newline at end of file
+void expectTrace(string file, unsigned long long maxSteps) {
+	GoldenTrace golden; //compares trace lines with the golden trace
+	ostream trace(&golden); //stream the trace is written to
+	ExecuteInstruction ins(&trace); //container class for instructions and ALU operations
+	unsigned long long steps; //instructions executed
+
+	if (!golden.open(file)) {
+		cout << "Could not open golden trace, ensure the path is correct." << endl;
+		exit(0);
+	}
+	steps = ins.run(maxSteps);
+	if (!ins.isHalted())
+		trace << "Machine Halted - step limit reached" << endl;
+	if (golden.finish()) {
+		cout << dec << "Trace matches golden trace (" << golden.getLine() << " lines, " << steps << " steps)" << endl;
+		return;
+	}
+	cout << dec << "Trace differs from golden trace at line " << golden.getLine() << " (step " << steps << ")" << endl;
+	cout << "expected: " << golden.getExpected() << endl;
+	cout << "actual:   " << golden.getActual() << endl;
+	//machine state when the difference was found
+	cout << "instruction register: " << hex << setw(3) << setfill('0') << instructionRegister->instructionAddress << endl;
+	ExecuteInstruction(&cout).printRegisters();
+}
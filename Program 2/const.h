@@ -40,6 +40,11 @@ enum opCodes {
 	JZ,
 	JN,
 	JP,
+	//bulk memory extension, only decoded with --block-ops (see BlockOps.h)
+	BCPY,
+	BFIL,
+	BSUM,
+	BXOR,
 	UNDEFINED
 };
 